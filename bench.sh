@@ -0,0 +1,6 @@
+#!/usr/bin/env sh
+# usage: bench.sh [max-elements] > bench_output.txt
+HERE="$(dirname ${0})"
+BUILD="${HERE}/builds"
+[ -d "${BUILD}" ] || mkdir -p "${BUILD}"
+"${HERE}"/build.sh bench >&2 && "${HERE}"/builds/"$(hostname)"/bench "$@"
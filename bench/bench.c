@@ -0,0 +1,299 @@
+/**
+ * Times the pipelines of src/main.c (tests 2 to 4) against equivalent
+ * hand-written loops.
+ *
+ * Usage: bench [max-elements]
+ *
+ * One tab-separated line per pipeline, variant and size on stdout, so
+ * that the output of two commits can be diffed.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "allocator.h"
+#include "allocator_type.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "value_stream_types.h"
+#include "value_streams.h"
+#include "values.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// each measure repeats its run for at least this long and keeps the best
+#define MIN_MEASURE_NS (200 * 1000 * 1000ull)
+#define MIN_MEASURE_RUNS 3
+
+/* the stages of the tests */
+
+static struct Value accumulateFloatIdentity(struct Reducer const *reducer,
+                                            struct Allocator *allocator)
+{
+        return inlineFloatValue(0.0f);
+}
+
+static struct Value accumulateFloatApply(struct Reducer const *reducer,
+                                         void *state, struct Value const input,
+                                         struct Value const current,
+                                         struct Allocator *allocator)
+{
+        return inlineFloatValue(floatOfValue(input) + floatOfValue(current));
+}
+
+static struct Reducer accumulator = {
+    .identity = accumulateFloatIdentity, .apply = accumulateFloatApply,
+};
+
+static bool positiveFloatsOnly(struct Value value, void *data)
+{
+        return value.type_tag == TTAG_FLOAT && floatOfValue(value) > 0.0f;
+}
+
+static struct Value invertFloat(struct Value value, void *data)
+{
+        return inlineFloatValue(-floatOfValue(value));
+}
+
+static bool isIndexBelow(struct Value value, void *data)
+{
+        size_t const *end = data;
+        return value.index < *end;
+}
+
+/* the pipelines and their hand-written equivalents */
+
+static float sumTransducer(float const *values, size_t count,
+                           struct Allocator *allocator)
+{
+        struct ValueStreamRange range;
+        floatArrayVSR(&range, values, count);
+
+        return floatOfValue(reduceStream(&range, &accumulator, allocator));
+}
+
+static float sumLoop(float const *values, size_t count)
+{
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+                sum = values[i] + sum;
+        }
+        return sum;
+}
+
+static float positivesSumTransducer(float const *values, size_t count,
+                                    struct Allocator *allocator)
+{
+        struct Transducer *steps[] = {
+            filteringTransducer(positiveFloatsOnly, NULL, allocator),
+            mappingTransducer(&accumulator, allocator),
+        };
+        struct Transducer *process = composingTransducer(
+            steps, sizeof steps / sizeof steps[0], allocator);
+
+        return floatOfValue(
+            transduceFloatArray(values, count, process, allocator));
+}
+
+static float positivesSumLoop(float const *values, size_t count)
+{
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+                if (values[i] > 0.0f) {
+                        sum = values[i] + sum;
+                }
+        }
+        return sum;
+}
+
+/* test 4 without its printing and counting stages, keeping the first
+ * quarter of the input */
+static float firstNegativesSumTransducer(float const *values, size_t count,
+                                         struct Allocator *allocator)
+{
+        size_t end = count / 4;
+        struct Transducer *steps[] = {
+            mappingFnTransducer(invertFloat, NULL, allocator),
+            filteringTransducer(positiveFloatsOnly, NULL, allocator),
+            indexingTransducer(allocator),
+            filteringTransducer(isIndexBelow, &end, allocator),
+            takingTransducer(end, allocator),
+            mappingTransducer(&accumulator, allocator),
+        };
+        struct Transducer *process = composingTransducer(
+            steps, sizeof steps / sizeof steps[0], allocator);
+
+        struct Value result =
+            transduceFloatArray(values, count, process, allocator);
+        return result.type_tag == TTAG_FLOAT ? floatOfValue(result) : 0.0f;
+}
+
+static float firstNegativesSumLoop(float const *values, size_t count)
+{
+        size_t const end = count / 4;
+        float sum = 0.0f;
+        size_t index = 0;
+        for (size_t i = 0; i < count && index < end; i++) {
+                float const value = -values[i];
+                if (value > 0.0f) {
+                        sum = value + sum;
+                        index++;
+                }
+        }
+        return sum;
+}
+
+struct Pipeline
+{
+        char const *name;
+        float (*transducer)(float const *values, size_t count,
+                            struct Allocator *allocator);
+        float (*loop)(float const *values, size_t count);
+};
+
+static struct Pipeline const pipelines[] = {
+    {"sum", sumTransducer, sumLoop},
+    {"positives-sum", positivesSumTransducer, positivesSumLoop},
+    {"first-negatives-sum", firstNegativesSumTransducer,
+     firstNegativesSumLoop},
+};
+
+/* measures */
+
+static void *stdlib_alloc(struct Allocator *const allocator, size_t size)
+{
+        return malloc(size);
+}
+
+static void stdlib_free(struct Allocator *const allocator, void *ptr)
+{
+        free(ptr);
+}
+
+static unsigned long long nowNs(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ull +
+               (unsigned long long)ts.tv_nsec;
+}
+
+struct Measure
+{
+        float result;
+        unsigned long long ns;
+        size_t allocs;
+};
+
+/**
+ * runs the transducer variant of pipeline when arena is set, the loop
+ * otherwise, and keeps its fastest run.
+ *
+ * Each transducer run allocates from a fresh reset of arena, through
+ * counter, so that all of its allocations are counted.
+ */
+static struct Measure measure(struct Pipeline const *pipeline,
+                              float const *values, size_t count,
+                              struct ArenaAllocator *arena)
+{
+        struct Measure best = {.ns = ~0ull};
+        unsigned long long const start = nowNs();
+
+        for (size_t run = 0;
+             run < MIN_MEASURE_RUNS || nowNs() - start < MIN_MEASURE_NS;
+             run++) {
+                struct CountingAllocator counter;
+                struct Measure current;
+
+                if (arena) {
+                        counting_allocator_init(&counter, &arena->super);
+                        unsigned long long const runStart = nowNs();
+                        current.result = pipeline->transducer(values, count,
+                                                              &counter.super);
+                        current.ns = nowNs() - runStart;
+                        current.allocs = counter.allocs;
+                        arena_allocator_reset(arena);
+                } else {
+                        unsigned long long const runStart = nowNs();
+                        current.result = pipeline->loop(values, count);
+                        current.ns = nowNs() - runStart;
+                        current.allocs = 0;
+                }
+
+                if (current.ns < best.ns) {
+                        best = current;
+                }
+        }
+
+        return best;
+}
+
+static void report(char const *pipeline, char const *variant, size_t count,
+                   struct Measure const *measure,
+                   struct Measure const *baseline)
+{
+        double const ns = measure->ns > 0 ? (double)measure->ns : 1.0;
+        double const baselineNs =
+            baseline->ns > 0 ? (double)baseline->ns : 1.0;
+
+        printf("%s\t%s\t%zu\t%.3f\t%.0f\t%.3f\t%.2f\n", pipeline, variant,
+               count, ns / (double)count, (double)count * 1e9 / ns,
+               (double)measure->allocs / (double)count, ns / baselineNs);
+}
+
+int main(int argc, char **argv)
+{
+        size_t maxCount = 100 * 1000 * 1000;
+        if (argc > 1) {
+                maxCount = strtoull(argv[1], NULL, 10);
+        }
+
+        struct Allocator heapAllocator = {
+            .alloc = stdlib_alloc, .free = stdlib_free,
+        };
+        struct ArenaAllocator arena;
+        arena_allocator_init(&arena, &heapAllocator, 1 << 20);
+
+        float *values = malloc(maxCount * sizeof *values);
+        if (maxCount > 0 && !values) {
+                fprintf(stderr, "cannot allocate %zu elements\n", maxCount);
+                return 1;
+        }
+        for (size_t i = 0; i < maxCount; i++) {
+                values[i] = (float)(i % 7) - 3.0f;
+        }
+
+        int status = 0;
+        printf("pipeline\tvariant\telements\tns_per_element\telements_per_"
+               "second\tallocations_per_element\toverhead_ratio\n");
+        for (size_t p = 0; p < sizeof pipelines / sizeof pipelines[0]; p++) {
+                struct Pipeline const *pipeline = &pipelines[p];
+
+                for (size_t count = 1000; count <= maxCount; count *= 10) {
+                        struct Measure const loop =
+                            measure(pipeline, values, count, NULL);
+                        struct Measure const transducer =
+                            measure(pipeline, values, count, &arena);
+
+                        report(pipeline->name, "loop", count, &loop, &loop);
+                        report(pipeline->name, "transducer", count,
+                               &transducer, &loop);
+                        fflush(stdout);
+
+                        if (transducer.result != loop.result) {
+                                fprintf(stderr,
+                                        "%s: %zu elements: transducer "
+                                        "result %f differs from loop "
+                                        "result %f\n",
+                                        pipeline->name, count,
+                                        transducer.result, loop.result);
+                                status = 1;
+                        }
+                }
+        }
+
+        free(values);
+        arena_allocator_release(&arena);
+
+        return status;
+}
@@ -0,0 +1,401 @@
+/**
+ * @file
+ * Generates a fused C loop from the description of a transducer pipeline.
+ *
+ * @see README.md for the description format
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_SIZE 128
+#define MAX_STAGES 64
+
+enum StageKind {
+        SK_Filter,
+        SK_Map,
+        SK_Mapping,
+        SK_Take,
+        SK_TakeWhile,
+};
+
+struct Stage
+{
+        enum StageKind kind;
+        char function[TOKEN_SIZE];
+        char argument[TOKEN_SIZE];
+};
+
+struct Pipeline
+{
+        char name[TOKEN_SIZE];
+        char elementType[TOKEN_SIZE];
+        char typeTag[TOKEN_SIZE];
+        char include[TOKEN_SIZE];
+        struct Stage stages[MAX_STAGES];
+        size_t stagesCount;
+};
+
+static void die(char const *path, int line, char const *message)
+{
+        fprintf(stderr, "%s:%d: %s\n", path, line, message);
+        exit(1);
+}
+
+/* splits line in at most tokensCapacity whitespace separated tokens */
+static size_t tokenize(char *line, char tokens[][TOKEN_SIZE],
+                       size_t tokensCapacity)
+{
+        size_t count = 0;
+        char *comment = strchr(line, '#');
+        if (comment) {
+                *comment = '\0';
+        }
+
+        for (char *token = strtok(line, " \t\r\n"); token;
+             token = strtok(NULL, " \t\r\n")) {
+                if (count == tokensCapacity ||
+                    strlen(token) >= TOKEN_SIZE) {
+                        return tokensCapacity + 1;
+                }
+                strcpy(tokens[count++], token);
+        }
+
+        return count;
+}
+
+static void parse(FILE *input, char const *path, struct Pipeline *pipeline)
+{
+        char line[1024];
+        int lineNumber = 0;
+
+        while (fgets(line, sizeof line, input)) {
+                char tokens[3][TOKEN_SIZE];
+                lineNumber++;
+                size_t count = tokenize(line, tokens, 3);
+                if (count == 0) {
+                        continue;
+                }
+                if (count > 3) {
+                        die(path, lineNumber, "too many or too long tokens");
+                }
+
+                char const *directive = tokens[0];
+                if (0 == strcmp(directive, "pipeline") && count == 2) {
+                        strcpy(pipeline->name, tokens[1]);
+                } else if (0 == strcmp(directive, "element") && count == 3) {
+                        strcpy(pipeline->elementType, tokens[1]);
+                        strcpy(pipeline->typeTag, tokens[2]);
+                } else if (0 == strcmp(directive, "include") && count == 2) {
+                        strcpy(pipeline->include, tokens[1]);
+                } else {
+                        struct Stage stage = {.kind = SK_Filter};
+                        if (0 == strcmp(directive, "filter") && count == 2) {
+                                stage.kind = SK_Filter;
+                        } else if (0 == strcmp(directive, "map") &&
+                                   count == 2) {
+                                stage.kind = SK_Map;
+                        } else if (0 == strcmp(directive, "mapping") &&
+                                   count == 3) {
+                                stage.kind = SK_Mapping;
+                                strcpy(stage.argument, tokens[2]);
+                        } else if (0 == strcmp(directive, "take") &&
+                                   count == 2) {
+                                stage.kind = SK_Take;
+                                strcpy(stage.argument, tokens[1]);
+                        } else if (0 == strcmp(directive, "take-while") &&
+                                   count == 2) {
+                                stage.kind = SK_TakeWhile;
+                        } else {
+                                die(path, lineNumber, "unknown directive");
+                        }
+                        if (stage.kind != SK_Take) {
+                                strcpy(stage.function, tokens[1]);
+                        }
+                        if (pipeline->stagesCount == MAX_STAGES) {
+                                die(path, lineNumber, "too many stages");
+                        }
+                        pipeline->stages[pipeline->stagesCount++] = stage;
+                }
+        }
+
+        if (!pipeline->name[0] || !pipeline->elementType[0]) {
+                die(path, lineNumber, "missing pipeline or element directive");
+        }
+}
+
+static bool hasStage(struct Pipeline const *pipeline, enum StageKind kind)
+{
+        for (size_t i = 0; i < pipeline->stagesCount; i++) {
+                if (pipeline->stages[i].kind == kind) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void emitFusedLoop(FILE *out, struct Pipeline const *pipeline)
+{
+        char const *type = pipeline->elementType;
+        bool const halts = hasStage(pipeline, SK_Take);
+        bool const filters = hasStage(pipeline, SK_Filter);
+
+        fprintf(out,
+                "/// runs the pipeline over values, returns false when no "
+                "element\n/// reached its end\n");
+        fprintf(out,
+                "static inline bool %s(%s const *values, size_t count, "
+                "%s *result)\n{\n",
+                pipeline->name, type, type);
+        fprintf(out, "        bool hasResult = false;\n");
+        if (halts) {
+                fprintf(out, "        bool halt = false;\n");
+        }
+        for (size_t i = 0; i < pipeline->stagesCount; i++) {
+                struct Stage const *stage = &pipeline->stages[i];
+                if (stage->kind == SK_Mapping) {
+                        fprintf(out, "        %s state%zu = %s;\n", type, i,
+                                stage->argument);
+                } else if (stage->kind == SK_Take) {
+                        fprintf(out, "        size_t remaining%zu = %s;\n", i,
+                                stage->argument);
+                }
+        }
+
+        fprintf(out, "        for (size_t i = 0; i < count; i++) {\n");
+        fprintf(out, "                %s x = values[i];\n", type);
+        for (size_t i = 0; i < pipeline->stagesCount; i++) {
+                struct Stage const *stage = &pipeline->stages[i];
+                switch (stage->kind) {
+                case SK_Filter:
+                        fprintf(out,
+                                "                if (!%s(x)) {\n"
+                                "                        goto next;\n"
+                                "                }\n",
+                                stage->function);
+                        break;
+                case SK_Map:
+                        fprintf(out, "                x = %s(x);\n",
+                                stage->function);
+                        break;
+                case SK_Mapping:
+                        fprintf(out,
+                                "                state%zu = %s(state%zu, x);\n"
+                                "                x = state%zu;\n",
+                                i, stage->function, i, i);
+                        break;
+                case SK_Take:
+                        fprintf(out,
+                                "                if (remaining%zu == 0) {\n"
+                                "                        break;\n"
+                                "                }\n"
+                                "                halt = --remaining%zu == 0 "
+                                "|| halt;\n",
+                                i, i);
+                        break;
+                case SK_TakeWhile:
+                        fprintf(out,
+                                "                if (!%s(x)) {\n"
+                                "                        break;\n"
+                                "                }\n",
+                                stage->function);
+                        break;
+                }
+        }
+        fprintf(out, "                *result = x;\n"
+                     "                hasResult = true;\n");
+        if (filters) {
+                fprintf(out, "        next:\n");
+        }
+        if (halts) {
+                fprintf(out, "                if (halt) {\n"
+                             "                        break;\n"
+                             "                }\n");
+        } else if (filters) {
+                fprintf(out, "                continue;\n");
+        }
+        fprintf(out, "        }\n"
+                     "        return hasResult;\n"
+                     "}\n\n");
+}
+
+static void emitAdapters(FILE *out, struct Pipeline const *pipeline)
+{
+        char const *name = pipeline->name;
+        char const *type = pipeline->elementType;
+
+        fprintf(out,
+                "static inline %s %sElement(struct Value value)\n{\n"
+                "        %s x;\n"
+                "        memcpy(&x, valueAddress(&value), sizeof x);\n"
+                "        return x;\n}\n\n",
+                type, name, type);
+
+        for (size_t i = 0; i < pipeline->stagesCount; i++) {
+                struct Stage const *stage = &pipeline->stages[i];
+                switch (stage->kind) {
+                case SK_Filter:
+                case SK_TakeWhile:
+                        fprintf(out,
+                                "static inline bool %sStage%zu(struct Value "
+                                "value, void *data)\n{\n"
+                                "        return %s(%sElement(value));\n}\n\n",
+                                name, i, stage->function, name);
+                        break;
+                case SK_Map:
+                        fprintf(out,
+                                "static inline struct Value %sStage%zu(struct "
+                                "Value value, void *data)\n{\n"
+                                "        %s x = %s(%sElement(value));\n"
+                                "        return inlineValue(%s, &x, sizeof "
+                                "x);\n}\n\n",
+                                name, i, type, stage->function, name,
+                                pipeline->typeTag);
+                        break;
+                case SK_Mapping:
+                        fprintf(out,
+                                "static inline struct Value "
+                                "%sStage%zuIdentity(struct Reducer const "
+                                "*reducer, struct Allocator *allocator)\n{\n"
+                                "        %s x = %s;\n"
+                                "        return inlineValue(%s, &x, sizeof "
+                                "x);\n}\n\n",
+                                name, i, type, stage->argument,
+                                pipeline->typeTag);
+                        fprintf(out,
+                                "static inline struct Value "
+                                "%sStage%zuApply(struct Reducer const "
+                                "*reducer, void *state, struct Value input, "
+                                "struct Value current, struct Allocator "
+                                "*allocator)\n{\n"
+                                "        %s x = %s(%sElement(current), "
+                                "%sElement(input));\n"
+                                "        return inlineValue(%s, &x, sizeof "
+                                "x);\n}\n\n",
+                                name, i, type, stage->function, name, name,
+                                pipeline->typeTag);
+                        break;
+                case SK_Take:
+                        break;
+                }
+        }
+}
+
+static void emitTransducer(FILE *out, struct Pipeline const *pipeline)
+{
+        char const *name = pipeline->name;
+
+        fprintf(out,
+                "/// the same pipeline, built with composingTransducer\n"
+                "static inline struct Transducer *%sTransducer(struct "
+                "Allocator *allocator)\n{\n",
+                name);
+        fprintf(out,
+                "        struct Transducer **steps = allocator_alloc(allocator, "
+                "%zu * sizeof *steps);\n",
+                pipeline->stagesCount ? pipeline->stagesCount : 1);
+        for (size_t i = 0; i < pipeline->stagesCount; i++) {
+                struct Stage const *stage = &pipeline->stages[i];
+                switch (stage->kind) {
+                case SK_Filter:
+                        fprintf(out,
+                                "        steps[%zu] = filteringTransducer("
+                                "%sStage%zu, NULL, allocator);\n",
+                                i, name, i);
+                        break;
+                case SK_Map:
+                        fprintf(out,
+                                "        steps[%zu] = mappingFnTransducer("
+                                "%sStage%zu, NULL, allocator);\n",
+                                i, name, i);
+                        break;
+                case SK_Mapping:
+                        fprintf(out,
+                                "        {\n"
+                                "                struct Reducer *reducer = "
+                                "allocator_alloc(allocator, sizeof "
+                                "*reducer);\n"
+                                "                *reducer = (struct Reducer){\n"
+                                "                    .identity = "
+                                "%sStage%zuIdentity,\n"
+                                "                    .apply = %sStage%zuApply,\n"
+                                "                };\n"
+                                "                steps[%zu] = "
+                                "mappingTransducer(reducer, allocator);\n"
+                                "        }\n",
+                                name, i, name, i, i);
+                        break;
+                case SK_Take:
+                        fprintf(out,
+                                "        steps[%zu] = takingTransducer(%s, "
+                                "allocator);\n",
+                                i, stage->argument);
+                        break;
+                case SK_TakeWhile:
+                        fprintf(out,
+                                "        steps[%zu] = takingWhileTransducer("
+                                "%sStage%zu, NULL, allocator);\n",
+                                i, name, i);
+                        break;
+                }
+        }
+        fprintf(out,
+                "        return composingTransducer(steps, %zu, allocator);\n"
+                "}\n",
+                pipeline->stagesCount);
+}
+
+static void emit(FILE *out, char const *path, struct Pipeline const *pipeline)
+{
+        fprintf(out, "/* generated by transducer-codegen from %s, do not edit "
+                     "*/\n\n",
+                path);
+        fprintf(out, "#pragma once\n\n");
+        if (pipeline->include[0]) {
+                fprintf(out, "#include %s\n\n", pipeline->include);
+        }
+        fprintf(out, "#include \"allocator.h\"\n"
+                     "#include \"transducer_types.h\"\n"
+                     "#include \"transducers.h\"\n"
+                     "#include \"values.h\"\n\n"
+                     "#include <stdbool.h>\n"
+                     "#include <stddef.h>\n"
+                     "#include <string.h>\n\n");
+        fprintf(out,
+                "_Static_assert(sizeof(%s) <= VALUE_INLINE_SIZE, \"%s "
+                "elements must fit inline in a struct Value\");\n\n",
+                pipeline->elementType, pipeline->elementType);
+
+        emitFusedLoop(out, pipeline);
+        emitAdapters(out, pipeline);
+        emitTransducer(out, pipeline);
+}
+
+int main(int argc, char **argv)
+{
+        if (argc != 3) {
+                fprintf(stderr, "Usage: %s <description> <output header>\n",
+                        argv[0]);
+                return 1;
+        }
+
+        FILE *input = fopen(argv[1], "r");
+        if (!input) {
+                perror(argv[1]);
+                return 1;
+        }
+        static struct Pipeline pipeline;
+        parse(input, argv[1], &pipeline);
+        fclose(input);
+
+        FILE *output = fopen(argv[2], "w");
+        if (!output) {
+                perror(argv[2]);
+                return 1;
+        }
+        emit(output, argv[1], &pipeline);
+
+        return fclose(output) == 0 ? 0 : 1;
+}
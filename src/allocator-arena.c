@@ -0,0 +1,97 @@
+#include "allocator_type.h"
+#include "allocator.h"
+
+#include <stdalign.h>
+
+struct ArenaBlock
+{
+        struct ArenaBlock *next;
+        size_t size;
+        alignas(max_align_t) uint8_t data[];
+};
+
+static size_t alignedSize(size_t size)
+{
+        size_t const alignment = alignof(max_align_t);
+        return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static void useBlock(struct ArenaAllocator *arena, struct ArenaBlock *block)
+{
+        arena->current = block;
+        arena->cursor = block->data;
+        arena->end = block->data + block->size;
+}
+
+/* moves to the next block able to hold size bytes, inserting a new one
+ * after the current block when the following one is too small */
+static void nextBlock(struct ArenaAllocator *arena, size_t size)
+{
+        struct ArenaBlock *next =
+            arena->current ? arena->current->next : arena->first;
+        if (next && next->size >= size) {
+                useBlock(arena, next);
+                return;
+        }
+
+        size_t blockSize = size > arena->block_size ? size : arena->block_size;
+        struct ArenaBlock *block =
+            allocator_alloc(arena->parent, sizeof *block + blockSize);
+        block->size = blockSize;
+        block->next = next;
+        if (arena->current) {
+                arena->current->next = block;
+        } else {
+                arena->first = block;
+        }
+        useBlock(arena, block);
+}
+
+static void *arenaAlloc(struct Allocator *allocator, size_t size)
+{
+        struct ArenaAllocator *self = (struct ArenaAllocator *)allocator;
+        size = alignedSize(size);
+        if ((size_t)(self->end - self->cursor) < size) {
+                nextBlock(self, size);
+        }
+
+        void *result = self->cursor;
+        self->cursor += size;
+
+        return result;
+}
+
+static void arenaFree(struct Allocator *allocator, void *ptr)
+{
+        (void)allocator;
+        (void)ptr;
+}
+
+void arena_allocator_init(struct ArenaAllocator *arena,
+                          struct Allocator *parent, size_t block_size)
+{
+        *arena = (struct ArenaAllocator){
+            .super = {.alloc = arenaAlloc, .free = arenaFree},
+            .parent = parent,
+            .block_size = alignedSize(block_size),
+        };
+}
+
+void arena_allocator_reset(struct ArenaAllocator *arena)
+{
+        arena->current = NULL;
+        arena->cursor = NULL;
+        arena->end = NULL;
+}
+
+void arena_allocator_release(struct ArenaAllocator *arena)
+{
+        struct ArenaBlock *block = arena->first;
+        while (block) {
+                struct ArenaBlock *next = block->next;
+                allocator_free(arena->parent, block);
+                block = next;
+        }
+        arena->first = NULL;
+        arena_allocator_reset(arena);
+}
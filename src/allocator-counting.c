@@ -0,0 +1,25 @@
+#include "allocator_type.h"
+#include "allocator.h"
+
+static void *countingAlloc(struct Allocator *const allocator, size_t size)
+{
+        struct CountingAllocator *self = (struct CountingAllocator *)allocator;
+        self->allocs++;
+        return allocator_alloc(self->parent, size);
+}
+
+static void countingFree(struct Allocator *const allocator, void *ptr)
+{
+        struct CountingAllocator *self = (struct CountingAllocator *)allocator;
+        self->frees++;
+        allocator_free(self->parent, ptr);
+}
+
+void counting_allocator_init(struct CountingAllocator *counter,
+                             struct Allocator *parent)
+{
+        *counter = (struct CountingAllocator){
+            .super = {.alloc = countingAlloc, .free = countingFree},
+            .parent = parent,
+        };
+}
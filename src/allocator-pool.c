@@ -0,0 +1,90 @@
+#include "allocator_type.h"
+#include "allocator.h"
+
+#include <assert.h>
+#include <stdalign.h>
+
+struct PoolSlot
+{
+        struct PoolSlot *next;
+};
+
+struct PoolBlock
+{
+        struct PoolBlock *next;
+        alignas(max_align_t) uint8_t data[];
+};
+
+static void growPool(struct PoolAllocator *pool)
+{
+        size_t const size = pool->slot_size * pool->slots_per_block;
+        struct PoolBlock *block =
+            allocator_alloc(pool->parent, sizeof *block + size);
+        block->next = pool->blocks;
+        pool->blocks = block;
+
+        for (size_t i = pool->slots_per_block; i > 0; i--) {
+                uint8_t *slotAddress = block->data + (i - 1) * pool->slot_size;
+                struct PoolSlot *slot = (struct PoolSlot *)slotAddress;
+                slot->next = pool->free_slots;
+                pool->free_slots = slot;
+        }
+}
+
+static void *poolAlloc(struct Allocator *allocator, size_t size)
+{
+        struct PoolAllocator *self = (struct PoolAllocator *)allocator;
+        assert(size <= self->slot_size);
+        if (size > self->slot_size) {
+                return NULL;
+        }
+
+        if (!self->free_slots) {
+                growPool(self);
+        }
+
+        struct PoolSlot *slot = self->free_slots;
+        self->free_slots = slot->next;
+
+        return slot;
+}
+
+static void poolFree(struct Allocator *allocator, void *ptr)
+{
+        struct PoolAllocator *self = (struct PoolAllocator *)allocator;
+        if (!ptr) {
+                return;
+        }
+
+        struct PoolSlot *slot = ptr;
+        slot->next = self->free_slots;
+        self->free_slots = slot;
+}
+
+void pool_allocator_init(struct PoolAllocator *pool, struct Allocator *parent,
+                         size_t slot_size, size_t slots_per_block)
+{
+        size_t const alignment = alignof(max_align_t);
+        if (slot_size < sizeof(struct PoolSlot)) {
+                slot_size = sizeof(struct PoolSlot);
+        }
+
+        *pool = (struct PoolAllocator){
+            .super = {.alloc = poolAlloc, .free = poolFree},
+            .parent = parent,
+            .slot_size = (slot_size + alignment - 1) & ~(alignment - 1),
+            .slots_per_block = slots_per_block ? slots_per_block : 1,
+        };
+}
+
+void pool_allocator_release(struct PoolAllocator *pool)
+{
+        struct PoolBlock *block = pool->blocks;
+        while (block) {
+                struct PoolBlock *next = block->next;
+                allocator_free(pool->parent, block);
+                block = next;
+        }
+        pool->blocks = NULL;
+        pool->free_slots = NULL;
+}
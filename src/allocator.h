@@ -3,6 +3,34 @@
 #include <stddef.h> /* for size_t */
 
 struct Allocator;
+struct ArenaAllocator;
+struct PoolAllocator;
+struct CountingAllocator;
 
 void *allocator_alloc(struct Allocator *allocator, size_t size);
 void allocator_free(struct Allocator *allocator, void *ptr);
+
+/**
+ * Arenas are meant to be scoped to one reduction, i.e. one call to
+ * reduceStream or transduceFloatArray:
+ *
+ * - init an arena on top of a long-lived allocator,
+ * - pass &arena.super as the allocator of the reduction, so that the
+ *   reducer chain, its staging buffers and all intermediate values come
+ *   from the arena,
+ * - read what is needed out of the value returned by reducer_complete,
+ * - reset the arena (to reuse its blocks for the next reduction) or
+ *   release it.
+ */
+void arena_allocator_init(struct ArenaAllocator *arena,
+                          struct Allocator *parent, size_t block_size);
+void arena_allocator_reset(struct ArenaAllocator *arena);
+void arena_allocator_release(struct ArenaAllocator *arena);
+
+/// pool of slots of slot_size bytes, obtained slots_per_block at a time
+void pool_allocator_init(struct PoolAllocator *pool, struct Allocator *parent,
+                         size_t slot_size, size_t slots_per_block);
+void pool_allocator_release(struct PoolAllocator *pool);
+
+void counting_allocator_init(struct CountingAllocator *counter,
+                             struct Allocator *parent);
@@ -1,9 +1,56 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct Allocator
 {
         void *(*alloc)(struct Allocator *self, size_t size);
         void (*free)(struct Allocator *self, void *ptr);
 };
+
+struct ArenaBlock;
+
+/**
+ * Bump allocator.
+ *
+ * Frees are no-ops, all allocations die together when the arena is reset.
+ * Blocks obtained from the parent allocator are kept across resets.
+ */
+struct ArenaAllocator
+{
+        struct Allocator super;
+        struct Allocator *parent;
+        size_t block_size;
+        struct ArenaBlock *first;
+        struct ArenaBlock *current;
+        uint8_t *cursor;
+        uint8_t *end;
+};
+
+struct PoolBlock;
+struct PoolSlot;
+
+/**
+ * Free-list allocator for blocks of a fixed size, such as Value payloads.
+ */
+struct PoolAllocator
+{
+        struct Allocator super;
+        struct Allocator *parent;
+        size_t slot_size;
+        size_t slots_per_block;
+        struct PoolBlock *blocks;
+        struct PoolSlot *free_slots;
+};
+
+/**
+ * Forwards to its parent allocator, counting the calls.
+ */
+struct CountingAllocator
+{
+        struct Allocator super;
+        struct Allocator *parent;
+        size_t allocs;
+        size_t frees;
+};
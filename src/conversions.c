@@ -0,0 +1,576 @@
+#include "conversions.h"
+
+#include "allocator.h"
+#include "kernel_dispatch.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <math.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* size in bytes of the buffer in which a stage converts its input before
+ * forwarding it downstream */
+#define CONVERSION_BUFFER_SIZE 8192
+
+struct ConversionKernels
+{
+        char const *name;
+        void (*uint8ToFloat)(uint8_t const *input, size_t count, float scale,
+                             float offset, float *output);
+        void (*int16ToFloat)(int16_t const *input, size_t count, float scale,
+                             float offset, float *output);
+        void (*floatToUint8)(float const *input, size_t count, float scale,
+                             float offset, uint8_t *output);
+        void (*floatToInt16)(float const *input, size_t count, float scale,
+                             float offset, int16_t *output);
+};
+
+static float saturatef(float y, float lowest, float highest)
+{
+        if (!(y >= lowest)) {
+                return lowest;
+        }
+        return y > highest ? highest : y;
+}
+
+static void scalarUint8ToFloat(uint8_t const *input, size_t count,
+                               float scale, float offset, float *output)
+{
+        for (size_t i = 0; i < count; i++) {
+                output[i] = scale * (float)input[i] + offset;
+        }
+}
+
+static void scalarInt16ToFloat(int16_t const *input, size_t count,
+                               float scale, float offset, float *output)
+{
+        for (size_t i = 0; i < count; i++) {
+                output[i] = scale * (float)input[i] + offset;
+        }
+}
+
+static void scalarFloatToUint8(float const *input, size_t count, float scale,
+                               float offset, uint8_t *output)
+{
+        for (size_t i = 0; i < count; i++) {
+                output[i] = (uint8_t)nearbyintf(
+                    saturatef(scale * input[i] + offset, 0.0f, 255.0f));
+        }
+}
+
+static void scalarFloatToInt16(float const *input, size_t count, float scale,
+                               float offset, int16_t *output)
+{
+        for (size_t i = 0; i < count; i++) {
+                output[i] = (int16_t)nearbyintf(saturatef(
+                    scale * input[i] + offset, -32768.0f, 32767.0f));
+        }
+}
+
+static struct ConversionKernels const scalarKernels = {
+    .name = "scalar",
+    .uint8ToFloat = scalarUint8ToFloat,
+    .int16ToFloat = scalarInt16ToFloat,
+    .floatToUint8 = scalarFloatToUint8,
+    .floatToInt16 = scalarFloatToInt16,
+};
+
+#if defined(KERNELS_X86)
+
+/* max and min return their second operand when the first one is NaN */
+#define SATURATE_PS(y, lowest, highest)                                        \
+        _mm_min_ps(_mm_max_ps((y), (lowest)), (highest))
+#define SATURATE256_PS(y, lowest, highest)                                     \
+        _mm256_min_ps(_mm256_max_ps((y), (lowest)), (highest))
+
+TARGET("sse2")
+static void sse2Uint8ToFloat(uint8_t const *input, size_t count, float scale,
+                             float offset, float *output)
+{
+        __m128 const a = _mm_set1_ps(scale);
+        __m128 const b = _mm_set1_ps(offset);
+        __m128i const zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+                __m128i const x =
+                    _mm_loadu_si128((__m128i const *)(input + i));
+                __m128i const low = _mm_unpacklo_epi8(x, zero);
+                __m128i const high = _mm_unpackhi_epi8(x, zero);
+                __m128i const words[] = {
+                    _mm_unpacklo_epi16(low, zero),
+                    _mm_unpackhi_epi16(low, zero),
+                    _mm_unpacklo_epi16(high, zero),
+                    _mm_unpackhi_epi16(high, zero),
+                };
+                for (size_t k = 0; k < 4; k++) {
+                        __m128 const y = _mm_cvtepi32_ps(words[k]);
+                        _mm_storeu_ps(output + i + 4 * k,
+                                      _mm_add_ps(_mm_mul_ps(a, y), b));
+                }
+        }
+        scalarUint8ToFloat(input + i, count - i, scale, offset, output + i);
+}
+
+TARGET("sse2")
+static void sse2Int16ToFloat(int16_t const *input, size_t count, float scale,
+                             float offset, float *output)
+{
+        __m128 const a = _mm_set1_ps(scale);
+        __m128 const b = _mm_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m128i const x =
+                    _mm_loadu_si128((__m128i const *)(input + i));
+                /* sign extension: the halves moved up, shifted back */
+                __m128i const low =
+                    _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                __m128i const high =
+                    _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                _mm_storeu_ps(output + i,
+                              _mm_add_ps(_mm_mul_ps(a, _mm_cvtepi32_ps(low)),
+                                         b));
+                _mm_storeu_ps(output + i + 4,
+                              _mm_add_ps(_mm_mul_ps(a, _mm_cvtepi32_ps(high)),
+                                         b));
+        }
+        scalarInt16ToFloat(input + i, count - i, scale, offset, output + i);
+}
+
+TARGET("sse2")
+static void sse2FloatToUint8(float const *input, size_t count, float scale,
+                             float offset, uint8_t *output)
+{
+        __m128 const a = _mm_set1_ps(scale);
+        __m128 const b = _mm_set1_ps(offset);
+        __m128 const lowest = _mm_setzero_ps();
+        __m128 const highest = _mm_set1_ps(255.0f);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+                __m128i words[4];
+                for (size_t k = 0; k < 4; k++) {
+                        __m128 const y = _mm_add_ps(
+                            _mm_mul_ps(a, _mm_loadu_ps(input + i + 4 * k)), b);
+                        words[k] = _mm_cvtps_epi32(
+                            SATURATE_PS(y, lowest, highest));
+                }
+                __m128i const low = _mm_packs_epi32(words[0], words[1]);
+                __m128i const high = _mm_packs_epi32(words[2], words[3]);
+                _mm_storeu_si128((__m128i *)(output + i),
+                                 _mm_packus_epi16(low, high));
+        }
+        scalarFloatToUint8(input + i, count - i, scale, offset, output + i);
+}
+
+TARGET("sse2")
+static void sse2FloatToInt16(float const *input, size_t count, float scale,
+                             float offset, int16_t *output)
+{
+        __m128 const a = _mm_set1_ps(scale);
+        __m128 const b = _mm_set1_ps(offset);
+        __m128 const lowest = _mm_set1_ps(-32768.0f);
+        __m128 const highest = _mm_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m128 const low =
+                    _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(input + i)), b);
+                __m128 const high =
+                    _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(input + i + 4)), b);
+                _mm_storeu_si128(
+                    (__m128i *)(output + i),
+                    _mm_packs_epi32(
+                        _mm_cvtps_epi32(SATURATE_PS(low, lowest, highest)),
+                        _mm_cvtps_epi32(SATURATE_PS(high, lowest, highest))));
+        }
+        scalarFloatToInt16(input + i, count - i, scale, offset, output + i);
+}
+
+static struct ConversionKernels const sse2Kernels = {
+    .name = "sse2",
+    .uint8ToFloat = sse2Uint8ToFloat,
+    .int16ToFloat = sse2Int16ToFloat,
+    .floatToUint8 = sse2FloatToUint8,
+    .floatToInt16 = sse2FloatToInt16,
+};
+
+TARGET("avx2")
+static void avx2Uint8ToFloat(uint8_t const *input, size_t count, float scale,
+                             float offset, float *output)
+{
+        __m256 const a = _mm256_set1_ps(scale);
+        __m256 const b = _mm256_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256i const x = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((__m128i const *)(input + i)));
+                _mm256_storeu_ps(
+                    output + i,
+                    _mm256_add_ps(_mm256_mul_ps(a, _mm256_cvtepi32_ps(x)), b));
+        }
+        scalarUint8ToFloat(input + i, count - i, scale, offset, output + i);
+}
+
+TARGET("avx2")
+static void avx2Int16ToFloat(int16_t const *input, size_t count, float scale,
+                             float offset, float *output)
+{
+        __m256 const a = _mm256_set1_ps(scale);
+        __m256 const b = _mm256_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256i const x = _mm256_cvtepi16_epi32(
+                    _mm_loadu_si128((__m128i const *)(input + i)));
+                _mm256_storeu_ps(
+                    output + i,
+                    _mm256_add_ps(_mm256_mul_ps(a, _mm256_cvtepi32_ps(x)), b));
+        }
+        scalarInt16ToFloat(input + i, count - i, scale, offset, output + i);
+}
+
+/* the eight words of x, saturated to 16 bits */
+TARGET("avx2") static __m128i avx2PackWords(__m256i x)
+{
+        return _mm_packs_epi32(_mm256_castsi256_si128(x),
+                               _mm256_extracti128_si256(x, 1));
+}
+
+TARGET("avx2")
+static void avx2FloatToUint8(float const *input, size_t count, float scale,
+                             float offset, uint8_t *output)
+{
+        __m256 const a = _mm256_set1_ps(scale);
+        __m256 const b = _mm256_set1_ps(offset);
+        __m256 const lowest = _mm256_setzero_ps();
+        __m256 const highest = _mm256_set1_ps(255.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256 const y = _mm256_add_ps(
+                    _mm256_mul_ps(a, _mm256_loadu_ps(input + i)), b);
+                __m128i const words = avx2PackWords(
+                    _mm256_cvtps_epi32(SATURATE256_PS(y, lowest, highest)));
+                _mm_storel_epi64((__m128i *)(output + i),
+                                 _mm_packus_epi16(words, words));
+        }
+        scalarFloatToUint8(input + i, count - i, scale, offset, output + i);
+}
+
+TARGET("avx2")
+static void avx2FloatToInt16(float const *input, size_t count, float scale,
+                             float offset, int16_t *output)
+{
+        __m256 const a = _mm256_set1_ps(scale);
+        __m256 const b = _mm256_set1_ps(offset);
+        __m256 const lowest = _mm256_set1_ps(-32768.0f);
+        __m256 const highest = _mm256_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256 const y = _mm256_add_ps(
+                    _mm256_mul_ps(a, _mm256_loadu_ps(input + i)), b);
+                _mm_storeu_si128((__m128i *)(output + i),
+                                 avx2PackWords(_mm256_cvtps_epi32(
+                                     SATURATE256_PS(y, lowest, highest))));
+        }
+        scalarFloatToInt16(input + i, count - i, scale, offset, output + i);
+}
+
+static struct ConversionKernels const avx2Kernels = {
+    .name = "avx2",
+    .uint8ToFloat = avx2Uint8ToFloat,
+    .int16ToFloat = avx2Int16ToFloat,
+    .floatToUint8 = avx2FloatToUint8,
+    .floatToInt16 = avx2FloatToInt16,
+};
+
+#endif
+
+static void const *selectKernels(enum KernelLevel level)
+{
+#if defined(KERNELS_X86)
+        if (level == KL_AVX2) {
+                return &avx2Kernels;
+        }
+        if (level == KL_SSE2) {
+                return &sse2Kernels;
+        }
+#endif
+        return &scalarKernels;
+}
+
+static struct ConversionKernels const *conversionKernels(void)
+{
+        static struct KernelDispatch dispatch = {.select = selectKernels};
+        return dispatchKernels(&dispatch);
+}
+
+char const *conversionKernelsName(void)
+{
+        return conversionKernels()->name;
+}
+
+/* the other conversions, one element at a time */
+
+static double readNumeric(uint32_t type_tag, uint8_t const *element)
+{
+        switch (type_tag) {
+        case TTAG_FLOAT: {
+                float x;
+                memcpy(&x, element, sizeof x);
+                return x;
+        }
+        case TTAG_DOUBLE: {
+                double x;
+                memcpy(&x, element, sizeof x);
+                return x;
+        }
+        case TTAG_INT64: {
+                int64_t x;
+                memcpy(&x, element, sizeof x);
+                return (double)x;
+        }
+        case TTAG_INT32: {
+                int32_t x;
+                memcpy(&x, element, sizeof x);
+                return x;
+        }
+        case TTAG_INT16: {
+                int16_t x;
+                memcpy(&x, element, sizeof x);
+                return x;
+        }
+        case TTAG_UINT8:
+                return *element;
+        }
+        return 0.0;
+}
+
+static double saturate(double y, double lowest, double highest)
+{
+        if (!(y >= lowest)) {
+                return lowest;
+        }
+        return y > highest ? highest : y;
+}
+
+static void writeNumeric(uint32_t type_tag, double y, uint8_t *element)
+{
+        switch (type_tag) {
+        case TTAG_FLOAT: {
+                float const x = (float)y;
+                memcpy(element, &x, sizeof x);
+                break;
+        }
+        case TTAG_DOUBLE:
+                memcpy(element, &y, sizeof y);
+                break;
+        case TTAG_INT64: {
+                /* the largest double below 2^63 */
+                int64_t const x = (int64_t)saturate(
+                    nearbyint(y), -9223372036854775808.0,
+                    9223372036854774784.0);
+                memcpy(element, &x, sizeof x);
+                break;
+        }
+        case TTAG_INT32: {
+                int32_t const x = (int32_t)saturate(
+                    nearbyint(y), -2147483648.0, 2147483647.0);
+                memcpy(element, &x, sizeof x);
+                break;
+        }
+        case TTAG_INT16: {
+                int16_t const x =
+                    (int16_t)saturate(nearbyint(y), -32768.0, 32767.0);
+                memcpy(element, &x, sizeof x);
+                break;
+        }
+        case TTAG_UINT8:
+                *element = (uint8_t)saturate(nearbyint(y), 0.0, 255.0);
+                break;
+        }
+}
+
+struct ConvertingTransducer
+{
+        struct Transducer super;
+        uint32_t to_type_tag;
+        double scale;
+        double offset;
+};
+
+struct ConvertingReducer
+{
+        struct ChainedReducer super;
+        struct ConversionKernels const *kernels;
+        uint32_t toTypeTag;
+        size_t toSize;
+        double scale;
+        double offset;
+};
+
+struct ConvertingState
+{
+        alignas(max_align_t) uint8_t output[CONVERSION_BUFFER_SIZE];
+};
+
+static bool isNumericSpan(struct ValueSpan span)
+{
+        return span.element_size > 0 &&
+               span.element_size == typeTagSize(span.type_tag);
+}
+
+static void convert(struct ConvertingReducer const *self, uint32_t fromTypeTag,
+                    uint8_t const *input, size_t count, uint8_t *output)
+{
+        struct ConversionKernels const *kernels = self->kernels;
+        size_t const fromSize = typeTagSize(fromTypeTag);
+        float const scale = (float)self->scale;
+        float const offset = (float)self->offset;
+
+        uint32_t const to = self->toTypeTag;
+        if ((uintptr_t)input % fromSize == 0) {
+                if (fromTypeTag == TTAG_UINT8 && to == TTAG_FLOAT) {
+                        kernels->uint8ToFloat(input, count, scale, offset,
+                                              (float *)output);
+                        return;
+                }
+                if (fromTypeTag == TTAG_INT16 && to == TTAG_FLOAT) {
+                        kernels->int16ToFloat((int16_t const *)input, count,
+                                              scale, offset, (float *)output);
+                        return;
+                }
+                if (fromTypeTag == TTAG_FLOAT && to == TTAG_UINT8) {
+                        kernels->floatToUint8((float const *)input, count,
+                                              scale, offset, output);
+                        return;
+                }
+                if (fromTypeTag == TTAG_FLOAT && to == TTAG_INT16) {
+                        kernels->floatToInt16((float const *)input, count,
+                                              scale, offset,
+                                              (int16_t *)output);
+                        return;
+                }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+                double const x = readNumeric(fromTypeTag, input + i * fromSize);
+                writeNumeric(to, self->scale * x + self->offset,
+                             output + i * self->toSize);
+        }
+}
+
+static struct Value convertingReducerApply(struct Reducer const *reducer,
+                                           void *state, struct Value input,
+                                           struct Value current,
+                                           struct Allocator *allocator)
+{
+        struct ConvertingReducer const *self =
+            (struct ConvertingReducer const *)reducer;
+        void *stepState = chainedStepState(&self->super, state);
+
+        if (input.element_size == 0 ||
+            input.element_size != typeTagSize(input.type_tag)) {
+                return reducer_apply(self->super.step, stepState, input,
+                                     current, allocator);
+        }
+
+        uint8_t output[VALUE_INLINE_SIZE];
+        convert(self, input.type_tag, valueAddress(&input), 1, output);
+        struct Value result =
+            inlineValue(self->toTypeTag, output, self->toSize);
+        if (isIndexed(input)) {
+                result = indexedValue(result, input.index);
+        }
+
+        return reducer_apply(self->super.step, stepState, result, current,
+                             allocator);
+}
+
+/* converts the span a buffer at a time, the indices of its elements
+ * following them */
+static struct Value convertingReducerApplyBatch(struct Reducer const *reducer,
+                                                void *state,
+                                                struct ValueSpan span,
+                                                struct Value current,
+                                                struct Allocator *allocator)
+{
+        struct ConvertingReducer const *self =
+            (struct ConvertingReducer const *)reducer;
+
+        if (!isNumericSpan(span)) {
+                for (uint8_t const *element = span.first;
+                     element < span.last && !isReduced(current);
+                     element += span.element_size) {
+                        current = convertingReducerApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        uint8_t *output = ((struct ConvertingState *)state)->output;
+        void *stepState = chainedStepState(&self->super, state);
+        size_t const chunkCount = CONVERSION_BUFFER_SIZE / self->toSize;
+        uint8_t const *first = span.first;
+        while (first < span.last && !isReduced(current)) {
+                size_t count = (size_t)(span.last - first) / span.element_size;
+                count = count > chunkCount ? chunkCount : count;
+                uint8_t const *last = first + count * span.element_size;
+
+                convert(self, span.type_tag, first, count, output);
+                struct ValueSpan converted = {
+                    .type_tag = self->toTypeTag,
+                    .element_size = self->toSize,
+                    .first = output,
+                    .last = output + count * self->toSize,
+                    .indices = subSpan(span, first, last).indices,
+                };
+                current = reducer_apply_batch(self->super.step, stepState,
+                                              converted, current, allocator);
+                first = last;
+        }
+
+        return current;
+}
+
+static struct Reducer *
+convertingTransducerApply(struct Transducer *transducer,
+                          struct Reducer const *step,
+                          struct Allocator *allocator)
+{
+        struct ConvertingTransducer *self =
+            (struct ConvertingTransducer *)transducer;
+        struct ConvertingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->super = chainedReducerMake(step, convertingReducerApply,
+                                           sizeof(struct ConvertingState));
+        result->super.super.apply_batch = convertingReducerApplyBatch;
+        chainedReducerCombineThroughStep(&result->super);
+        result->kernels = conversionKernels();
+        result->toTypeTag = self->to_type_tag;
+        result->toSize = typeTagSize(self->to_type_tag);
+        result->scale = self->scale;
+        result->offset = self->offset;
+
+        return &result->super.super;
+}
+
+struct Transducer *convertingTransducer(uint32_t to_type_tag, double scale,
+                                        double offset,
+                                        struct Allocator *allocator)
+{
+        struct ConvertingTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct ConvertingTransducer){
+            .to_type_tag = to_type_tag,
+            .scale = scale,
+            .offset = offset,
+            .super = (struct Transducer){
+                .apply = convertingTransducerApply,
+            }};
+
+        return &transducer->super;
+}
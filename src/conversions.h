@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @file
+ * Conversions between the numeric types of values.
+ *
+ * A converting stage turns each numeric element into to_type_tag as
+ * scale * x + offset. Conversions to an integer type round to the nearest
+ * (ties to even) and saturate, NaN giving the lowest value of the type.
+ *
+ * Spans are converted whole, with vectorized kernels (AVX2 or SSE2 when
+ * the CPU has them) between uint8, int16 and float, in which case the
+ * arithmetic is done in float. Other conversions are done in double with
+ * scalar code. Elements of other types go through unchanged.
+ */
+
+struct Allocator;
+struct Transducer;
+
+#include <stdint.h>
+
+/// name of the kernels selected for this CPU
+char const *conversionKernelsName(void);
+
+/// to_type_tag is one of the numeric types
+struct Transducer *convertingTransducer(uint32_t to_type_tag, double scale,
+                                        double offset,
+                                        struct Allocator *allocator);
@@ -0,0 +1,535 @@
+#include "float_kernels.h"
+
+#include "allocator.h"
+#include "kernel_dispatch.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+
+/* number of floats a stage produces before forwarding them downstream */
+#define FLOAT_CHUNK_SIZE 1024
+
+struct FloatKernels
+{
+        char const *name;
+        float (*sum)(float const *values, size_t count);
+        /* writes the values above threshold to output, returns their count */
+        size_t (*filterAbove)(float const *values, size_t count,
+                              float threshold, float *output);
+        void (*affine)(float const *values, size_t count, float scale,
+                       float offset, float *output);
+};
+
+static float scalarSum(float const *values, size_t count)
+{
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+                sum += values[i];
+        }
+        return sum;
+}
+
+static size_t scalarFilterAbove(float const *values, size_t count,
+                                float threshold, float *output)
+{
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+                float const x = values[i];
+                output[n] = x;
+                n += x > threshold;
+        }
+        return n;
+}
+
+static void scalarAffine(float const *values, size_t count, float scale,
+                         float offset, float *output)
+{
+        for (size_t i = 0; i < count; i++) {
+                output[i] = scale * values[i] + offset;
+        }
+}
+
+static struct FloatKernels const scalarKernels = {
+    .name = "scalar",
+    .sum = scalarSum,
+    .filterAbove = scalarFilterAbove,
+    .affine = scalarAffine,
+};
+
+#if defined(KERNELS_X86)
+
+TARGET("sse2") static float sse2Sum(float const *values, size_t count)
+{
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                acc0 = _mm_add_ps(acc0, _mm_loadu_ps(values + i));
+                acc1 = _mm_add_ps(acc1, _mm_loadu_ps(values + i + 4));
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+        float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < count; i++) {
+                sum += values[i];
+        }
+        return sum;
+}
+
+TARGET("sse2")
+static size_t sse2FilterAbove(float const *values, size_t count,
+                              float threshold, float *output)
+{
+        __m128 const t = _mm_set1_ps(threshold);
+        size_t n = 0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+                __m128 const x = _mm_loadu_ps(values + i);
+                int const mask = _mm_movemask_ps(_mm_cmpgt_ps(x, t));
+                if (mask == 0xf) {
+                        _mm_storeu_ps(output + n, x);
+                        n += 4;
+                } else if (mask) {
+                        for (int lane = 0; lane < 4; lane++) {
+                                output[n] = values[i + lane];
+                                n += (mask >> lane) & 1;
+                        }
+                }
+        }
+        return n + scalarFilterAbove(values + i, count - i, threshold,
+                                     output + n);
+}
+
+TARGET("sse2")
+static void sse2Affine(float const *values, size_t count, float scale,
+                       float offset, float *output)
+{
+        __m128 const a = _mm_set1_ps(scale);
+        __m128 const b = _mm_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+                __m128 const x = _mm_loadu_ps(values + i);
+                _mm_storeu_ps(output + i, _mm_add_ps(_mm_mul_ps(a, x), b));
+        }
+        scalarAffine(values + i, count - i, scale, offset, output + i);
+}
+
+static struct FloatKernels const sse2Kernels = {
+    .name = "sse2",
+    .sum = sse2Sum,
+    .filterAbove = sse2FilterAbove,
+    .affine = sse2Affine,
+};
+
+/* permutations moving the lanes selected by a mask to the front */
+static alignas(32) int32_t avx2CompactionTable[256][8];
+
+static void avx2InitCompactionTable(void)
+{
+        for (int mask = 0; mask < 256; mask++) {
+                int n = 0;
+                for (int lane = 0; lane < 8; lane++) {
+                        if (mask & (1 << lane)) {
+                                avx2CompactionTable[mask][n++] = lane;
+                        }
+                }
+                while (n < 8) {
+                        avx2CompactionTable[mask][n++] = 0;
+                }
+        }
+}
+
+TARGET("avx2") static float avx2Sum(float const *values, size_t count)
+{
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+                acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(values + i));
+                acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(values + i + 8));
+        }
+
+        __m256 const acc = _mm256_add_ps(acc0, acc1);
+        __m128 const half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                                       _mm256_extractf128_ps(acc, 1));
+        float lanes[4];
+        _mm_storeu_ps(lanes, half);
+        float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < count; i++) {
+                sum += values[i];
+        }
+        return sum;
+}
+
+TARGET("avx2")
+static size_t avx2FilterAbove(float const *values, size_t count,
+                              float threshold, float *output)
+{
+        __m256 const t = _mm256_set1_ps(threshold);
+        size_t n = 0;
+        size_t i = 0;
+        /* n <= i so the full-width stores stay within [0, count) */
+        for (; i + 8 <= count; i += 8) {
+                __m256 const x = _mm256_loadu_ps(values + i);
+                int const mask =
+                    _mm256_movemask_ps(_mm256_cmp_ps(x, t, _CMP_GT_OQ));
+                __m256i const permutation = _mm256_load_si256(
+                    (__m256i const *)avx2CompactionTable[mask]);
+                _mm256_storeu_ps(output + n,
+                                 _mm256_permutevar8x32_ps(x, permutation));
+                n += (size_t)__builtin_popcount((unsigned)mask);
+        }
+        return n + scalarFilterAbove(values + i, count - i, threshold,
+                                     output + n);
+}
+
+TARGET("avx2")
+static void avx2Affine(float const *values, size_t count, float scale,
+                       float offset, float *output)
+{
+        __m256 const a = _mm256_set1_ps(scale);
+        __m256 const b = _mm256_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256 const x = _mm256_loadu_ps(values + i);
+                _mm256_storeu_ps(output + i,
+                                 _mm256_add_ps(_mm256_mul_ps(a, x), b));
+        }
+        scalarAffine(values + i, count - i, scale, offset, output + i);
+}
+
+static struct FloatKernels const avx2Kernels = {
+    .name = "avx2",
+    .sum = avx2Sum,
+    .filterAbove = avx2FilterAbove,
+    .affine = avx2Affine,
+};
+
+#endif
+
+static void const *selectKernels(enum KernelLevel level)
+{
+#if defined(KERNELS_X86)
+        if (level == KL_AVX2) {
+                avx2InitCompactionTable();
+                return &avx2Kernels;
+        }
+        if (level == KL_SSE2) {
+                return &sse2Kernels;
+        }
+#endif
+        return &scalarKernels;
+}
+
+static struct FloatKernels const *floatKernels(void)
+{
+        static struct KernelDispatch dispatch = {.select = selectKernels};
+        return dispatchKernels(&dispatch);
+}
+
+char const *floatKernelsName(void)
+{
+        return floatKernels()->name;
+}
+
+static bool isFloatSpan(struct ValueSpan span)
+{
+        return span.type_tag == TTAG_FLOAT &&
+               span.element_size == sizeof(float) &&
+               (uintptr_t)span.first % alignof(float) == 0;
+}
+
+static struct ValueSpan floatSpan(float const *first, float const *last)
+{
+        return (struct ValueSpan){
+            .type_tag = TTAG_FLOAT,
+            .element_size = sizeof(float),
+            .first = (uint8_t const *)first,
+            .last = (uint8_t const *)last,
+        };
+}
+
+struct FloatSumReducer
+{
+        struct Reducer super;
+        struct FloatKernels const *kernels;
+};
+
+static struct Value floatSumReducerIdentity(struct Reducer const *reducer,
+                                            struct Allocator *allocator)
+{
+        return inlineFloatValue(0.0f);
+}
+
+static struct Value floatSumReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        return inlineFloatValue(floatOfValue(current) + floatOfValue(input));
+}
+
+static struct Value floatSumReducerCombine(struct Reducer const *reducer,
+                                           struct Value left,
+                                           struct Value right,
+                                           struct Allocator *allocator)
+{
+        return inlineFloatValue(floatOfValue(left) + floatOfValue(right));
+}
+
+static struct Value floatSumReducerApplyBatch(struct Reducer const *reducer,
+                                              void *state,
+                                              struct ValueSpan span,
+                                              struct Value current,
+                                              struct Allocator *allocator)
+{
+        struct FloatSumReducer const *self =
+            (struct FloatSumReducer const *)reducer;
+        if (!isFloatSpan(span)) {
+                for (uint8_t const *element = span.first; element < span.last;
+                     element += span.element_size) {
+                        current = floatSumReducerApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        size_t const count = (size_t)(span.last - span.first) / sizeof(float);
+        return inlineFloatValue(
+            floatOfValue(current) +
+            self->kernels->sum((float const *)span.first, count));
+}
+
+struct Reducer *floatSumReducer(struct Allocator *allocator)
+{
+        struct FloatSumReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct FloatSumReducer){
+            .super =
+                {
+                    .identity = floatSumReducerIdentity,
+                    .apply = floatSumReducerApply,
+                    .apply_batch = floatSumReducerApplyBatch,
+                    .combine = floatSumReducerCombine,
+                },
+            .kernels = floatKernels(),
+        };
+
+        return &result->super;
+}
+
+struct FloatStageTransducer
+{
+        struct Transducer super;
+        float a;
+        float b;
+};
+
+/* reducer of the filtering (a: threshold) and affine (a * x + b) stages */
+struct FloatStageReducer
+{
+        struct ChainedReducer super;
+        struct FloatKernels const *kernels;
+        float a;
+        float b;
+};
+
+struct FloatStageState
+{
+        float output[FLOAT_CHUNK_SIZE];
+};
+
+static struct Reducer *
+newFloatStageReducer(struct Transducer *transducer, struct Reducer const *step,
+                     struct Value (*reducingFn)(struct Reducer const *,
+                                                void *, struct Value,
+                                                struct Value,
+                                                struct Allocator *),
+                     struct Value (*batchFn)(struct Reducer const *, void *,
+                                             struct ValueSpan, struct Value,
+                                             struct Allocator *),
+                     struct Allocator *allocator)
+{
+        struct FloatStageTransducer *self =
+            (struct FloatStageTransducer *)transducer;
+        struct FloatStageReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->super = chainedReducerMake(step, reducingFn,
+                                           sizeof(struct FloatStageState));
+        result->super.super.apply_batch = batchFn;
+        chainedReducerCombineThroughStep(&result->super);
+        result->kernels = floatKernels();
+        result->a = self->a;
+        result->b = self->b;
+
+        return &result->super.super;
+}
+
+static struct Transducer *
+newFloatStageTransducer(float a, float b,
+                        struct Reducer *(*apply)(struct Transducer *,
+                                                 struct Reducer const *,
+                                                 struct Allocator *),
+                        struct Allocator *allocator)
+{
+        struct FloatStageTransducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct FloatStageTransducer){
+            .super = {.apply = apply}, .a = a, .b = b,
+        };
+
+        return &result->super;
+}
+
+static struct Value floatAboveReducerApply(struct Reducer const *reducer,
+                                           void *state, struct Value input,
+                                           struct Value current,
+                                           struct Allocator *allocator)
+{
+        struct FloatStageReducer const *self =
+            (struct FloatStageReducer const *)reducer;
+        if (input.type_tag == TTAG_FLOAT && floatOfValue(input) > self->a) {
+                return reducer_apply(self->super.step,
+                                     chainedStepState(&self->super, state),
+                                     input, current, allocator);
+        }
+
+        return current;
+}
+
+static struct Value floatAboveReducerApplyBatch(struct Reducer const *reducer,
+                                                void *state,
+                                                struct ValueSpan span,
+                                                struct Value current,
+                                                struct Allocator *allocator)
+{
+        struct FloatStageReducer const *self =
+            (struct FloatStageReducer const *)reducer;
+        /* the kernel compacts values, not their indices */
+        if (!isFloatSpan(span) || span.indices) {
+                for (uint8_t const *element = span.first;
+                     element < span.last && !isReduced(current);
+                     element += span.element_size) {
+                        current = floatAboveReducerApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        float *output = ((struct FloatStageState *)state)->output;
+        void *stepState = chainedStepState(&self->super, state);
+        float const *values = (float const *)span.first;
+        float const *last = (float const *)span.last;
+        while (values < last && !isReduced(current)) {
+                size_t count = (size_t)(last - values);
+                count = count > FLOAT_CHUNK_SIZE ? FLOAT_CHUNK_SIZE : count;
+                size_t const n = self->kernels->filterAbove(values, count,
+                                                            self->a, output);
+                if (n > 0) {
+                        current = reducer_apply_batch(
+                            self->super.step, stepState,
+                            floatSpan(output, output + n), current, allocator);
+                }
+                values += count;
+        }
+
+        return current;
+}
+
+static struct Reducer *floatAboveTransducerApply(struct Transducer *transducer,
+                                                 struct Reducer const *step,
+                                                 struct Allocator *allocator)
+{
+        return newFloatStageReducer(transducer, step, floatAboveReducerApply,
+                                    floatAboveReducerApplyBatch, allocator);
+}
+
+struct Transducer *floatAboveFilteringTransducer(float threshold,
+                                                 struct Allocator *allocator)
+{
+        return newFloatStageTransducer(threshold, 0.0f,
+                                       floatAboveTransducerApply, allocator);
+}
+
+static struct Value floatAffineReducerApply(struct Reducer const *reducer,
+                                            void *state, struct Value input,
+                                            struct Value current,
+                                            struct Allocator *allocator)
+{
+        struct FloatStageReducer const *self =
+            (struct FloatStageReducer const *)reducer;
+        struct Value result =
+            inlineFloatValue(self->a * floatOfValue(input) + self->b);
+        if (isIndexed(input)) {
+                result = indexedValue(result, input.index);
+        }
+
+        return reducer_apply(self->super.step,
+                             chainedStepState(&self->super, state), result,
+                             current, allocator);
+}
+
+static struct Value floatAffineReducerApplyBatch(struct Reducer const *reducer,
+                                                 void *state,
+                                                 struct ValueSpan span,
+                                                 struct Value current,
+                                                 struct Allocator *allocator)
+{
+        struct FloatStageReducer const *self =
+            (struct FloatStageReducer const *)reducer;
+        if (!isFloatSpan(span)) {
+                for (uint8_t const *element = span.first;
+                     element < span.last && !isReduced(current);
+                     element += span.element_size) {
+                        current = floatAffineReducerApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        float *output = ((struct FloatStageState *)state)->output;
+        void *stepState = chainedStepState(&self->super, state);
+        float const *values = (float const *)span.first;
+        float const *last = (float const *)span.last;
+        while (values < last && !isReduced(current)) {
+                size_t count = (size_t)(last - values);
+                count = count > FLOAT_CHUNK_SIZE ? FLOAT_CHUNK_SIZE : count;
+                self->kernels->affine(values, count, self->a, self->b, output);
+                /* the results keep the positions of the values they map */
+                struct ValueSpan mapped = floatSpan(output, output + count);
+                mapped.indices =
+                    subSpan(span, (uint8_t const *)values,
+                            (uint8_t const *)(values + count))
+                        .indices;
+                current = reducer_apply_batch(self->super.step, stepState,
+                                              mapped, current, allocator);
+                values += count;
+        }
+
+        return current;
+}
+
+static struct Reducer *floatAffineTransducerApply(struct Transducer *transducer,
+                                                  struct Reducer const *step,
+                                                  struct Allocator *allocator)
+{
+        return newFloatStageReducer(transducer, step, floatAffineReducerApply,
+                                    floatAffineReducerApplyBatch, allocator);
+}
+
+struct Transducer *floatAffineMappingTransducer(float scale, float offset,
+                                                struct Allocator *allocator)
+{
+        return newFloatStageTransducer(scale, offset,
+                                       floatAffineTransducerApply, allocator);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @file
+ * Prebuilt reducers and transducers for TTAG_FLOAT streams.
+ *
+ * They process the contiguous float spans they receive through apply_batch
+ * with vectorized kernels (AVX2 or SSE2 when the CPU has them, scalar code
+ * otherwise) and fall back to per-element code for any other input.
+ */
+
+struct Allocator;
+struct Reducer;
+struct Transducer;
+
+/// name of the kernels selected for this CPU
+char const *floatKernelsName(void);
+
+/// sum of its inputs, starting from 0.0f
+struct Reducer *floatSumReducer(struct Allocator *allocator);
+
+/// lets through the floats strictly greater than threshold
+struct Transducer *floatAboveFilteringTransducer(float threshold,
+                                                 struct Allocator *allocator);
+
+/// maps x to scale * x + offset
+struct Transducer *floatAffineMappingTransducer(float scale, float offset,
+                                                struct Allocator *allocator);
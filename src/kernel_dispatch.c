@@ -0,0 +1,40 @@
+#include "kernel_dispatch.h"
+
+#include <pthread.h>
+
+/* held while any module selects its kernels */
+static pthread_mutex_t selecting = PTHREAD_MUTEX_INITIALIZER;
+
+static enum KernelLevel cpuKernelLevel(void)
+{
+#if defined(KERNELS_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                return KL_AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+                return KL_SSE2;
+        }
+#endif
+        return KL_Scalar;
+}
+
+void const *dispatchKernels(struct KernelDispatch *dispatch)
+{
+        void const *selected =
+            atomic_load_explicit(&dispatch->selected, memory_order_acquire);
+        if (selected) {
+                return selected;
+        }
+
+        pthread_mutex_lock(&selecting);
+        selected =
+            atomic_load_explicit(&dispatch->selected, memory_order_relaxed);
+        if (!selected) {
+                selected = dispatch->select(cpuKernelLevel());
+                atomic_store_explicit(&dispatch->selected, selected,
+                                      memory_order_release);
+        }
+        pthread_mutex_unlock(&selecting);
+        return selected;
+}
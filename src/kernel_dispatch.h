@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+ * @file
+ * Selection, once per process, of the kernels a module has for the
+ * instruction sets of the CPU.
+ */
+
+#include <stdatomic.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+/// compiles the function that follows for the instruction set isa
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/// instruction sets kernels are written for, from the least demanding
+enum KernelLevel {
+        KL_Scalar,
+        KL_SSE2,
+        KL_AVX2,
+};
+
+/// kernels of a module, to be defined with static storage
+struct KernelDispatch
+{
+        /// returns the kernels for level, preparing any table they use
+        void const *(*select)(enum KernelLevel level);
+        /// NULL until select has returned
+        void const *_Atomic selected;
+};
+
+/**
+ * kernels of dispatch for this CPU.
+ *
+ * The first call selects them and the others, from any thread, wait for
+ * and share that selection.
+ */
+void const *dispatchKernels(struct KernelDispatch *dispatch);
@@ -1,16 +1,36 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "allocator.h"
 #include "allocator_type.h"
+#include "conversions.h"
+#include "firstPositivesSum.h"
+#include "float_kernels.h"
+#include "parallel_reduce.h"
+#include "partitioning.h"
+#include "pipelining.h"
+#include "profiling.h"
+#include "records.h"
+#include "reducers.h"
+#include "sampling.h"
+#include "sketches.h"
+#include "stream.h"
 #include "stream_types.h"
 #include "transducer_types.h"
 #include "transducers.h"
 #include "value_stream_types.h"
 #include "value_streams.h"
 #include "values.h"
+#include "windows.h"
 
 #include <assert.h>
+#include <math.h>
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 /* 1. extensions to values & transducers */
 
@@ -20,100 +40,17 @@ static struct Value floatValue(float const f, struct Allocator *const allocator)
         *result = f;
         return (struct Value){.type_tag = TTAG_FLOAT,
                               .element_size = sizeof *result,
-                              .address = result};
+                              .address = result,
+                              .allocator = allocator};
 }
 
 static float justFloat(struct Value value)
 {
         assert(value.type_tag == TTAG_FLOAT);
-        return *((float *)value.address);
-}
-
-#define TTAG_IndexedValue (0xd4e1cf8d)
-
-struct IndexedValue
-{
-        struct Value value;
-        size_t index;
-};
-
-static size_t justIndex(struct Value value)
-{
-        assert(value.type_tag == TTAG_IndexedValue);
-        return ((struct IndexedValue *)value.address)->index;
-}
-
-static struct Value indexValue(struct Value value, size_t index,
-                               struct Allocator *allocator)
-{
-        struct IndexedValue *result =
-            allocator_alloc(allocator, sizeof *result);
-
-        *result = (struct IndexedValue){
-            .value = value, .index = index,
-        };
-
-        return (struct Value){TTAG_IndexedValue, sizeof *result, result,
-                              allocator};
-}
-
-static struct Value justValueOfIndexedValue(struct Value indexedValue)
-{
-        assert(indexedValue.type_tag == TTAG_IndexedValue);
-        return ((struct IndexedValue *)indexedValue.address)->value;
-}
-
-static struct Value transduceFloatArray(float *values, size_t valuesCount,
-                                        struct Transducer *transducer,
-                                        struct Allocator *allocator)
-{
-        struct Reducer *reducer =
-            transducer_apply(transducer, idReducer(allocator), allocator);
-        struct Value result = reducer_identity(reducer, allocator);
-        for (size_t i = 0; i < valuesCount; i++) {
-                struct Value value = {TTAG_FLOAT, sizeof values[i], &values[i],
-                                      0};
-                result = reducer_apply(reducer, value, result, allocator);
-        }
-
-        return reducer_complete(reducer, result, allocator);
-}
-
-/* 2. streams of values */
-
-static struct Value nextValueVSR(struct ValueStreamRange *range)
-{
-        static struct Value zero;
-
-        while (range->error == S_NoError) {
-                if (range->cursor < range->end) {
-                        void const *valueAddress = range->cursor;
-                        range->cursor += range->element_size;
-                        return (struct Value){
-                            .type_tag = range->type_tag,
-                            .element_size = range->element_size,
-                            .address = valueAddress,
-                        };
-                }
-                range->next(range);
-        }
-
-        return zero;
-}
-
-static struct Value reduceStream(struct ValueStreamRange *range,
-                                 struct Reducer *reducer,
-                                 struct Allocator *allocator)
-{
-        struct Value element;
-        struct Value result = reducer_identity(reducer, allocator);
-        while ((element = nextValueVSR(range), range->error == S_NoError)) {
-                result = reducer_apply(reducer, element, result, allocator);
-        }
-        return reducer_complete(reducer, result, allocator);
+        return floatOfValue(value);
 }
 
-/* 3. reducers */
+/* 2. reducers */
 
 static struct Value accumulateFloat(struct Value const input,
                                     struct Value const current,
@@ -122,47 +59,88 @@ static struct Value accumulateFloat(struct Value const input,
         assert(input.type_tag == TTAG_FLOAT);
         assert(current.type_tag == TTAG_FLOAT);
 
-        float const *inputFloat = input.address;
-        float const *currentFloat = current.address;
-
-        return floatValue(*inputFloat + *currentFloat, allocator);
+        return inlineFloatValue(floatOfValue(input) + floatOfValue(current));
 }
 
 static struct Value accumulateFloatIdentity(struct Reducer const *reducer,
                                             struct Allocator *allocator)
 {
-        static float zero = 0.0f;
-        return (struct Value){
-            .type_tag = TTAG_FLOAT,
-            .element_size = sizeof zero,
-            .address = &zero,
-        };
+        return inlineFloatValue(0.0f);
 }
 
 static struct Value accumulateFloatApply(struct Reducer const *reducer,
-                                         struct Value const input,
+                                         void *state, struct Value const input,
                                          struct Value const current,
                                          struct Allocator *allocator)
 {
         return accumulateFloat(input, current, allocator);
 }
 
+static struct Value accumulateFloatCombine(struct Reducer const *reducer,
+                                           struct Value const left,
+                                           struct Value const right,
+                                           struct Allocator *allocator)
+{
+        return accumulateFloat(left, right, allocator);
+}
+
+/* accumulates floats, counting the results it combines in a counter owned
+ * by the caller */
+struct CombineCountingReducer
+{
+        struct Reducer super;
+        size_t *combines;
+};
+
+static struct Value
+combineCountingReducerCombine(struct Reducer const *reducer,
+                              struct Value const left,
+                              struct Value const right,
+                              struct Allocator *allocator)
+{
+        struct CombineCountingReducer const *self =
+            (struct CombineCountingReducer const *)reducer;
+
+        (*self->combines)++;
+        return accumulateFloat(left, right, allocator);
+}
+
 static void printValue(struct Value value)
 {
-        if (value.type_tag == TTAG_FLOAT) {
-                printf("%f", *((float *)value.address));
-        } else if (value.type_tag == TTAG_IndexedValue) {
-                printf("(%zu ", justIndex(value));
-                printValue(justValueOfIndexedValue(value));
+        if (isIndexed(value)) {
+                printf("(%zu ", value.index);
+                value.flags &= ~VFLAG_INDEXED;
+                printValue(value);
                 printf(")");
-
+        } else if (isArrayValue(value)) {
+                struct ValueSpan span = spanOfArrayValue(value);
+                printf("<");
+                for (uint8_t const *element = span.first;
+                     element < span.last; element += span.element_size) {
+                        if (element != span.first) {
+                                printf(" ");
+                        }
+                        printValue(valueOfSpanElement(span, element));
+                }
+                printf(">");
+        } else if (value.type_tag == TTAG_FLOAT) {
+                printf("%f", floatOfValue(value));
+        } else if (value.type_tag == TTAG_VALUE) {
+                printValue(*(struct Value const *)valueAddress(&value));
+        } else if (value.type_tag == TTAG_INT64) {
+                printf("%lld", (long long)int64OfValue(value));
+        } else if (value.type_tag == TTAG_GROUP_RESULT) {
+                struct GroupResult const *group = valueAddress(&value);
+                printf("%lld: ", (long long)group->key);
+                printValue(group->result);
         } else {
                 printf("?");
         }
 }
 
 static struct Value printReducerApply(struct Reducer const *reducer,
-                                      struct Value input, struct Value current,
+                                      void *state, struct Value input,
+                                      struct Value current,
                                       struct Allocator *allocator)
 {
         if (current.type_tag == 0) {
@@ -179,7 +157,7 @@ static struct Value printReducerApply(struct Reducer const *reducer,
 }
 
 static struct Value printReducerComplete(struct Reducer const *reducer,
-                                         struct Value result,
+                                         void *state, struct Value result,
                                          struct Allocator *allocator)
 {
         printf("]\n");
@@ -200,81 +178,262 @@ static struct Reducer *printReducer(struct Allocator *allocator)
 static bool positiveFloatsOnly(struct Value value, void *data)
 {
         (void)data;
-        return value.type_tag == TTAG_FLOAT && *((float *)value.address) > 0.0f;
+        return value.type_tag == TTAG_FLOAT && floatOfValue(value) > 0.0f;
 }
 
-static struct Value indexingReducerApply(struct Reducer const *reducer,
-                                         struct Value input,
+static struct Value countingReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
                                          struct Value current,
                                          struct Allocator *allocator)
 {
-        size_t index;
-        if (current.type_tag == 0) {
-                index = 0;
-        } else {
-                index = 1 + justIndex(current);
-        }
+        size_t *count = state;
 
-        return indexValue(input, index, allocator);
+        (*count)++;
+
+        return input;
 }
 
-static struct Value unwrapIndexedValue(struct Value value, void *data)
+static struct Value countingReducerComplete(struct Reducer const *reducer,
+                                            void *state, struct Value result,
+                                            struct Allocator *allocator)
 {
-        return justValueOfIndexedValue(value);
+        size_t const *count = state;
+
+        printf("{counted: %zu}", *count);
+
+        return result;
 }
 
-struct Reducer *indexingReducer(struct Allocator *allocator)
+struct Reducer *countingReducer(struct Allocator *allocator)
 {
         struct Reducer *result = allocator_alloc(allocator, sizeof *result);
 
         *result = (struct Reducer){
-            .apply = indexingReducerApply,
+            .apply = countingReducerApply,
+            .complete = countingReducerComplete,
+            .state_size = sizeof(size_t),
         };
 
         return result;
 }
 
-struct CountingReducer
+static int64_t floatSign(struct Value value, void *data)
+{
+        return floatOfValue(value) < 0.0f ? -1 : 1;
+}
+
+/* stores its inputs in values, counting them in a counter owned by the
+ * caller, who resets it between runs */
+struct CollectingReducer
 {
         struct Reducer super;
-        size_t count;
+        float *values;
+        size_t capacity;
+        size_t *count;
 };
 
-static struct Value countingReducerApply(struct Reducer const *reducer,
-                                         struct Value input,
-                                         struct Value current,
-                                         struct Allocator *allocator)
+static struct Value collectingReducerApply(struct Reducer const *reducer,
+                                           void *state, struct Value input,
+                                           struct Value current,
+                                           struct Allocator *allocator)
 {
-        struct CountingReducer *self = (struct CountingReducer *)reducer;
+        struct CollectingReducer const *self =
+            (struct CollectingReducer const *)reducer;
 
-        self->count++;
+        if (*self->count < self->capacity) {
+                self->values[(*self->count)++] = floatOfValue(input);
+        }
 
-        return input;
+        return current;
 }
 
-static struct Value countingReducerComplete(struct Reducer const *reducer,
-                                            struct Value result,
-                                            struct Allocator *allocator)
+/* counts the calls it receives and the indexed elements among its inputs,
+ * in counters owned by the caller */
+struct CallCountingReducer
 {
-        struct CountingReducer *self = (struct CountingReducer *)reducer;
+        struct Reducer super;
+        size_t *applies;
+        size_t *batches;
+        size_t *indexed;
+};
 
-        printf("{counted: %zu}", self->count);
+static struct Value callCountingReducerApply(struct Reducer const *reducer,
+                                             void *state, struct Value input,
+                                             struct Value current,
+                                             struct Allocator *allocator)
+{
+        struct CallCountingReducer const *self =
+            (struct CallCountingReducer const *)reducer;
 
-        return result;
+        (*self->applies)++;
+        *self->indexed += isIndexed(input);
+        return current;
 }
 
-struct Reducer *countingReducer(struct Allocator *allocator)
+static struct Value
+callCountingReducerApplyBatch(struct Reducer const *reducer, void *state,
+                              struct ValueSpan span, struct Value current,
+                              struct Allocator *allocator)
+{
+        struct CallCountingReducer const *self =
+            (struct CallCountingReducer const *)reducer;
+
+        (*self->batches)++;
+        if (span.indices) {
+                *self->indexed +=
+                    (size_t)(span.last - span.first) / span.element_size;
+        }
+        return current;
+}
+
+/* hands out bytes chunk_size at a time */
+struct ChunkedStreamRange
+{
+        struct StreamRange super;
+        uint8_t const *last;
+        size_t chunk_size;
+};
+
+static enum StreamErrorCode chunkedStreamNext(struct StreamRange *range)
+{
+        struct ChunkedStreamRange *self = (struct ChunkedStreamRange *)range;
+        size_t size = self->chunk_size;
+        if (range->end == self->last) {
+                range->error = S_ReadPastEnd;
+                return range->error;
+        }
+
+        if ((size_t)(self->last - range->end) < size) {
+                size = (size_t)(self->last - range->end);
+        }
+        range->start = range->end;
+        range->cursor = range->end;
+        range->end += size;
+
+        return range->error;
+}
+
+static void chunkedStream(struct ChunkedStreamRange *range,
+                          uint8_t const *bytes, size_t size, size_t chunk_size)
+{
+        *range = (struct ChunkedStreamRange){
+            .super =
+                {
+                    .start = bytes,
+                    .cursor = bytes,
+                    .end = bytes,
+                    .error = S_NoError,
+                    .next = chunkedStreamNext,
+                },
+            .last = bytes + size,
+            .chunk_size = chunk_size,
+        };
+}
+
+/* hands out the elements of an array chunk_size elements at a time */
+struct ChunkedArrayVSR
+{
+        struct ValueStreamRange super;
+        uint8_t const *last;
+        size_t chunk_size;
+};
+
+static enum StreamErrorCode chunkedArrayNext(struct ValueStreamRange *range)
+{
+        struct ChunkedArrayVSR *self = (struct ChunkedArrayVSR *)range;
+        size_t size = self->chunk_size * range->element_size;
+        if (range->end == self->last) {
+                range->error = S_ReadPastEnd;
+                return range->error;
+        }
+
+        if ((size_t)(self->last - range->end) < size) {
+                size = (size_t)(self->last - range->end);
+        }
+        range->start = range->end;
+        range->cursor = range->end;
+        range->end += size;
+
+        return range->error;
+}
+
+static void chunkedArrayVSR(struct ChunkedArrayVSR *range, int type_tag,
+                            size_t element_size, void const *values,
+                            size_t count, size_t chunk_size)
+{
+        *range = (struct ChunkedArrayVSR){
+            .super =
+                {
+                    .type_tag = type_tag,
+                    .element_size = element_size,
+                    .start = values,
+                    .cursor = values,
+                    .end = values,
+                    .error = S_NoError,
+                    .next = chunkedArrayNext,
+                },
+            .last = (uint8_t const *)values + count * element_size,
+            .chunk_size = chunk_size,
+        };
+}
+
+/* of tuples of a float and an int32 */
+static struct Value sumOfProductsApply(struct Reducer const *reducer,
+                                       void *state, struct Value input,
+                                       struct Value current,
+                                       struct Allocator *allocator)
+{
+        float x;
+        int32_t y;
+        memcpy(&x, valueAddress(&input), sizeof x);
+        memcpy(&y, (uint8_t const *)valueAddress(&input) + sizeof x, sizeof y);
+
+        return inlineFloatValue(floatOfValue(current) + x * (float)y);
+}
+
+static int64_t int64Key(struct Value value, void *data)
 {
-        struct CountingReducer *result =
-            allocator_alloc(allocator, sizeof *result);
+        return int64OfValue(value);
+}
 
-        *result =
-            (struct CountingReducer){.super = (struct Reducer){
-                                         .apply = countingReducerApply,
-                                         .complete = countingReducerComplete,
-                                     }};
+/* costly enough for the stages around it to be worth running alongside */
+static struct Value slowFloatMapper(struct Value value, void *data)
+{
+        float x = floatOfValue(value);
+        for (int i = 0; i < 32; i++) {
+                x = sqrtf(x * x + 1.0f);
+        }
+        /* whole, so that sums do not depend on how they are split */
+        return inlineFloatValue(floorf(x));
+}
 
-        return &result->super;
+static bool hasParity(struct Value value, void *data)
+{
+        return int64OfValue(value) % 2 == *(int64_t const *)data;
+}
+
+/* heavy-tailed: key k > 0 comes about 1 / k^2 of the time */
+static int64_t skewedKey(size_t i)
+{
+        size_t const u = i * 7919 % 10007;
+        return (int64_t)(sqrt(10007.0 / (double)(u + 1)));
+}
+
+static int64_t floatKey(struct Value value, void *data)
+{
+        return (int64_t)floatOfValue(value);
+}
+
+static int compareFloatsDescending(void const *a, void const *b)
+{
+        float const left = *(float const *)a;
+        float const right = *(float const *)b;
+        return (left < right) - (left > right);
+}
+
+static int64_t floatModuloKey(struct Value value, void *data)
+{
+        return (int64_t)floatOfValue(value) % *(int64_t const *)data;
 }
 
 struct Range
@@ -287,15 +446,38 @@ static bool isIndexInRange(struct Value value, void *userData)
 {
         struct Range *range = userData;
 
-        size_t index = justIndex(value);
-
-        return index >= range->start && index < range->end;
+        assert(isIndexed(value));
+        return value.index >= range->start && value.index < range->end;
 }
 
 struct Value invertFloat(struct Value value, void *userData)
 {
-        struct Allocator *allocator = userData;
-        return floatValue(-justFloat(value), allocator);
+        return inlineFloatValue(-justFloat(value));
+}
+
+/* keeps the position of the value it inverts */
+static struct Value invertIndexedFloat(struct Value value, void *userData)
+{
+        struct Value result = inlineFloatValue(-floatOfValue(value));
+        return isIndexed(value) ? indexedValue(result, value.index) : result;
+}
+
+struct FloatPair
+{
+        float values[2];
+        struct ArrayPayload array;
+};
+
+/* array of two copies of a float, in the FloatPair at userData */
+static struct Value repeatFloat(struct Value value, void *userData)
+{
+        struct FloatPair *pair = userData;
+        pair->values[0] = pair->values[1] = justFloat(value);
+        pair->array = (struct ArrayPayload){
+            .count = 2,
+            .elements = pair->values,
+        };
+        return arrayValue(TTAG_FLOAT, sizeof(float), &pair->array);
 }
 
 /* main program */
@@ -317,7 +499,9 @@ int main(int argc, char **argv)
         };
 
         static struct Reducer accumulator = {
-            .identity = accumulateFloatIdentity, .apply = accumulateFloatApply,
+            .identity = accumulateFloatIdentity,
+            .apply = accumulateFloatApply,
+            .combine = accumulateFloatCombine,
         };
 
         printf("1. individual test\n");
@@ -398,17 +582,14 @@ int main(int argc, char **argv)
                 struct Transducer *processSteps[] = {
                     mappingTransducer(countingReducer(&heapAllocator),
                                       &heapAllocator),
-                    mappingFnTransducer(invertFloat, &heapAllocator,
-                                        &heapAllocator),
+                    mappingFnTransducer(invertFloat, NULL, &heapAllocator),
                     filteringTransducer(positiveFloatsOnly, NULL,
                                         &heapAllocator),
-                    mappingTransducer(indexingReducer(&heapAllocator),
-                                      &heapAllocator),
+                    indexingTransducer(&heapAllocator),
                     filteringTransducer(isIndexInRange, &range, &heapAllocator),
+                    takingTransducer(range.end - range.start, &heapAllocator),
                     mappingTransducer(printReducer(&heapAllocator),
                                       &heapAllocator),
-                    mappingFnTransducer(unwrapIndexedValue, NULL,
-                                        &heapAllocator),
                     mappingTransducer(&accumulator, &heapAllocator),
                 };
                 struct Transducer *process = composingTransducer(
@@ -422,7 +603,7 @@ int main(int argc, char **argv)
                             values, sizeof values / sizeof values[0], process,
                             &heapAllocator);
 
-                        printf("expected: {counted: 4}\n");
+                        printf("expected: {counted: 8}\n");
                         if (result.type_tag == TTAG_FLOAT) {
                                 printf("result is: %f ; expected 19.0\n",
                                        justFloat(result));
@@ -430,5 +611,1453 @@ int main(int argc, char **argv)
                 }
         }
 
+        printf("5. stop at the first negative float\n");
+        {
+                float values[] = {1.0f, 2.0f, 3.0f, -1.0f, 5.0f, 6.0f};
+                struct Transducer *processSteps[] = {
+                    mappingTransducer(countingReducer(&heapAllocator),
+                                      &heapAllocator),
+                    takingWhileTransducer(positiveFloatsOnly, NULL,
+                                          &heapAllocator),
+                    mappingTransducer(&accumulator, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    processSteps, sizeof processSteps / sizeof processSteps[0],
+                    &heapAllocator);
+
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values,
+                              sizeof values / sizeof values[0]);
+                struct Value result = reduceStream(
+                    &valuesRange,
+                    transducer_apply(process, idReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("\nexpected: {counted: 4}\n");
+                printf("result is: %f ; expected: 6.0\n", justFloat(result));
+        }
+
+        printf("6. scope an arena to each reduction\n");
+        {
+                struct CountingAllocator countingAllocator;
+                counting_allocator_init(&countingAllocator, &heapAllocator);
+                struct ArenaAllocator arena;
+                arena_allocator_init(&arena, &countingAllocator.super, 65536);
+
+                float values[] = {-1.0f, 1.0f,  -2.0f, 2.0f,
+                                  3.0f,  -3.0f, 4.0f,  -4.0f};
+                struct Transducer *processSteps[] = {
+                    filteringTransducer(positiveFloatsOnly, NULL,
+                                        &heapAllocator),
+                    mappingTransducer(&accumulator, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    processSteps, sizeof processSteps / sizeof processSteps[0],
+                    &heapAllocator);
+
+                size_t blockAllocs[2];
+                for (size_t run = 0; run < 2; run++) {
+                        struct Value result = transduceFloatArray(
+                            values, sizeof values / sizeof values[0], process,
+                            &arena.super);
+                        printf("result is: %f ; expected: 10.0\n",
+                               justFloat(result));
+                        blockAllocs[run] = countingAllocator.allocs;
+                        arena_allocator_reset(&arena);
+                }
+                printf("blocks allocated by the second run: %zu ; expected: "
+                       "0\n",
+                       blockAllocs[1] - blockAllocs[0]);
+                arena_allocator_release(&arena);
+
+                struct PoolAllocator pool;
+                pool_allocator_init(&pool, &heapAllocator, sizeof(float), 256);
+                struct Value a = floatValue(1.0f, &pool.super);
+                void const *firstSlot = a.address;
+                freeValue(&a);
+                struct Value b = floatValue(2.0f, &pool.super);
+                printf("pool slot reused: %s ; expected: yes\n",
+                       b.address == firstSlot ? "yes" : "no");
+                freeValue(&b);
+                pool_allocator_release(&pool);
+        }
+
+        printf("7. fused loop generated from firstPositivesSum.pipeline\n");
+        {
+                float values[] = {-3.0, -5.0, 1.0,  2.0, 3.0,
+                                  4.0,  -5.0, -6.0, -7.0};
+                size_t const valuesCount = sizeof values / sizeof values[0];
+
+                float fused;
+                if (firstPositivesSum(values, valuesCount, &fused)) {
+                        printf("fused result is: %f ; expected 19.0\n", fused);
+                }
+
+                struct Value result = transduceFloatArray(
+                    values, valuesCount,
+                    firstPositivesSumTransducer(&heapAllocator),
+                    &heapAllocator);
+                printf("dynamic result is: %f ; expected 19.0\n",
+                       justFloat(result));
+        }
+
+        printf("8. vectorized float kernels\n");
+        {
+                static float values[1000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 7) - 3.0f;
+                }
+
+                struct Transducer *boxedSteps[] = {
+                    filteringTransducer(positiveFloatsOnly, NULL,
+                                        &heapAllocator),
+                    mappingFnTransducer(invertFloat, NULL, &heapAllocator),
+                    mappingTransducer(&accumulator, &heapAllocator),
+                };
+                struct Value boxed = transduceFloatArray(
+                    values, valuesCount,
+                    composingTransducer(boxedSteps,
+                                        sizeof boxedSteps /
+                                            sizeof boxedSteps[0],
+                                        &heapAllocator),
+                    &heapAllocator);
+                printf("boxed result is: %f ; expected: -855.0\n",
+                       justFloat(boxed));
+
+                struct Transducer *kernelSteps[] = {
+                    floatAboveFilteringTransducer(0.0f, &heapAllocator),
+                    floatAffineMappingTransducer(-1.0f, 0.0f, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    kernelSteps, sizeof kernelSteps / sizeof kernelSteps[0],
+                    &heapAllocator);
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                struct Value result = reduceStream(
+                    &valuesRange,
+                    transducer_apply(process, floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("kernels result is: %f ; expected: -855.0\n",
+                       justFloat(result));
+
+                /* mapped values keep their positions */
+                struct Range range = {
+                    .start = 0, .end = 10,
+                };
+                struct Transducer *indexedSteps[] = {
+                    indexingTransducer(&heapAllocator),
+                    floatAffineMappingTransducer(-1.0f, 0.0f, &heapAllocator),
+                    filteringTransducer(isIndexInRange, &range, &heapAllocator),
+                };
+                process = composingTransducer(
+                    indexedSteps, sizeof indexedSteps / sizeof indexedSteps[0],
+                    &heapAllocator);
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                result = reduceStream(
+                    &valuesRange,
+                    transducer_apply(process, floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("indexed kernels result is: %f ; expected: 6.0\n",
+                       justFloat(result));
+        }
+
+        printf("9. parallel fold\n");
+        {
+                static float values[1 << 20];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 4) - 1.0f;
+                }
+
+                struct Transducer *kernelSteps[] = {
+                    floatAboveFilteringTransducer(0.0f, &heapAllocator),
+                    floatAffineMappingTransducer(2.0f, 0.0f, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    kernelSteps, sizeof kernelSteps / sizeof kernelSteps[0],
+                    &heapAllocator);
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                struct Value result = parallelReduceStream(
+                    &valuesRange, process, floatSumReducer(&heapAllocator), 4,
+                    &heapAllocator);
+                printf("result is: %f ; expected: 1572864.0\n",
+                       justFloat(result));
+
+                printf("parallel refills\n");
+                size_t combines = 0;
+                struct CombineCountingReducer combining = {
+                    .super = {.identity = accumulateFloatIdentity,
+                              .apply = accumulateFloatApply,
+                              .combine = combineCountingReducerCombine},
+                    .combines = &combines,
+                };
+                struct ChunkedArrayVSR chunksRange;
+                chunkedArrayVSR(&chunksRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, valuesCount / 4);
+                result = parallelReduceStream(&chunksRange.super, NULL,
+                                              &combining.super, 4,
+                                              &heapAllocator);
+                /* 32 chunks for each of the 4 refills */
+                printf("result is: %f, combines: %zu ; expected: 524288.0, "
+                       "combines: 128\n",
+                       justFloat(result), combines);
+
+                printf("sequential fallback for running totals\n");
+                struct Transducer *runningTotal =
+                    mappingTransducer(&accumulator, &heapAllocator);
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                result = parallelReduceStream(&valuesRange, runningTotal,
+                                              idReducer(&heapAllocator), 4,
+                                              &heapAllocator);
+                printf("result is: %f ; expected: 524288.0\n",
+                       justFloat(result));
+        }
+
+        printf("10. read floats from a file\n");
+        {
+                FILE *file = tmpfile();
+                for (int i = 1; i <= 5000; i++) {
+                        float value = (float)i;
+                        fwrite(&value, sizeof value, 1, file);
+                }
+                fflush(file);
+                int const fd = fileno(file);
+
+                /* not a multiple of sizeof(float), to split elements */
+                uint8_t buffer[30];
+                struct FileStreamRange bytes;
+                lseek(fd, 0, SEEK_SET);
+                stream_on_file(&bytes, fd, buffer, sizeof buffer);
+                size_t bytesCount = 0;
+                while (bytes.super.error == S_NoError) {
+                        bytesCount += bytes.super.end - bytes.super.cursor;
+                        bytes.super.cursor = bytes.super.end;
+                        bytes.super.next(&bytes.super);
+                }
+                printf("bytes read: %zu ; expected: 20000\n", bytesCount);
+
+                struct FileValueStreamRange fileRange;
+                lseek(fd, 0, SEEK_SET);
+                fileVSR(&fileRange, TTAG_FLOAT, sizeof(float), fd, buffer,
+                        sizeof buffer);
+                struct Value result =
+                    reduceStream(&fileRange.super,
+                                 floatSumReducer(&heapAllocator),
+                                 &heapAllocator);
+                printf("read() result is: %f ; expected: 12502500.0\n",
+                       justFloat(result));
+
+                struct MappedFileValueStreamRange mappedRange;
+                if (0 == mappedFileVSR(&mappedRange, TTAG_FLOAT, sizeof(float),
+                                       fd, 1024)) {
+                        result = reduceStream(&mappedRange.super,
+                                              floatSumReducer(&heapAllocator),
+                                              &heapAllocator);
+                        printf("mmap() result is: %f ; expected: 12502500.0\n",
+                               justFloat(result));
+                        unmapFileVSR(&mappedRange);
+                }
+                fclose(file);
+        }
+
+        printf("11. refill a stream from a background thread\n");
+        {
+                static uint8_t bytes[100000];
+                size_t expectedSum = 0;
+                for (size_t i = 0; i < sizeof bytes; i++) {
+                        bytes[i] = (uint8_t)(i % 251);
+                        expectedSum += bytes[i];
+                }
+
+                struct StreamRange source;
+                stream_on_memory(&source, bytes, sizeof bytes);
+                struct AsyncStreamRange async;
+                stream_async(&async, &source, 3, 1000, &heapAllocator);
+                size_t sum = 0;
+                while (async.super.error == S_NoError) {
+                        for (; async.super.cursor < async.super.end;
+                             async.super.cursor++) {
+                                sum += *async.super.cursor;
+                        }
+                        async.super.next(&async.super);
+                }
+                stream_async_release(&async);
+                printf("sum of bytes is: %zu ; expected: %zu\n", sum,
+                       expectedSum);
+        }
+
+        printf("12. profile the stages of a pipeline\n");
+        {
+                struct Range range = {
+                    .start = 0, .end = 4,
+                };
+                struct Transducer *processSteps[] = {
+                    mappingFnTransducer(invertFloat, NULL, &heapAllocator),
+                    filteringTransducer(positiveFloatsOnly, NULL,
+                                        &heapAllocator),
+                    indexingTransducer(&heapAllocator),
+                    filteringTransducer(isIndexInRange, &range, &heapAllocator),
+                    takingTransducer(range.end - range.start, &heapAllocator),
+                    mappingTransducer(&accumulator, &heapAllocator),
+                };
+                char const *names[] = {
+                    "invert", "positives", "index", "in range", "take", "sum",
+                };
+                struct Transducer *process = profiledComposingTransducer(
+                    processSteps, sizeof processSteps / sizeof processSteps[0],
+                    names, &heapAllocator);
+
+                float values[] = {-3.0, -5.0, 1.0,  2.0, 3.0,
+                                  4.0,  -5.0, -6.0, -7.0};
+                struct Value result = transduceFloatArray(
+                    values, sizeof values / sizeof values[0], process,
+                    &heapAllocator);
+                printf("result is: %f ; expected 19.0\n", justFloat(result));
+
+                profilingReport(stdout, process);
+                struct StageProfile total = profilingTransducerProfile(process);
+                printf("total in: %llu, out: %llu ; expected in: 8, out: 4\n",
+                       (unsigned long long)total.elements_in,
+                       (unsigned long long)total.elements_out);
+                printf("allocations: %llu ; expected: 0\n",
+                       (unsigned long long)total.allocs);
+        }
+
+        printf("13. filter a stream by position\n");
+        {
+                static float values[10000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 4);
+                }
+
+                struct Range range = {
+                    .start = 100, .end = 2100,
+                };
+                struct Transducer *processSteps[] = {
+                    indexingTransducer(&heapAllocator),
+                    filteringTransducer(isIndexInRange, &range, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    processSteps, sizeof processSteps / sizeof processSteps[0],
+                    &heapAllocator);
+                struct Reducer *reducer = transducer_apply(
+                    process, floatSumReducer(&heapAllocator), &heapAllocator);
+                void *state = reducer_new_state(reducer, &heapAllocator);
+
+                struct CountingAllocator countingAllocator;
+                counting_allocator_init(&countingAllocator, &heapAllocator);
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                struct Value result = reduceStreamInState(
+                    &valuesRange, reducer, state, &countingAllocator.super);
+                printf("result is: %f ; expected: 3000.0\n",
+                       justFloat(result));
+                printf("allocations: %zu ; expected: 0\n",
+                       countingAllocator.allocs);
+                allocator_free(&heapAllocator, state);
+
+                /* indices go through mapping stages in batches */
+                struct Transducer *mappedSteps[] = {
+                    indexingTransducer(&heapAllocator),
+                    mappingFnTransducer(invertIndexedFloat, NULL,
+                                        &heapAllocator),
+                    filteringTransducer(isIndexInRange, &range, &heapAllocator),
+                };
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                result = reduceStream(
+                    &valuesRange,
+                    transducer_apply(composingTransducer(mappedSteps, 3,
+                                                         &heapAllocator),
+                                     floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("result is: %f ; expected: -3000.0\n",
+                       justFloat(result));
+
+                size_t applies = 0;
+                size_t batches = 0;
+                size_t indexed = 0;
+                struct CallCountingReducer calls = {
+                    .super = {.apply = callCountingReducerApply,
+                              .apply_batch = callCountingReducerApplyBatch},
+                    .applies = &applies,
+                    .batches = &batches,
+                    .indexed = &indexed,
+                };
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                reduceStream(&valuesRange,
+                             transducer_apply(composingTransducer(
+                                                  mappedSteps, 2,
+                                                  &heapAllocator),
+                                              &calls.super, &heapAllocator),
+                             &heapAllocator);
+                printf("batches: %zu, single elements: %zu, indexed: %zu ; "
+                       "expected batches: 20, single elements: 0, indexed: "
+                       "%zu\n",
+                       batches, applies, indexed, valuesCount);
+        }
+
+        printf("14. run one composed reducer in two states at once\n");
+        {
+                float const values[] = {1.0f, -2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+                size_t const valuesCount = sizeof values / sizeof values[0];
+
+                struct Transducer *processSteps[] = {
+                    filteringTransducer(positiveFloatsOnly, NULL,
+                                        &heapAllocator),
+                    takingTransducer(3, &heapAllocator),
+                };
+                struct Transducer *process = composingTransducer(
+                    processSteps, sizeof processSteps / sizeof processSteps[0],
+                    &heapAllocator);
+                struct Reducer *reducer = transducer_apply(
+                    process, floatSumReducer(&heapAllocator), &heapAllocator);
+
+                /* the second run starts one element late, interleaved
+                 * with the first */
+                void *states[] = {
+                    reducer_new_state(reducer, &heapAllocator),
+                    reducer_new_state(reducer, &heapAllocator),
+                };
+                struct Value results[] = {
+                    reducer_identity(reducer, &heapAllocator),
+                    reducer_identity(reducer, &heapAllocator),
+                };
+                for (size_t i = 0; i < valuesCount; i++) {
+                        for (size_t run = 0; run < 2; run++) {
+                                if (i < run || isReduced(results[run])) {
+                                        continue;
+                                }
+                                results[run] = reducer_apply(
+                                    reducer, states[run],
+                                    inlineFloatValue(values[i - run]),
+                                    results[run], &heapAllocator);
+                        }
+                }
+                for (size_t run = 0; run < 2; run++) {
+                        results[run] = reducer_complete(
+                            reducer, states[run], unreducedValue(results[run]),
+                            &heapAllocator);
+                        allocator_free(&heapAllocator, states[run]);
+                }
+                printf("results are: %f, %f ; expected: 8.0, 8.0\n",
+                       justFloat(results[0]), justFloat(results[1]));
+        }
+
+        printf("15. gather elements in chunks\n");
+        {
+                float const values[] = {1.0f, 2.0f,  3.0f,  -1.0f, -2.0f,
+                                        3.0f, -4.0f, -5.0f, 6.0f,  7.0f};
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                struct Transducer *partitions[] = {
+                    partitioningAllTransducer(4, &heapAllocator),
+                    partitioningByTransducer(floatSign, NULL, &heapAllocator),
+                };
+                char const *const expected[] = {
+                    "[<1.000000 2.000000 3.000000 -1.000000>, <-2.000000 "
+                    "3.000000 -4.000000 -5.000000>, <6.000000 7.000000>]",
+                    "[<1.000000 2.000000 3.000000>, <-1.000000 -2.000000>, "
+                    "<3.000000>, <-4.000000 -5.000000>, <6.000000 "
+                    "7.000000>]",
+                };
+
+                for (size_t i = 0; i < 2; i++) {
+                        struct Reducer *reducer = transducer_apply(
+                            partitions[i], printReducer(&heapAllocator),
+                            &heapAllocator);
+                        void *state =
+                            reducer_new_state(reducer, &heapAllocator);
+
+                        struct CountingAllocator countingAllocator;
+                        counting_allocator_init(&countingAllocator,
+                                                &heapAllocator);
+                        struct ValueStreamRange valuesRange;
+                        floatArrayVSR(&valuesRange, values, valuesCount);
+                        struct Value last = reduceStreamInState(
+                            &valuesRange, reducer, state,
+                            &countingAllocator.super);
+                        printf("expected: %s\n", expected[i]);
+                        /* the buffer, and the copy of the last chunk that
+                         * outlives it */
+                        printf("allocations: %zu ; expected: 2\n",
+                               countingAllocator.allocs);
+                        freeValue(&last);
+                        allocator_free(&heapAllocator, state);
+                }
+
+                /* chunks go whole through mapping stages */
+                struct FloatPair pair;
+                struct Transducer *stages[] = {
+                    partitioningAllTransducer(2, &heapAllocator),
+                    mappingTransducer(idReducer(&heapAllocator),
+                                      &heapAllocator),
+                };
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, 5);
+                reduceStream(&valuesRange,
+                             transducer_apply(
+                                 composingTransducer(stages, 2, &heapAllocator),
+                                 printReducer(&heapAllocator), &heapAllocator),
+                             &heapAllocator);
+                printf("expected: [<1.000000 2.000000>, <3.000000 "
+                       "-1.000000>, <-2.000000>]\n");
+                floatArrayVSR(&valuesRange, values, 3);
+                reduceStream(
+                    &valuesRange,
+                    transducer_apply(
+                        mappingFnTransducer(repeatFloat, &pair, &heapAllocator),
+                        printReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                printf("expected: [<1.000000 1.000000>, <2.000000 "
+                       "2.000000>, <3.000000 3.000000>]\n");
+        }
+
+        printf("16. aggregate sliding windows\n");
+        {
+                float const values[] = {1.0f, 3.0f, -2.0f, 5.0f,
+                                        4.0f, 0.0f, 2.0f,  -1.0f};
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                struct Transducer *windows[] = {
+                    floatWindowTransducer(FW_Sum, 3, 1, &heapAllocator),
+                    floatWindowTransducer(FW_Max, 3, 2, &heapAllocator),
+                    floatWindowTransducer(FW_Min, 4, 4, &heapAllocator),
+                };
+                char const *const expected[] = {
+                    "[2.000000, 6.000000, 7.000000, 9.000000, 6.000000, "
+                    "1.000000]",
+                    "[3.000000, 5.000000, 4.000000]",
+                    "[-2.000000, -1.000000]",
+                };
+
+                for (size_t i = 0; i < 3; i++) {
+                        struct ValueStreamRange valuesRange;
+                        floatArrayVSR(&valuesRange, values, valuesCount);
+                        reduceStream(&valuesRange,
+                                     transducer_apply(
+                                         windows[i],
+                                         printReducer(&heapAllocator),
+                                         &heapAllocator),
+                                     &heapAllocator);
+                        printf("expected: %s\n", expected[i]);
+                }
+
+                /* against a direct computation of each window */
+                static float signal[10000];
+                size_t const signalCount = sizeof signal / sizeof signal[0];
+                for (size_t i = 0; i < signalCount; i++) {
+                        signal[i] = (float)((i * 7919) % 1000) / 10.0f - 50.0f;
+                }
+                size_t const size = 64;
+                size_t const stride = 5;
+                enum FloatWindowAggregate const aggregates[] = {
+                    FW_Mean, FW_Min, FW_Max,
+                };
+                static float outputs[10000];
+                size_t count;
+                struct CollectingReducer collector = {
+                    .super = {.apply = collectingReducerApply},
+                    .values = outputs,
+                    .capacity = sizeof outputs / sizeof outputs[0],
+                    .count = &count,
+                };
+                size_t mismatches = 0;
+                size_t allocations = 0;
+                for (size_t a = 0; a < 3; a++) {
+                        struct Reducer *reducer = transducer_apply(
+                            floatWindowTransducer(aggregates[a], size, stride,
+                                                  &heapAllocator),
+                            &collector.super, &heapAllocator);
+                        void *state =
+                            reducer_new_state(reducer, &heapAllocator);
+
+                        struct CountingAllocator countingAllocator;
+                        counting_allocator_init(&countingAllocator,
+                                                &heapAllocator);
+                        struct ValueStreamRange valuesRange;
+                        floatArrayVSR(&valuesRange, signal, signalCount);
+                        count = 0;
+                        reduceStreamInState(&valuesRange, reducer, state,
+                                            &countingAllocator.super);
+                        allocations += countingAllocator.allocs;
+
+                        mismatches +=
+                            count != (signalCount - size) / stride + 1;
+                        for (size_t w = 0; w < count; w++) {
+                                float const *window = signal + w * stride;
+                                float expected = window[0];
+                                double sum = 0.0;
+                                for (size_t i = 0; i < size; i++) {
+                                        sum += window[i];
+                                        if (aggregates[a] == FW_Min
+                                                ? window[i] < expected
+                                                : window[i] > expected) {
+                                                expected = window[i];
+                                        }
+                                }
+                                if (aggregates[a] == FW_Mean) {
+                                        expected = (float)(sum / (double)size);
+                                }
+                                mismatches += fabsf(outputs[w] - expected) >
+                                              1e-4f;
+                        }
+                        allocator_free(&heapAllocator, state);
+                }
+                printf("mismatches: %zu ; expected: 0\n", mismatches);
+                printf("allocations: %zu ; expected: 0\n", allocations);
+        }
+
+        printf("17. convert between numeric types\n");
+        {
+                uint8_t const bytes[] = {0, 51, 255};
+                struct ValueStreamRange bytesRange;
+                uint8ArrayVSR(&bytesRange, bytes, sizeof bytes);
+                reduceStream(&bytesRange,
+                             transducer_apply(
+                                 convertingTransducer(TTAG_FLOAT, 1.0 / 255.0,
+                                                      0.0, &heapAllocator),
+                                 printReducer(&heapAllocator), &heapAllocator),
+                             &heapAllocator);
+                printf("expected: [0.000000, 0.200000, 1.000000]\n");
+
+                /* rounding to even, saturation and NaN, repeated past
+                 * the width of the kernels */
+                float const cases[] = {-5.0f, 0.4f, 0.6f, 1.5f,
+                                       2.5f,  300.0f, NAN};
+                unsigned const expectedBytes[] = {0, 0, 1, 2, 2, 255, 0};
+                size_t const casesCount = sizeof cases / sizeof cases[0];
+                float floats[5 * sizeof cases / sizeof cases[0]];
+                float converted[sizeof floats / sizeof floats[0]];
+                size_t const floatsCount = sizeof floats / sizeof floats[0];
+                for (size_t i = 0; i < floatsCount; i++) {
+                        floats[i] = cases[i % casesCount];
+                }
+                size_t collected = 0;
+                struct CollectingReducer collector = {
+                    .super = {.apply = collectingReducerApply},
+                    .values = converted,
+                    .capacity = floatsCount,
+                    .count = &collected,
+                };
+                struct Transducer *steps[] = {
+                    convertingTransducer(TTAG_UINT8, 1.0, 0.0, &heapAllocator),
+                    convertingTransducer(TTAG_FLOAT, 1.0, 0.0, &heapAllocator),
+                };
+                struct ValueStreamRange floatsRange;
+                floatArrayVSR(&floatsRange, floats, floatsCount);
+                reduceStream(&floatsRange,
+                             transducer_apply(
+                                 composingTransducer(steps, 2, &heapAllocator),
+                                 &collector.super, &heapAllocator),
+                             &heapAllocator);
+                size_t mismatches = 0;
+                printf("result is:");
+                for (size_t i = 0; i < floatsCount; i++) {
+                        if (i < casesCount) {
+                                printf(" %u", (unsigned)converted[i]);
+                        }
+                        mismatches += converted[i] !=
+                                      (float)expectedBytes[i % casesCount];
+                }
+                printf(" ; expected: 0 0 1 2 2 255 0\n");
+
+                /* int16 samples through float and back, at every
+                 * alignment and length around the width of the kernels */
+                static int16_t samples[1000];
+                static float roundTrip[1000];
+                size_t const samplesCount = sizeof samples / sizeof samples[0];
+                for (size_t i = 0; i < samplesCount; i++) {
+                        samples[i] = (int16_t)((int)(i * 7919 % 65536) - 32768);
+                }
+                struct Transducer *roundTripSteps[] = {
+                    convertingTransducer(TTAG_FLOAT, 1.0 / 32768.0, 0.0,
+                                         &heapAllocator),
+                    convertingTransducer(TTAG_INT16, 32768.0, 0.0,
+                                         &heapAllocator),
+                    convertingTransducer(TTAG_FLOAT, 1.0, 0.0, &heapAllocator),
+                };
+                struct CollectingReducer roundTripCollector = {
+                    .super = {.apply = collectingReducerApply},
+                    .values = roundTrip,
+                    .capacity = sizeof roundTrip / sizeof roundTrip[0],
+                    .count = &collected,
+                };
+                struct Reducer *reducer = transducer_apply(
+                    composingTransducer(roundTripSteps, 3, &heapAllocator),
+                    &roundTripCollector.super, &heapAllocator);
+                for (size_t first = 0; first <= 40; first++) {
+                        size_t const count = samplesCount - 2 * first;
+                        struct ValueStreamRange samplesRange;
+                        int16ArrayVSR(&samplesRange, samples + first, count);
+                        collected = 0;
+                        reduceStream(&samplesRange, reducer, &heapAllocator);
+                        for (size_t i = 0; i < count; i++) {
+                                mismatches +=
+                                    roundTrip[i] != (float)samples[first + i];
+                        }
+                }
+                printf("mismatches: %zu ; expected: 0\n", mismatches);
+        }
+
+        printf("18. zip and merge streams\n");
+        {
+                float const floats[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f,
+                                        6.0f, 7.0f, 8.0f, 9.0f, 10.0f};
+                int32_t const ints[] = {10, 20, 30, 40, 50, 60, 70};
+                struct ChunkedArrayVSR floatsRange;
+                struct ChunkedArrayVSR intsRange;
+                chunkedArrayVSR(&floatsRange, TTAG_FLOAT, sizeof floats[0],
+                                floats, sizeof floats / sizeof floats[0], 3);
+                chunkedArrayVSR(&intsRange, TTAG_INT32, sizeof ints[0], ints,
+                                sizeof ints / sizeof ints[0], 4);
+                struct ValueStreamRange *zipped[] = {
+                    &floatsRange.super, &intsRange.super,
+                };
+                alignas(max_align_t) uint8_t
+                    tuples[5 * (sizeof floats[0] + sizeof ints[0])];
+                struct ZipValueStreamRange zip;
+                zipVSR(&zip, zipped, 2, tuples, sizeof tuples);
+                struct Reducer sumOfProducts = {
+                    .identity = accumulateFloatIdentity,
+                    .apply = sumOfProductsApply,
+                };
+                struct Value result =
+                    reduceStream(&zip.super, &sumOfProducts, &heapAllocator);
+                printf("result is: %f ; expected: 1400.0\n",
+                       justFloat(result));
+
+                /* fields of tuples are aligned */
+                uint8_t const flags[] = {1, 0, 1};
+                double const prices[] = {1.5, 2.5, 4.0};
+                struct ValueStreamRange flagsRange;
+                struct ValueStreamRange pricesRange;
+                uint8ArrayVSR(&flagsRange, flags, 3);
+                doubleArrayVSR(&pricesRange, prices, 3);
+                struct ValueStreamRange *flagged[] = {&flagsRange,
+                                                      &pricesRange};
+                alignas(max_align_t) uint8_t flaggedTuples[2 * 16];
+                zipVSR(&zip, flagged, 2, flaggedTuples, sizeof flaggedTuples);
+                size_t const priceOffset =
+                    tupleFieldOffset(sizeof flags[0], sizeof prices[0]);
+                size_t const tupleSize = zip.super.element_size;
+                double flaggedSum = 0.0;
+                size_t misaligned = 0;
+                while (zip.super.error == S_NoError) {
+                        for (uint8_t const *tuple = zip.super.cursor;
+                             tuple < zip.super.end; tuple += tupleSize) {
+                                double const *price =
+                                    (double const *)(tuple + priceOffset);
+                                misaligned += (uintptr_t)price %
+                                                  alignof(double) !=
+                                              0;
+                                flaggedSum += tuple[0] ? *price : 0.0;
+                        }
+                        zip.super.cursor = zip.super.end;
+                        zip.super.next(&zip.super);
+                }
+                printf("result is: %f, tuple size: %zu, misaligned: %zu ; "
+                       "expected: 5.5, tuple size: 16, misaligned: 0\n",
+                       flaggedSum, tupleSize, misaligned);
+
+                int64_t const shards[][7] = {
+                    {1, 4, 7, 10},
+                    {2, 4, 8},
+                    {0, 3, 5, 6, 9, 11, 12},
+                };
+                size_t const shardsCounts[] = {4, 3, 7};
+                struct ChunkedArrayVSR shardsRanges[3];
+                struct ValueStreamRange *merged[3];
+                for (size_t k = 0; k < 3; k++) {
+                        chunkedArrayVSR(&shardsRanges[k], TTAG_INT64,
+                                        sizeof(int64_t), shards[k],
+                                        shardsCounts[k], k + 1);
+                        merged[k] = &shardsRanges[k].super;
+                }
+                int64_t mergeBuffer[4];
+                struct MergeValueStreamRange merge;
+                mergeVSR(&merge, merged, 3, int64Key, NULL,
+                         (uint8_t *)mergeBuffer, sizeof mergeBuffer);
+                reduceStream(&merge.super, printReducer(&heapAllocator),
+                             &heapAllocator);
+                printf("expected: [0, 1, 2, 3, 4, 4, 5, 6, 7, 8, 9, 10, 11, "
+                       "12]\n");
+        }
+
+        printf("19. compute several aggregates in one pass\n");
+        {
+                static float values[100000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 7) - 3.0f;
+                }
+
+                struct Reducer const *aggregates[] = {
+                    floatSumReducer(&heapAllocator),
+                    transducer_apply(
+                        floatAboveFilteringTransducer(0.0f, &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    transducer_apply(takingTransducer(10, &heapAllocator),
+                                     floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    transducer_apply(
+                        floatWindowTransducer(FW_Max, 4, 4, &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    transducer_apply(
+                        mappingFnTransducer(invertFloat, NULL, &heapAllocator),
+                        idReducer(&heapAllocator), &heapAllocator),
+                };
+                struct Reducer *reducer = broadcastingReducer(
+                    aggregates, sizeof aggregates / sizeof aggregates[0],
+                    &heapAllocator);
+
+                struct ChunkedArrayVSR valuesRange;
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                struct Value result =
+                    reduceStream(&valuesRange.super, reducer, &heapAllocator);
+                printValue(result);
+
+                /* the same aggregates, one loop each */
+                float sum = 0.0f;
+                float positivesSum = 0.0f;
+                float firstSum = 0.0f;
+                float blockMaxSum = 0.0f;
+                for (size_t i = 0; i < valuesCount; i++) {
+                        sum += values[i];
+                        positivesSum += values[i] > 0.0f ? values[i] : 0.0f;
+                        firstSum += i < 10 ? values[i] : 0.0f;
+                }
+                for (size_t i = 0; i + 4 <= valuesCount; i += 4) {
+                        float max = values[i];
+                        for (size_t j = i + 1; j < i + 4; j++) {
+                                max = values[j] > max ? values[j] : max;
+                        }
+                        blockMaxSum += max;
+                }
+                printf("\nexpected: <%f %f %f %f %f>\n", sum, positivesSum,
+                       firstSum, blockMaxSum, -values[valuesCount - 1]);
+                freeValue(&result);
+        }
+
+        printf("20. reduce each group of values on its own\n");
+        {
+                float small[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f};
+                int64_t modulo = 3;
+                struct Reducer *reducer =
+                    groupingReducer(floatModuloKey, &modulo,
+                                    floatSumReducer(&heapAllocator),
+                                    &heapAllocator);
+                struct ChunkedArrayVSR smallRange;
+                chunkedArrayVSR(&smallRange, TTAG_FLOAT, sizeof small[0],
+                                small, sizeof small / sizeof small[0], 3);
+                struct Value result =
+                    reduceStream(&smallRange.super, reducer, &heapAllocator);
+                printValue(result);
+                printf("\nexpected: <0: 9.000000 1: 12.000000 2: "
+                       "7.000000>\n");
+                freeValue(&result);
+
+                /* enough groups for the table to grow several times, each
+                 * with a window state moved along with its slot */
+                static float values[100000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)((i * 7919) % 1000);
+                }
+                modulo = 300;
+                reducer = groupingReducer(
+                    floatModuloKey, &modulo,
+                    transducer_apply(
+                        floatWindowTransducer(FW_Max, 4, 4, &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                struct ChunkedArrayVSR valuesRange;
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                result =
+                    reduceStream(&valuesRange.super, reducer, &heapAllocator);
+
+                /* the same blocks, one group at a time */
+                size_t mismatches = 0;
+                struct ValueSpan groups = spanOfArrayValue(result);
+                for (uint8_t const *element = groups.first;
+                     element < groups.last; element += groups.element_size) {
+                        struct GroupResult const *group =
+                            (struct GroupResult const *)element;
+                        float blockMaxSum = 0.0f;
+                        float max = 0.0f;
+                        size_t seen = 0;
+                        for (size_t i = 0; i < valuesCount; i++) {
+                                if ((int64_t)values[i] % modulo != group->key) {
+                                        continue;
+                                }
+                                max = seen % 4 == 0 || values[i] > max
+                                          ? values[i]
+                                          : max;
+                                if (++seen % 4 == 0) {
+                                        blockMaxSum += max;
+                                }
+                        }
+                        mismatches +=
+                            floatOfValue(group->result) != blockMaxSum;
+                }
+                printf("groups: %zu, mismatches: %zu ; expected groups: %lld, "
+                       "mismatches: 0\n",
+                       (size_t)(groups.last - groups.first) /
+                           groups.element_size,
+                       mismatches, (long long)modulo);
+                freeValue(&result);
+
+                /* the last element of each group, staged by a mapping stage
+                 * whose state is too large to be held in the slots */
+                reducer = groupingReducer(
+                    floatModuloKey, &modulo,
+                    transducer_apply(
+                        mappingFnTransducer(invertFloat, NULL, &heapAllocator),
+                        idReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                result =
+                    reduceStream(&valuesRange.super, reducer, &heapAllocator);
+                mismatches = 0;
+                groups = spanOfArrayValue(result);
+                for (uint8_t const *element = groups.first;
+                     element < groups.last; element += groups.element_size) {
+                        struct GroupResult const *group =
+                            (struct GroupResult const *)element;
+                        size_t i = valuesCount;
+                        while (i > 0 &&
+                               (int64_t)values[i - 1] % modulo != group->key) {
+                                i--;
+                        }
+                        mismatches += i == 0 || floatOfValue(group->result) !=
+                                                    -values[i - 1];
+                }
+                printf("last elements mismatches: %zu ; expected: 0\n",
+                       mismatches);
+                freeValue(&result);
+        }
+
+        printf("21. run the segments of a reduction on threads of their own\n");
+        {
+                static float values[200000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 100);
+                }
+                struct Transducer *segments[] = {
+                    mappingFnTransducer(slowFloatMapper, NULL, &heapAllocator),
+                    floatWindowTransducer(FW_Max, 8, 8, &heapAllocator),
+                    floatAboveFilteringTransducer(50.0f, &heapAllocator),
+                };
+                size_t const segmentsCount = sizeof segments / sizeof *segments;
+                struct ChunkedArrayVSR valuesRange;
+
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                struct Value pipelined = reduceStream(
+                    &valuesRange.super,
+                    transducer_apply(
+                        pipelinedTransducer(segments, segmentsCount, 4,
+                                            &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                struct Value sequential = reduceStream(
+                    &valuesRange.super,
+                    transducer_apply(composingTransducer(segments,
+                                                         segmentsCount,
+                                                         &heapAllocator),
+                                     floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("result is: %f ; expected: %f\n",
+                       floatOfValue(pipelined), floatOfValue(sequential));
+
+                /* the result outlives the queue it went through */
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                struct Value last = reduceStream(
+                    &valuesRange.super,
+                    transducer_apply(pipeliningTransducer(2, &heapAllocator),
+                                     idReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("last is: %f ; expected: %f\n", floatOfValue(last),
+                       values[valuesCount - 1]);
+
+                /* downstream ending the reduction stops upstream */
+                struct Transducer *halting[] = {
+                    segments[0],
+                    takingTransducer(1000, &heapAllocator),
+                };
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                pipelined = reduceStream(
+                    &valuesRange.super,
+                    transducer_apply(pipelinedTransducer(halting, 2, 4,
+                                                         &heapAllocator),
+                                     floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                chunkedArrayVSR(&valuesRange, TTAG_FLOAT, sizeof values[0],
+                                values, valuesCount, 30000);
+                sequential = reduceStream(
+                    &valuesRange.super,
+                    transducer_apply(
+                        composingTransducer(halting, 2, &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                printf("result is: %f ; expected: %f\n",
+                       floatOfValue(pipelined), floatOfValue(sequential));
+
+                /* chunks and indices cross the queue too */
+                float small[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+                struct Transducer *chunking[] = {
+                    indexingTransducer(&heapAllocator),
+                    partitioningAllTransducer(2, &heapAllocator),
+                };
+                struct ChunkedArrayVSR smallRange;
+                chunkedArrayVSR(&smallRange, TTAG_FLOAT, sizeof small[0],
+                                small, sizeof small / sizeof small[0], 3);
+                reduceStream(
+                    &smallRange.super,
+                    transducer_apply(pipelinedTransducer(chunking, 2, 1,
+                                                         &heapAllocator),
+                                     printReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("expected: [<1.000000 2.000000>, <3.000000 4.000000>, "
+                       "<5.000000>]\n");
+                struct Transducer *indexing[] = {
+                    indexingTransducer(&heapAllocator),
+                    takingTransducer(4, &heapAllocator),
+                };
+                chunkedArrayVSR(&smallRange, TTAG_FLOAT, sizeof small[0],
+                                small, sizeof small / sizeof small[0], 3);
+                reduceStream(
+                    &smallRange.super,
+                    transducer_apply(pipelinedTransducer(indexing, 2, 1,
+                                                         &heapAllocator),
+                                     printReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("expected: [(0 1.000000), (1 2.000000), (2 3.000000), "
+                       "(3 4.000000)]\n");
+        }
+
+        printf("22. pull the elements a transducer produces as a stream\n");
+        {
+                static float values[100000];
+                size_t const valuesCount = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < valuesCount; i++) {
+                        values[i] = (float)(i % 100) - 50.0f;
+                }
+                struct Transducer *stages[] = {
+                    floatAboveFilteringTransducer(0.0f, &heapAllocator),
+                    partitioningAllTransducer(3, &heapAllocator),
+                };
+                struct Transducer *transducer =
+                    composingTransducer(stages, 2, &heapAllocator);
+
+                struct ValueStreamRange valuesRange;
+                struct EductionValueStreamRange eduction;
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                eductionVSR(&eduction, &valuesRange, transducer, 256,
+                            &heapAllocator);
+                struct Value educed = reduceStream(
+                    &eduction.super, floatSumReducer(&heapAllocator),
+                    &heapAllocator);
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                struct Value direct = reduceStream(
+                    &valuesRange,
+                    transducer_apply(stages[0], floatSumReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("result is: %f ; expected: %f\n",
+                       floatOfValue(educed), floatOfValue(direct));
+
+                /* only what the first elements need is pulled */
+                floatArrayVSR(&valuesRange, values, valuesCount);
+                eductionVSR(&eduction, &valuesRange,
+                            takingTransducer(5, &heapAllocator), 64,
+                            &heapAllocator);
+                printf("pulled: %zu ; expected: 16\n",
+                       (size_t)(valuesRange.cursor - valuesRange.start) /
+                           sizeof values[0]);
+                reduceStream(&eduction.super, printReducer(&heapAllocator),
+                             &heapAllocator);
+                printf("expected: [-50.000000, -49.000000, -48.000000, "
+                       "-47.000000, -46.000000]\n");
+
+                /* pulled by another stream */
+                int64_t const integers[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+                int64_t const parities[] = {0, 1};
+                struct ValueStreamRange integersRanges[2];
+                struct EductionValueStreamRange parityRanges[2];
+                struct ValueStreamRange *parityStreams[2];
+                for (size_t k = 0; k < 2; k++) {
+                        int64ArrayVSR(&integersRanges[k], integers, 10);
+                        eductionVSR(&parityRanges[k], &integersRanges[k],
+                                    filteringTransducer(hasParity,
+                                                        (void *)&parities[k],
+                                                        &heapAllocator),
+                                    2 * sizeof integers[0], &heapAllocator);
+                        parityStreams[k] = &parityRanges[k].super;
+                }
+                struct MergeValueStreamRange merge;
+                int64_t mergeBuffer[3];
+                mergeVSR(&merge, parityStreams, 2, int64Key, NULL,
+                         (uint8_t *)mergeBuffer, sizeof mergeBuffer);
+                reduceStream(&merge.super, printReducer(&heapAllocator),
+                             &heapAllocator);
+                printf("expected: [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]\n");
+        }
+
+        printf("23. estimate distinct counts, frequencies and quantiles\n");
+        {
+                static int64_t keys[100000];
+                static float values[100000];
+                size_t const count = sizeof keys / sizeof keys[0];
+                for (size_t i = 0; i < count; i++) {
+                        keys[i] = (int64_t)(i * 7919 % 20000);
+                        values[i] = (float)(i * 7919 % count);
+                }
+
+                struct ValueStreamRange keysRange;
+                int64ArrayVSR(&keysRange, keys, count);
+                struct Value distinct = reduceStream(
+                    &keysRange, hyperLogLogReducer(12, &heapAllocator),
+                    &heapAllocator);
+                int64ArrayVSR(&keysRange, keys, count);
+                struct Value parallelDistinct = parallelReduceStream(
+                    &keysRange, NULL, hyperLogLogReducer(12, &heapAllocator), 4,
+                    &heapAllocator);
+                printf("within 5%%: %s, parallel: %s ; expected within 5%%: "
+                       "yes, parallel: same\n",
+                       fabs(doubleOfValue(distinct) - 20000.0) < 1000.0
+                           ? "yes"
+                           : "no",
+                       doubleOfValue(distinct) ==
+                               doubleOfValue(parallelDistinct)
+                           ? "same"
+                           : "different");
+
+                size_t exact[100] = {0};
+                for (size_t i = 0; i < count; i++) {
+                        keys[i] = skewedKey(i);
+                        exact[keys[i] < 100 ? keys[i] : 0]++;
+                }
+                int64ArrayVSR(&keysRange, keys, count);
+                struct Value hitters = parallelReduceStream(
+                    &keysRange, NULL,
+                    countMinReducer(int64Key, NULL, 1024, 4, 3,
+                                    &heapAllocator),
+                    4, &heapAllocator);
+                printValue(hitters);
+                printf("\nexpected: <1: %zu 2: %zu 3: %zu>\n", exact[1],
+                       exact[2], exact[3]);
+                freeValue(&hitters);
+
+                double const quantiles[] = {0.01, 0.5, 0.99};
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, count);
+                struct Value estimates = parallelReduceStream(
+                    &valuesRange, NULL,
+                    quantilesReducer(quantiles, 3, 200, &heapAllocator), 4,
+                    &heapAllocator);
+                float const *estimated = arrayElements(estimates);
+                bool close = true;
+                for (size_t q = 0; q < 3; q++) {
+                        close = close && fabs(estimated[q] -
+                                              quantiles[q] * (double)count) <
+                                             0.02 * (double)count;
+                }
+                printf("within 2%%: %s ; expected: yes\n",
+                       close ? "yes" : "no");
+                freeValue(&estimates);
+        }
+
+        printf("24. keep the highest or a random few elements\n");
+        {
+                static float values[100000];
+                static float sorted[100000];
+                size_t const count = sizeof values / sizeof values[0];
+                for (size_t i = 0; i < count; i++) {
+                        values[i] = (float)(i * 7919 % 65536);
+                }
+                memcpy(sorted, values, sizeof values);
+                qsort(sorted, count, sizeof sorted[0],
+                      compareFloatsDescending);
+
+                struct ValueStreamRange valuesRange;
+                floatArrayVSR(&valuesRange, values, count);
+                struct Value top = parallelReduceStream(
+                    &valuesRange, NULL,
+                    topKReducer(5, floatKey, NULL, &heapAllocator), 4,
+                    &heapAllocator);
+                printValue(top);
+                printf("\nexpected: <");
+                for (size_t i = 0; i < 5; i++) {
+                        printf(i ? " %.0f: %f" : "%.0f: %f", sorted[i],
+                               sorted[i]);
+                }
+                printf(">\n");
+                freeValue(&top);
+
+                /* each of 100 elements drawn about as often */
+                float small[100];
+                for (size_t i = 0; i < 100; i++) {
+                        small[i] = (float)i;
+                }
+                float drawn[10];
+                size_t draws[100] = {0};
+                size_t drawnCount;
+                struct CollectingReducer collecting = {
+                    .super = {.apply = collectingReducerApply},
+                    .values = drawn,
+                    .capacity = sizeof drawn / sizeof drawn[0],
+                    .count = &drawnCount,
+                };
+                for (uint64_t seed = 0; seed < 2000; seed++) {
+                        struct ValueStreamRange smallRange;
+                        floatArrayVSR(&smallRange, small, 100);
+                        drawnCount = 0;
+                        reduceStream(
+                            &smallRange,
+                            transducer_apply(
+                                reservoirSamplingTransducer(10, seed,
+                                                            &heapAllocator),
+                                &collecting.super,
+                                &heapAllocator),
+                            &heapAllocator);
+                        for (size_t i = 0; i < 10; i++) {
+                                draws[(size_t)drawn[i]]++;
+                        }
+                }
+                size_t fewest = draws[0];
+                size_t most = draws[0];
+                for (size_t i = 1; i < 100; i++) {
+                        fewest = draws[i] < fewest ? draws[i] : fewest;
+                        most = draws[i] > most ? draws[i] : most;
+                }
+                printf("uniform: %s ; expected: yes\n",
+                       fewest > 140 && most < 260 ? "yes" : "no");
+
+                struct ValueStreamRange fewRange;
+                floatArrayVSR(&fewRange, small, 3);
+                reduceStream(
+                    &fewRange,
+                    transducer_apply(reservoirSamplingTransducer(
+                                         10, 42, &heapAllocator),
+                                     printReducer(&heapAllocator),
+                                     &heapAllocator),
+                    &heapAllocator);
+                printf("expected: [0.000000, 1.000000, 2.000000]\n");
+        }
+
+        printf("25. parse numbers out of text\n");
+        {
+                static char const text[] =
+                    "1.5,2,-3.25\n4e2, 5 \r\n\n,0.1,123456789.125";
+                float floats[4];
+                for (size_t chunk = 1; chunk <= 7; chunk += 6) {
+                        struct ChunkedStreamRange source;
+                        struct TextValueStreamRange numbers;
+                        chunkedStream(&source, (uint8_t const *)text,
+                                      sizeof text - 1, chunk);
+                        textVSR(&numbers, TTAG_FLOAT, ',', &source.super,
+                                (uint8_t *)floats, sizeof floats);
+                        reduceStream(&numbers.super,
+                                     printReducer(&heapAllocator),
+                                     &heapAllocator);
+                        printf("expected: [1.500000, 2.000000, -3.250000, "
+                               "400.000000, 5.000000, 0.100000, "
+                               "123456792.000000]\n");
+                }
+
+                static char lines[1000000];
+                static float expected[100000];
+                size_t const count = sizeof expected / sizeof expected[0];
+                size_t size = 0;
+                for (size_t i = 0; i < count; i++) {
+                        int const whole = (int)(i * 7919 % 20000) - 10000;
+                        int const hundredths = (int)(i % 100);
+                        char const *token = lines + size;
+                        size += (size_t)snprintf(
+                            lines + size, sizeof lines - size, "%s%d.%02d\n",
+                            whole < 0 ? "-" : "", abs(whole), hundredths);
+                        expected[i] = strtof(token, NULL);
+                }
+                struct ChunkedStreamRange source;
+                chunkedStream(&source, (uint8_t const *)lines, size, 4093);
+                struct TextValueStreamRange numbers;
+                uint8_t buffer[4096];
+                textVSR(&numbers, TTAG_FLOAT, ',', &source.super, buffer,
+                        sizeof buffer);
+                size_t parsed = 0;
+                size_t mismatches = 0;
+                while (numbers.super.error == S_NoError) {
+                        for (float const *x =
+                                 (float const *)numbers.super.cursor;
+                             x < (float const *)numbers.super.end; x++) {
+                                mismatches += parsed >= count ||
+                                              *x != expected[parsed];
+                                parsed++;
+                        }
+                        numbers.super.cursor = numbers.super.end;
+                        numbers.super.next(&numbers.super);
+                }
+                printf("parsed: %zu, mismatches: %zu ; expected parsed: %zu, "
+                       "mismatches: 0\n",
+                       parsed, mismatches, count);
+
+                static char const integers[] = "12\n-7\n9223372036854775807"
+                                               "\nfoo\n3";
+                int64_t int64s[8];
+                struct StreamRange integersSource;
+                stream_on_memory(&integersSource, (uint8_t const *)integers,
+                                 sizeof integers - 1);
+                textVSR(&numbers, TTAG_INT64, ',', &integersSource,
+                        (uint8_t *)int64s, sizeof int64s);
+                reduceStream(&numbers.super, printReducer(&heapAllocator),
+                             &heapAllocator);
+                printf("expected: [12, -7, 9223372036854775807]\n");
+                printf("error is: %d ; expected: %d\n", numbers.super.error,
+                       S_IOError);
+        }
+
+
+        printf("26. project fields of binary records\n");
+        {
+                struct Trade
+                {
+                        int64_t timestamp;
+                        double price;
+                        float quantity;
+                        int32_t venue;
+                        int16_t flags;
+                        uint8_t side;
+                };
+                static struct Trade trades[100000];
+                size_t const count = sizeof trades / sizeof trades[0];
+                for (size_t i = 0; i < count; i++) {
+                        trades[i] = (struct Trade){
+                            .timestamp = 1000000 + (int64_t)i,
+                            .price = (double)(i * 7919 % 977) * 0.5,
+                            .quantity = (float)(i % 13),
+                            .venue = (int32_t)(i % 7),
+                            .flags = (int16_t)(i % 3),
+                            .side = (uint8_t)(i / 5 % 2),
+                        };
+                }
+                struct RecordField const fields[] = {
+                    {TTAG_INT64, offsetof(struct Trade, timestamp)},
+                    {TTAG_DOUBLE, offsetof(struct Trade, price)},
+                    {TTAG_FLOAT, offsetof(struct Trade, quantity)},
+                    {TTAG_INT32, offsetof(struct Trade, venue)},
+                    {TTAG_INT16, offsetof(struct Trade, flags)},
+                    {TTAG_UINT8, offsetof(struct Trade, side)},
+                };
+                struct RecordSchema const schema = {
+                    .record_size = sizeof(struct Trade),
+                    .fields = fields,
+                    .field_count = sizeof fields / sizeof fields[0],
+                };
+
+                /* quantity of the buys on venue 3 */
+                size_t const quantity[] = {2};
+                struct RecordPredicate const buysOnVenue3[] = {
+                    {.field = 3, .comparison = RC_Equal, .operand = 3},
+                    {.field = 5, .comparison = RC_Equal, .operand = 1},
+                };
+                float expected = 0.0f;
+                for (size_t i = 0; i < count; i++) {
+                        if (trades[i].venue == 3 && trades[i].side == 1) {
+                                expected += trades[i].quantity;
+                        }
+                }
+                struct ValueStreamRange tradesRange;
+                recordArrayVSR(&tradesRange, trades, sizeof trades[0], count);
+                struct Value sum = reduceStream(
+                    &tradesRange,
+                    transducer_apply(
+                        projectingTransducer(&schema, quantity, 1,
+                                             buysOnVenue3, 2, &heapAllocator),
+                        floatSumReducer(&heapAllocator), &heapAllocator),
+                    &heapAllocator);
+                printf("result is: %f ; expected: %f\n", floatOfValue(sum),
+                       expected);
+
+                /* tuples of the side and timestamp of expensive trades */
+                size_t const sideAndTimestamp[] = {5, 0};
+                struct RecordPredicate const expensive[] = {
+                    {.field = 1, .comparison = RC_GreaterOrEqual,
+                     .operand = 400.0},
+                };
+                recordArrayVSR(&tradesRange, trades, sizeof trades[0], count);
+                struct EductionValueStreamRange tuples;
+                eductionVSR(&tuples, &tradesRange,
+                            projectingTransducer(&schema, sideAndTimestamp, 2,
+                                                 expensive, 1, &heapAllocator),
+                            4096, &heapAllocator);
+                size_t next = 0;
+                size_t projected = 0;
+                size_t const timestampOffset =
+                    tupleFieldOffset(sizeof(uint8_t), sizeof(int64_t));
+                size_t mismatches = tuples.super.element_size !=
+                                    timestampOffset + sizeof(int64_t);
+                while (tuples.super.error == S_NoError) {
+                        for (uint8_t const *tuple = tuples.super.cursor;
+                             tuple < tuples.super.end;
+                             tuple += tuples.super.element_size) {
+                                while (next < count &&
+                                       trades[next].price < 400.0) {
+                                        next++;
+                                }
+                                int64_t const *timestamp =
+                                    (int64_t const *)(tuple +
+                                                      timestampOffset);
+                                mismatches +=
+                                    next == count ||
+                                    (uintptr_t)timestamp % alignof(int64_t) ||
+                                    *timestamp != trades[next].timestamp ||
+                                    tuple[0] != trades[next].side;
+                                next++;
+                                projected++;
+                        }
+                        tuples.super.cursor = tuples.super.end;
+                        tuples.super.next(&tuples.super);
+                }
+                releaseEductionVSR(&tuples);
+                size_t expensiveCount = 0;
+                for (size_t i = 0; i < count; i++) {
+                        expensiveCount += trades[i].price >= 400.0;
+                }
+                printf("projected: %zu, mismatches: %zu ; expected "
+                       "projected: %zu, mismatches: 0\n",
+                       projected, mismatches, expensiveCount);
+
+                /* indexed records keep their index */
+                struct Transducer *stages[] = {
+                    indexingTransducer(&heapAllocator),
+                    projectingTransducer(&schema, quantity, 1, buysOnVenue3,
+                                         2, &heapAllocator),
+                };
+                recordArrayVSR(&tradesRange, trades, sizeof trades[0], 40);
+                reduceStream(&tradesRange,
+                             transducer_apply(
+                                 composingTransducer(stages, 2, &heapAllocator),
+                                 printReducer(&heapAllocator), &heapAllocator),
+                             &heapAllocator);
+                printf("expected: [(17 4.000000), (38 12.000000)]\n");
+        }
+
         return 0;
 }
@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel_reduce.h"
+
+#include "allocator.h"
+#include "stream_types.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "value_stream_types.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+/* smallest chunk worth handing to a worker */
+#define MIN_CHUNK_ELEMENTS 4096
+/* more chunks than workers, so that faster workers take over the rest */
+#define CHUNKS_PER_WORKER 8
+
+struct ParallelReduction
+{
+        struct ValueSpan span;
+        size_t chunkElements;
+        size_t chunksCount;
+        atomic_size_t nextChunk;
+        struct Value *results;
+        struct Allocator *allocator;
+};
+
+struct WorkerPool;
+
+struct Worker
+{
+        struct WorkerPool *pool;
+        struct Reducer const *reducer;
+        void *state;
+        pthread_t thread;
+};
+
+/*
+ * Workers started with the first buffer worth reducing in parallel, kept
+ * waiting for the next ones until the stream ends. The calling thread is
+ * the first worker and reuses the state of the reduction.
+ *
+ * Each buffer is a new round: the caller publishes its reduction and wakes
+ * the workers up, then waits for all of them to be done with it.
+ */
+struct WorkerPool
+{
+        pthread_mutex_t mutex;
+        /// signalled on a new round, and when stopping
+        pthread_cond_t wakeup;
+        /// signalled when the last busy worker is done with its round
+        pthread_cond_t done;
+        struct ParallelReduction *reduction;
+        size_t round;
+        size_t busy;
+        bool stopping;
+        struct Worker *workers;
+        /// workers running, the caller included
+        size_t started;
+};
+
+static void workerRun(struct Worker *worker,
+                      struct ParallelReduction *reduction)
+{
+        size_t const chunkSize =
+            reduction->chunkElements * reduction->span.element_size;
+
+        size_t chunk;
+        while ((chunk = atomic_fetch_add(&reduction->nextChunk, 1)) <
+               reduction->chunksCount) {
+                struct ValueSpan span = reduction->span;
+                uint8_t const *first = span.first + chunk * chunkSize;
+                uint8_t const *last = (size_t)(span.last - first) > chunkSize
+                                          ? first + chunkSize
+                                          : span.last;
+                span = subSpan(span, first, last);
+
+                struct Value result =
+                    reducer_identity(worker->reducer, reduction->allocator);
+                reduction->results[chunk] =
+                    reducer_apply_batch(worker->reducer, worker->state, span,
+                                        result, reduction->allocator);
+        }
+}
+
+static void *workerLoop(void *data)
+{
+        struct Worker *worker = data;
+        struct WorkerPool *pool = worker->pool;
+        size_t round = 0;
+
+        pthread_mutex_lock(&pool->mutex);
+        for (;;) {
+                while (pool->round == round && !pool->stopping) {
+                        pthread_cond_wait(&pool->wakeup, &pool->mutex);
+                }
+                if (pool->stopping) {
+                        break;
+                }
+                round = pool->round;
+                struct ParallelReduction *reduction = pool->reduction;
+                pthread_mutex_unlock(&pool->mutex);
+
+                workerRun(worker, reduction);
+
+                pthread_mutex_lock(&pool->mutex);
+                if (--pool->busy == 0) {
+                        pthread_cond_signal(&pool->done);
+                }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        return NULL;
+}
+
+static size_t onlineCPUs(void)
+{
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (size_t)count : 1;
+}
+
+static void poolStart(struct WorkerPool *pool, struct Reducer const *reducer,
+                      void *state, size_t workerCount,
+                      struct Allocator *allocator)
+{
+        *pool = (struct WorkerPool){
+            .workers = allocator_alloc(allocator,
+                                       workerCount * sizeof *pool->workers),
+        };
+        pthread_mutex_init(&pool->mutex, NULL);
+        pthread_cond_init(&pool->wakeup, NULL);
+        pthread_cond_init(&pool->done, NULL);
+
+        pool->workers[0] = (struct Worker){
+            .pool = pool,
+            .reducer = reducer,
+            .state = state,
+        };
+        for (pool->started = 1; pool->started < workerCount;
+             pool->started++) {
+                struct Worker *worker = &pool->workers[pool->started];
+                *worker = (struct Worker){
+                    .pool = pool,
+                    .reducer = reducer,
+                    .state = reducer_new_state(reducer, allocator),
+                };
+                if (0 != pthread_create(&worker->thread, NULL, workerLoop,
+                                        worker)) {
+                        allocator_free(allocator, worker->state);
+                        break;
+                }
+        }
+}
+
+static void poolStop(struct WorkerPool *pool, struct Allocator *allocator)
+{
+        pthread_mutex_lock(&pool->mutex);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->wakeup);
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (size_t i = 1; i < pool->started; i++) {
+                pthread_join(pool->workers[i].thread, NULL);
+                allocator_free(allocator, pool->workers[i].state);
+        }
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->wakeup);
+        pthread_mutex_destroy(&pool->mutex);
+        allocator_free(allocator, pool->workers);
+}
+
+static struct Value reduceInParallel(struct WorkerPool *pool,
+                                     struct ValueSpan span, size_t count,
+                                     struct Allocator *allocator)
+{
+        struct Reducer const *reducer = pool->workers[0].reducer;
+        size_t chunkElements = count / (pool->started * CHUNKS_PER_WORKER);
+        if (chunkElements < MIN_CHUNK_ELEMENTS) {
+                chunkElements = MIN_CHUNK_ELEMENTS;
+        }
+
+        struct ParallelReduction reduction = {
+            .span = span,
+            .chunkElements = chunkElements,
+            .chunksCount = (count + chunkElements - 1) / chunkElements,
+            .allocator = allocator,
+        };
+        atomic_init(&reduction.nextChunk, 0);
+        reduction.results = allocator_alloc(
+            allocator, reduction.chunksCount * sizeof *reduction.results);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->reduction = &reduction;
+        pool->busy = pool->started - 1;
+        pool->round++;
+        pthread_cond_broadcast(&pool->wakeup);
+        pthread_mutex_unlock(&pool->mutex);
+
+        workerRun(&pool->workers[0], &reduction);
+
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->busy > 0) {
+                pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        struct Value result = reduction.results[0];
+        for (size_t i = 1; i < reduction.chunksCount; i++) {
+                result = reducer_combine(reducer, result, reduction.results[i],
+                                         allocator);
+        }
+
+        /* the states of the workers go on with the next buffer */
+        for (size_t i = 1; i < pool->started; i++) {
+                result = detachValue(result, pool->workers[i].state,
+                                     reducer->state_size, allocator);
+        }
+        allocator_free(allocator, reduction.results);
+
+        return result;
+}
+
+struct Value parallelReduceStream(struct ValueStreamRange *range,
+                                  struct Transducer *transducer,
+                                  struct Reducer const *step,
+                                  size_t workerCount,
+                                  struct Allocator *allocator)
+{
+        struct Reducer const *reducer =
+            transducer ? transducer_apply(transducer, step, allocator) : step;
+        void *state = reducer_new_state(reducer, allocator);
+        struct Value result = reducer_identity(reducer, allocator);
+        if (workerCount == 0) {
+                workerCount = onlineCPUs();
+        }
+
+        bool const parallel =
+            reducer->combine && !reducer->may_halt && workerCount > 1;
+        struct WorkerPool pool;
+        bool poolStarted = false;
+        while (range->error == S_NoError && !isReduced(result)) {
+                if (range->cursor < range->end) {
+                        size_t const count =
+                            range->element_size
+                                ? (size_t)(range->end - range->cursor) /
+                                      range->element_size
+                                : 0;
+                        struct ValueSpan span = {
+                            .type_tag = range->type_tag,
+                            .element_size = range->element_size,
+                            .first = range->cursor,
+                            .last = range->end,
+                        };
+                        range->cursor = range->end;
+                        if (parallel && count >= 2 * MIN_CHUNK_ELEMENTS) {
+                                if (!poolStarted) {
+                                        poolStart(&pool, reducer, state,
+                                                  workerCount, allocator);
+                                        poolStarted = true;
+                                }
+                                result = reducer_combine(
+                                    reducer, result,
+                                    reduceInParallel(&pool, span, count,
+                                                     allocator),
+                                    allocator);
+                        } else {
+                                result = reducer_apply_batch(
+                                    reducer, state, span, result, allocator);
+                        }
+                        continue;
+                }
+                range->next(range);
+        }
+        if (poolStarted) {
+                poolStop(&pool, allocator);
+        }
+        result = reducer_complete(reducer, state, unreducedValue(result),
+                                  allocator);
+        result = detachValue(result, state, reducer->state_size, allocator);
+        allocator_free(allocator, state);
+
+        return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "values.h"
+
+#include <stddef.h>
+
+struct Allocator;
+struct Reducer;
+struct Transducer;
+struct ValueStreamRange;
+
+/**
+ * Reduces range, each buffer it hands out on workerCount threads.
+ *
+ * Each buffer is cut in chunks, which the workers claim in turn from a
+ * shared counter until none is left: faster workers take more chunks, but
+ * no worker steals from another. The workers are started with the first
+ * buffer worth it and wait for the next ones until the stream ends. All
+ * workers share the reducer obtained by applying transducer (when not
+ * NULL) to step, each with its own state kept from one buffer to the next,
+ * and the results of the chunks are merged in order with combine.
+ *
+ * Buffers too small to be worth the threads are reduced sequentially, as
+ * is the whole stream when the reducer has no combine or may halt.
+ *
+ * @param workerCount number of threads, or 0 for one per online CPU
+ * @param allocator must be usable from several threads at once
+ */
+struct Value parallelReduceStream(struct ValueStreamRange *range,
+                                  struct Transducer *transducer,
+                                  struct Reducer const *step,
+                                  size_t workerCount,
+                                  struct Allocator *allocator);
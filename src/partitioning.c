@@ -0,0 +1,406 @@
+#include "partitioning.h"
+
+#include "allocator.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Chunk being gathered by a partitioning stage, part of its state.
+ *
+ * The buffer is allocated from the allocator of the reduction when the
+ * first element comes in, and only reallocated when a chunk outgrows it.
+ */
+struct Partition
+{
+        struct Allocator *allocator;
+        uint8_t *buffer;
+        size_t capacity;
+        uint32_t type_tag;
+        size_t element_size;
+        size_t count;
+        int64_t key;
+        /// payload of the chunk being forwarded
+        struct ArrayPayload chunk;
+        /// set once downstream ended the reduction, so that completing does
+        /// not forward the partial chunk
+        bool halted;
+};
+
+static bool partitionAccepts(struct Partition const *partition,
+                             uint32_t type_tag, size_t element_size)
+{
+        return partition->count == 0 ||
+               (partition->type_tag == type_tag &&
+                partition->element_size == element_size);
+}
+
+/* makes room for capacity elements, keeping those already gathered */
+static void partitionReserve(struct Partition *partition, size_t capacity,
+                             struct Allocator *allocator)
+{
+        size_t const size = capacity * partition->element_size;
+        if (size <= partition->capacity) {
+                return;
+        }
+
+        uint8_t *buffer = allocator_alloc(allocator, size);
+        if (partition->buffer) {
+                memcpy(buffer, partition->buffer,
+                       partition->count * partition->element_size);
+                allocator_free(partition->allocator, partition->buffer);
+        }
+        partition->allocator = allocator;
+        partition->buffer = buffer;
+        partition->capacity = size;
+}
+
+static void partitionAppend(struct Partition *partition, void const *elements,
+                            size_t count)
+{
+        memcpy(partition->buffer + partition->count * partition->element_size,
+               elements, count * partition->element_size);
+        partition->count += count;
+}
+
+static struct Value partitionEmit(struct ChainedReducer const *self,
+                                  struct Partition *partition,
+                                  void *stepState, void const *elements,
+                                  size_t count, struct Value current,
+                                  struct Allocator *allocator)
+{
+        partition->chunk = (struct ArrayPayload){
+            .count = count,
+            .elements = elements,
+        };
+        current = reducer_apply(self->step, stepState,
+                                arrayValue(partition->type_tag,
+                                           partition->element_size,
+                                           &partition->chunk),
+                                current, allocator);
+        partition->halted = isReduced(current);
+
+        return current;
+}
+
+static struct Value partitionFlush(struct ChainedReducer const *self,
+                                   struct Partition *partition,
+                                   void *stepState, struct Value current,
+                                   struct Allocator *allocator)
+{
+        if (partition->count > 0) {
+                size_t const count = partition->count;
+                partition->count = 0;
+                current = partitionEmit(self, partition, stepState,
+                                        partition->buffer, count, current,
+                                        allocator);
+        }
+
+        return current;
+}
+
+/* forwards the partial chunk unless downstream is done, then releases the
+ * buffer */
+static struct Value partitioningReducerComplete(struct Reducer const *reducer,
+                                                void *state,
+                                                struct Value result,
+                                                struct Allocator *allocator)
+{
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        struct Partition *partition = state;
+        void *stepState = chainedStepState(self, state);
+
+        if (!partition->halted) {
+                result = unreducedValue(partitionFlush(
+                    self, partition, stepState, result, allocator));
+        }
+        /* the last chunk was only lent to the step */
+        result = detachValue(result, &partition->chunk,
+                             sizeof partition->chunk, allocator);
+        if (partition->buffer) {
+                allocator_free(partition->allocator, partition->buffer);
+                partition->buffer = NULL;
+                partition->capacity = 0;
+        }
+
+        return reducer_complete(self->step, stepState, result, allocator);
+}
+
+static struct Reducer *
+newPartitioningReducer(struct Reducer const *step,
+                       struct Value (*apply)(struct Reducer const *, void *,
+                                             struct Value, struct Value,
+                                             struct Allocator *),
+                       size_t size, struct Allocator *allocator)
+{
+        struct ChainedReducer *result = allocator_alloc(allocator, size);
+
+        *result = chainedReducerMake(step, apply, sizeof(struct Partition));
+        result->super.complete = partitioningReducerComplete;
+
+        return &result->super;
+}
+
+/* partitioning all */
+
+struct PartitioningAllTransducer
+{
+        struct Transducer super;
+        size_t n;
+};
+
+struct PartitioningAllReducer
+{
+        struct ChainedReducer super;
+        size_t n;
+};
+
+static struct Value partitioningAllReducerApply(struct Reducer const *reducer,
+                                                void *state, struct Value input,
+                                                struct Value current,
+                                                struct Allocator *allocator)
+{
+        struct PartitioningAllReducer const *self =
+            (struct PartitioningAllReducer const *)reducer;
+        struct Partition *partition = state;
+        void *stepState = chainedStepState(&self->super, state);
+
+        if (!partitionAccepts(partition, input.type_tag, input.element_size)) {
+                current = partitionFlush(&self->super, partition, stepState,
+                                         current, allocator);
+                if (isReduced(current)) {
+                        return current;
+                }
+        }
+        partition->type_tag = input.type_tag;
+        partition->element_size = input.element_size;
+        partitionReserve(partition, self->n, allocator);
+        partitionAppend(partition, valueAddress(&input), 1);
+
+        if (partition->count == self->n) {
+                current = partitionFlush(&self->super, partition, stepState,
+                                         current, allocator);
+        }
+
+        return current;
+}
+
+/* whole chunks of the span go downstream without being copied */
+static struct Value
+partitioningAllReducerApplyBatch(struct Reducer const *reducer, void *state,
+                                 struct ValueSpan span, struct Value current,
+                                 struct Allocator *allocator)
+{
+        struct PartitioningAllReducer const *self =
+            (struct PartitioningAllReducer const *)reducer;
+        struct Partition *partition = state;
+        void *stepState = chainedStepState(&self->super, state);
+        size_t const n = self->n;
+
+        if (!partitionAccepts(partition, span.type_tag, span.element_size)) {
+                current = partitionFlush(&self->super, partition, stepState,
+                                         current, allocator);
+        }
+        partition->type_tag = span.type_tag;
+        partition->element_size = span.element_size;
+
+        uint8_t const *first = span.first;
+        while (first < span.last && !isReduced(current)) {
+                size_t const remaining =
+                    (size_t)(span.last - first) / span.element_size;
+                if (partition->count == 0 && remaining >= n) {
+                        current = partitionEmit(&self->super, partition,
+                                                stepState, first, n, current,
+                                                allocator);
+                        first += n * span.element_size;
+                        continue;
+                }
+
+                size_t const count = remaining < n - partition->count
+                                         ? remaining
+                                         : n - partition->count;
+                partitionReserve(partition, n, allocator);
+                partitionAppend(partition, first, count);
+                first += count * span.element_size;
+                if (partition->count == n) {
+                        current = partitionFlush(&self->super, partition,
+                                                 stepState, current, allocator);
+                }
+        }
+
+        return current;
+}
+
+static struct Reducer *
+partitioningAllTransducerApply(struct Transducer *transducer,
+                               struct Reducer const *step,
+                               struct Allocator *allocator)
+{
+        struct PartitioningAllTransducer *self =
+            (struct PartitioningAllTransducer *)transducer;
+        struct PartitioningAllReducer *result =
+            (struct PartitioningAllReducer *)newPartitioningReducer(
+                step, partitioningAllReducerApply, sizeof *result, allocator);
+
+        result->super.super.apply_batch = partitioningAllReducerApplyBatch;
+        result->n = self->n;
+
+        return &result->super.super;
+}
+
+struct Transducer *partitioningAllTransducer(size_t n,
+                                             struct Allocator *allocator)
+{
+        /* chunks of no elements would never fill up */
+        assert(n > 0);
+
+        struct PartitioningAllTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct PartitioningAllTransducer){
+            .n = n,
+            .super = (struct Transducer){
+                .apply = partitioningAllTransducerApply,
+            }};
+
+        return &transducer->super;
+}
+
+/* partitioning by key */
+
+struct PartitioningByTransducer
+{
+        struct Transducer super;
+        int64_t (*keyFn)(struct Value value, void *data);
+        void *keyData;
+};
+
+struct PartitioningByReducer
+{
+        struct ChainedReducer super;
+        int64_t (*keyFn)(struct Value value, void *data);
+        void *keyData;
+};
+
+/* adds count elements of the same key, starting a new chunk when the key
+ * or the type of the elements changes */
+static struct Value partitioningByPush(struct PartitioningByReducer const *self,
+                                       struct Partition *partition,
+                                       void *stepState, uint32_t type_tag,
+                                       size_t element_size, int64_t key,
+                                       void const *elements, size_t count,
+                                       struct Value current,
+                                       struct Allocator *allocator)
+{
+        if (!partitionAccepts(partition, type_tag, element_size) ||
+            (partition->count > 0 && partition->key != key)) {
+                current = partitionFlush(&self->super, partition, stepState,
+                                         current, allocator);
+                if (isReduced(current)) {
+                        return current;
+                }
+        }
+        partition->type_tag = type_tag;
+        partition->element_size = element_size;
+        partition->key = key;
+
+        size_t const needed = partition->count + count;
+        if (needed * element_size > partition->capacity) {
+                size_t const doubled = 2 * partition->capacity / element_size;
+                partitionReserve(partition,
+                                 needed > doubled ? needed : doubled,
+                                 allocator);
+        }
+        partitionAppend(partition, elements, count);
+
+        return current;
+}
+
+static struct Value partitioningByReducerApply(struct Reducer const *reducer,
+                                               void *state, struct Value input,
+                                               struct Value current,
+                                               struct Allocator *allocator)
+{
+        struct PartitioningByReducer const *self =
+            (struct PartitioningByReducer const *)reducer;
+
+        return partitioningByPush(
+            self, state, chainedStepState(&self->super, state), input.type_tag,
+            input.element_size, self->keyFn(input, self->keyData),
+            valueAddress(&input), 1, current, allocator);
+}
+
+/* copies the runs of elements of the same key at once */
+static struct Value
+partitioningByReducerApplyBatch(struct Reducer const *reducer, void *state,
+                                struct ValueSpan span, struct Value current,
+                                struct Allocator *allocator)
+{
+        struct PartitioningByReducer const *self =
+            (struct PartitioningByReducer const *)reducer;
+        void *stepState = chainedStepState(&self->super, state);
+
+        uint8_t const *first = span.first;
+        int64_t key = first < span.last
+                          ? self->keyFn(valueOfSpanElement(span, first),
+                                        self->keyData)
+                          : 0;
+        while (first < span.last && !isReduced(current)) {
+                uint8_t const *last = first + span.element_size;
+                int64_t nextKey = key;
+                while (last < span.last &&
+                       (nextKey = self->keyFn(valueOfSpanElement(span, last),
+                                              self->keyData)) == key) {
+                        last += span.element_size;
+                }
+
+                current = partitioningByPush(
+                    self, state, stepState, span.type_tag, span.element_size,
+                    key, first, (size_t)(last - first) / span.element_size,
+                    current, allocator);
+                first = last;
+                key = nextKey;
+        }
+
+        return current;
+}
+
+static struct Reducer *
+partitioningByTransducerApply(struct Transducer *transducer,
+                              struct Reducer const *step,
+                              struct Allocator *allocator)
+{
+        struct PartitioningByTransducer *self =
+            (struct PartitioningByTransducer *)transducer;
+        struct PartitioningByReducer *result =
+            (struct PartitioningByReducer *)newPartitioningReducer(
+                step, partitioningByReducerApply, sizeof *result, allocator);
+
+        result->super.super.apply_batch = partitioningByReducerApplyBatch;
+        result->keyFn = self->keyFn;
+        result->keyData = self->keyData;
+
+        return &result->super.super;
+}
+
+struct Transducer *
+partitioningByTransducer(int64_t (*keyFn)(struct Value value, void *data),
+                         void *keyData, struct Allocator *allocator)
+{
+        struct PartitioningByTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct PartitioningByTransducer){
+            .keyFn = keyFn,
+            .keyData = keyData,
+            .super = (struct Transducer){
+                .apply = partitioningByTransducerApply,
+            }};
+
+        return &transducer->super;
+}
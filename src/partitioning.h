@@ -0,0 +1,31 @@
+#pragma once
+
+/**
+ * @file
+ * Transducers gathering consecutive elements into chunks.
+ *
+ * Chunks go downstream as array values (see arrayValue) of the type of
+ * their elements, which all share one type tag and element size. A chunk
+ * only stays valid for the duration of the call it is passed to: its
+ * elements live in a buffer of the reduction, reused from one chunk to the
+ * next, or in the span being reduced. Completing the reduction forwards
+ * the last, partial, chunk and releases the buffer.
+ *
+ * The positions of indexed elements are not carried over to their chunk.
+ */
+
+struct Allocator;
+struct Transducer;
+struct Value;
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// gathers elements in chunks of n, n > 0
+struct Transducer *partitioningAllTransducer(size_t n,
+                                             struct Allocator *allocator);
+
+/// gathers runs of elements for which keyFn returns the same key
+struct Transducer *
+partitioningByTransducer(int64_t (*keyFn)(struct Value value, void *data),
+                         void *keyData, struct Allocator *allocator);
@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * @file
+ * Functions on unboxed floats, used by the pipeline descriptions of this
+ * directory.
+ */
+
+#include <stdbool.h>
+
+static inline bool isPositiveFloat(float x)
+{
+        return x > 0.0f;
+}
+
+static inline float negateFloat(float x)
+{
+        return -x;
+}
+
+static inline float addFloats(float a, float b)
+{
+        return a + b;
+}
@@ -0,0 +1,546 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pipelining.h"
+
+#include "allocator.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* size in bytes of the elements of a batch, and of their indices when
+ * they have some */
+#define PIPE_BATCH_SIZE 16384
+
+/* keeps the counters of the producer and of the consumer on cache lines of
+ * their own */
+#define PIPE_CACHE_LINE_SIZE 64
+
+/* times a side yields before going to sleep, batches being usually
+ * published and released in quick succession */
+#define PIPE_SPINS 64
+
+struct PipeliningTransducer
+{
+        struct Transducer super;
+        size_t queueLength;
+};
+
+struct PipeliningReducer
+{
+        struct ChainedReducer super;
+        size_t queueLength;
+};
+
+enum PipeBatchKind {
+        /// count elements of a span, followed by their indices when indexed
+        PB_Elements,
+        /// one array value, whose elements are in the batch unless they did
+        /// not fit, in which case the batch owns a copy of them
+        PB_Array,
+        /// one value without payload
+        PB_Value,
+        /// the producer is done
+        PB_End,
+};
+
+struct PipeBatch
+{
+        enum PipeBatchKind kind;
+        uint32_t type_tag;
+        size_t element_size;
+        size_t count;
+        bool indexed;
+        struct Value value;
+        /// elements of a PB_Array batch, NULL when they are in data
+        struct ArrayPayload array;
+        uint8_t *data;
+};
+
+/*
+ * Queue between a pipelining stage and the thread running its step,
+ * allocated along with its batches and with the state of the step.
+ *
+ * Batches [head, tail) modulo the length of the queue are those the
+ * consumer has yet to reduce. The producer fills batch tail before
+ * publishing it by moving tail.
+ *
+ * A side waiting for the other one spins for a while, then sleeps on
+ * wakeup once it counted itself in sleepers. Moving head or tail wakes it
+ * up when there are sleepers.
+ */
+struct Pipe
+{
+        atomic_size_t head;
+        uint8_t headPadding[PIPE_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+        atomic_size_t tail;
+        uint8_t tailPadding[PIPE_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+        /// set by the consumer once the step ended the reduction
+        atomic_bool halted;
+        atomic_size_t sleepers;
+        pthread_mutex_t mutex;
+        pthread_cond_t wakeup;
+
+        struct PipeliningReducer const *reducer;
+        struct Allocator *allocator;
+        /// bytes allocated for the pipe, its batches and the step state
+        size_t size;
+        pthread_t thread;
+        bool threaded;
+        /// the producer is filling batch tail
+        bool open;
+        /// of the step, owned by the consumer until it is joined
+        struct Value result;
+        void *stepState;
+        struct PipeBatch *batches;
+};
+
+/* part of the state of the reduction, the pipe living outside of it */
+struct PipeliningState
+{
+        struct Pipe *pipe;
+};
+
+static struct PipeBatch *pipeBatch(struct Pipe *pipe, size_t position)
+{
+        return &pipe->batches[position % pipe->reducer->queueLength];
+}
+
+static size_t pipeBatchCapacity(struct PipeBatch const *batch)
+{
+        size_t const size = batch->element_size +
+                            (batch->indexed ? sizeof(size_t) : 0);
+        return PIPE_BATCH_SIZE / size;
+}
+
+static size_t *pipeBatchIndices(struct PipeBatch const *batch)
+{
+        return (size_t *)(batch->data + PIPE_BATCH_SIZE -
+                          pipeBatchCapacity(batch) * sizeof(size_t));
+}
+
+static bool pipeHasBatch(struct Pipe *pipe, size_t head)
+{
+        return head != atomic_load_explicit(&pipe->tail, memory_order_acquire);
+}
+
+static bool pipeHasRoom(struct Pipe *pipe, size_t tail)
+{
+        return tail - atomic_load_explicit(&pipe->head,
+                                           memory_order_acquire) !=
+               pipe->reducer->queueLength;
+}
+
+/* until ready holds for position */
+static void pipeWait(struct Pipe *pipe,
+                     bool (*ready)(struct Pipe *, size_t), size_t position)
+{
+        for (int spins = 0; spins < PIPE_SPINS; spins++) {
+                if (ready(pipe, position)) {
+                        return;
+                }
+                sched_yield();
+        }
+
+        pthread_mutex_lock(&pipe->mutex);
+        atomic_fetch_add(&pipe->sleepers, 1);
+        /* pairs with the fence of pipeWake, so that either this side sees
+         * the move or the other one sees the sleeper */
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!ready(pipe, position)) {
+                pthread_cond_wait(&pipe->wakeup, &pipe->mutex);
+        }
+        atomic_fetch_sub(&pipe->sleepers, 1);
+        pthread_mutex_unlock(&pipe->mutex);
+}
+
+/* once head or tail moved */
+static void pipeWake(struct Pipe *pipe)
+{
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&pipe->sleepers, memory_order_relaxed)) {
+                pthread_mutex_lock(&pipe->mutex);
+                pthread_cond_broadcast(&pipe->wakeup);
+                pthread_mutex_unlock(&pipe->mutex);
+        }
+}
+
+/* reduces batch with the step, on the consumer side */
+static void pipeConsume(struct Pipe *pipe, struct PipeBatch *batch)
+{
+        struct Reducer const *step = pipe->reducer->super.step;
+        struct Allocator *allocator = pipe->allocator;
+        struct Value result = pipe->result;
+
+        switch (batch->kind) {
+        case PB_Elements: {
+                struct ValueSpan const span = {
+                    .type_tag = batch->type_tag,
+                    .element_size = batch->element_size,
+                    .first = batch->data,
+                    .last = batch->data + batch->count * batch->element_size,
+                    .indices = batch->indexed ? pipeBatchIndices(batch) : NULL,
+                };
+                result = reducer_apply_batch(step, pipe->stepState, span,
+                                             result, allocator);
+                break;
+        }
+        case PB_Array: {
+                struct Value value = batch->value;
+                struct ArrayPayload array = batch->array;
+                bool const owned = array.elements != NULL;
+                if (!owned) {
+                        array.elements = batch->data;
+                }
+                value.address = &array;
+                result = reducer_apply(step, pipe->stepState, value, result,
+                                       allocator);
+                result = detachValue(result, &array, sizeof array, allocator);
+                if (owned) {
+                        result = detachValue(result, array.elements,
+                                             array.count * value.element_size,
+                                             allocator);
+                        allocator_free(allocator, (void *)array.elements);
+                }
+                break;
+        }
+        case PB_Value:
+                result = reducer_apply(step, pipe->stepState, batch->value,
+                                       result, allocator);
+                break;
+        case PB_End:
+                break;
+        }
+
+        /* the producer reuses the batch once released */
+        pipe->result = detachValue(result, batch->data, PIPE_BATCH_SIZE,
+                                   allocator);
+        if (isReduced(result)) {
+                atomic_store_explicit(&pipe->halted, true,
+                                      memory_order_release);
+        }
+}
+
+/* once the step ended the reduction, batches are only released, so that
+ * the producer never waits for good */
+static void *pipeRun(void *data)
+{
+        struct Pipe *pipe = data;
+        size_t head = atomic_load_explicit(&pipe->head, memory_order_relaxed);
+
+        for (;;) {
+                pipeWait(pipe, pipeHasBatch, head);
+
+                struct PipeBatch *batch = pipeBatch(pipe, head);
+                bool const end = batch->kind == PB_End;
+                if (isReduced(pipe->result)) {
+                        if (batch->kind == PB_Array && batch->array.elements) {
+                                allocator_free(pipe->allocator,
+                                               (void *)batch->array.elements);
+                        }
+                } else {
+                        pipeConsume(pipe, batch);
+                }
+                atomic_store_explicit(&pipe->head, ++head,
+                                      memory_order_release);
+                pipeWake(pipe);
+                if (end) {
+                        return NULL;
+                }
+        }
+}
+
+static struct Pipe *pipeStart(struct PipeliningReducer const *self,
+                              struct PipeliningState *pipelining,
+                              struct Value current,
+                              struct Allocator *allocator)
+{
+        if (pipelining->pipe) {
+                return pipelining->pipe;
+        }
+
+        size_t const queueLength = self->queueLength;
+        size_t const batchesOffset = reducer_state_align(sizeof(struct Pipe));
+        size_t const dataOffset = reducer_state_align(
+            batchesOffset + queueLength * sizeof(struct PipeBatch));
+        size_t const stepStateOffset =
+            dataOffset + queueLength * PIPE_BATCH_SIZE;
+        size_t const size = stepStateOffset + self->super.step->state_size;
+        uint8_t *memory = allocator_alloc(allocator, size);
+
+        struct Pipe *pipe = (struct Pipe *)memory;
+        *pipe = (struct Pipe){
+            .reducer = self,
+            .allocator = allocator,
+            .size = size,
+            .result = current,
+            .stepState = memory + stepStateOffset,
+            .batches = (struct PipeBatch *)(memory + batchesOffset),
+        };
+        atomic_init(&pipe->head, 0);
+        atomic_init(&pipe->tail, 0);
+        atomic_init(&pipe->halted, false);
+        atomic_init(&pipe->sleepers, 0);
+        pthread_mutex_init(&pipe->mutex, NULL);
+        pthread_cond_init(&pipe->wakeup, NULL);
+        for (size_t i = 0; i < queueLength; i++) {
+                pipe->batches[i] = (struct PipeBatch){
+                    .data = memory + dataOffset + i * PIPE_BATCH_SIZE,
+                };
+        }
+        reducer_init_state(self->super.step, pipe->stepState, allocator);
+
+        /* without a thread, batches are reduced as soon as published */
+        pipe->threaded =
+            0 == pthread_create(&pipe->thread, NULL, pipeRun, pipe);
+        pipelining->pipe = pipe;
+
+        return pipe;
+}
+
+/* batch tail, once the consumer released it */
+static struct PipeBatch *pipeWaitForBatch(struct Pipe *pipe)
+{
+        size_t const tail =
+            atomic_load_explicit(&pipe->tail, memory_order_relaxed);
+        pipeWait(pipe, pipeHasRoom, tail);
+
+        return pipeBatch(pipe, tail);
+}
+
+static void pipePublish(struct Pipe *pipe)
+{
+        size_t const tail =
+            atomic_load_explicit(&pipe->tail, memory_order_relaxed);
+
+        pipe->open = false;
+        if (!pipe->threaded) {
+                pipeConsume(pipe, pipeBatch(pipe, tail));
+                return;
+        }
+        atomic_store_explicit(&pipe->tail, tail + 1, memory_order_release);
+        pipeWake(pipe);
+}
+
+/* batch tail, ready for a new batch of kind */
+static struct PipeBatch *pipeOpen(struct Pipe *pipe, enum PipeBatchKind kind)
+{
+        if (pipe->open) {
+                pipePublish(pipe);
+        }
+
+        struct PipeBatch *batch = pipeWaitForBatch(pipe);
+        batch->kind = kind;
+        batch->count = 0;
+        batch->indexed = false;
+        pipe->open = kind == PB_Elements;
+
+        return batch;
+}
+
+/* copies elements into batches of their type, until downstream ends the
+ * reduction */
+static void pipeAppend(struct Pipe *pipe, uint32_t type_tag,
+                       size_t element_size, uint8_t const *elements,
+                       size_t const *indices, size_t count)
+{
+        while (count > 0 &&
+               !atomic_load_explicit(&pipe->halted, memory_order_acquire)) {
+                struct PipeBatch *batch =
+                    pipe->open ? pipeBatch(pipe, atomic_load_explicit(
+                                                     &pipe->tail,
+                                                     memory_order_relaxed))
+                               : NULL;
+                if (!batch || batch->type_tag != type_tag ||
+                    batch->element_size != element_size ||
+                    batch->indexed != (indices != NULL) ||
+                    batch->count == pipeBatchCapacity(batch)) {
+                        batch = pipeOpen(pipe, PB_Elements);
+                        batch->type_tag = type_tag;
+                        batch->element_size = element_size;
+                        batch->indexed = indices != NULL;
+                }
+
+                size_t const room = pipeBatchCapacity(batch) - batch->count;
+                size_t const n = count < room ? count : room;
+                memcpy(batch->data + batch->count * element_size, elements,
+                       n * element_size);
+                if (indices) {
+                        memcpy(pipeBatchIndices(batch) + batch->count,
+                               indices, n * sizeof *indices);
+                        indices += n;
+                }
+                batch->count += n;
+                elements += n * element_size;
+                count -= n;
+        }
+}
+
+/* array values go in a batch of their own, with a copy of their elements */
+static void pipeAppendArray(struct Pipe *pipe, struct Value value)
+{
+        struct PipeBatch *batch = pipeOpen(pipe, PB_Array);
+        size_t const count = arrayCount(value);
+        size_t const size = count * value.element_size;
+
+        batch->value = value;
+        batch->value.address = NULL;
+        batch->array.count = count;
+        if (size <= PIPE_BATCH_SIZE) {
+                memcpy(batch->data, arrayElements(value), size);
+                batch->array.elements = NULL;
+        } else {
+                void *copy = allocator_alloc(pipe->allocator, size);
+                memcpy(copy, arrayElements(value), size);
+                batch->array.elements = copy;
+        }
+        pipePublish(pipe);
+}
+
+static struct Value pipeliningReducerApply(struct Reducer const *reducer,
+                                           void *state, struct Value input,
+                                           struct Value current,
+                                           struct Allocator *allocator)
+{
+        struct PipeliningReducer const *self =
+            (struct PipeliningReducer const *)reducer;
+        struct Pipe *pipe = pipeStart(self, state, current, allocator);
+
+        if (atomic_load_explicit(&pipe->halted, memory_order_acquire)) {
+                return reducedValue(current);
+        }
+
+        if (isArrayValue(input)) {
+                pipeAppendArray(pipe, input);
+        } else if (input.element_size == 0) {
+                struct PipeBatch *batch = pipeOpen(pipe, PB_Value);
+                batch->value = input;
+                pipePublish(pipe);
+        } else {
+                pipeAppend(pipe, input.type_tag, input.element_size,
+                           valueAddress(&input),
+                           isIndexed(input) ? &input.index : NULL, 1);
+        }
+
+        return current;
+}
+
+static struct Value pipeliningReducerApplyBatch(struct Reducer const *reducer,
+                                                void *state,
+                                                struct ValueSpan span,
+                                                struct Value current,
+                                                struct Allocator *allocator)
+{
+        struct PipeliningReducer const *self =
+            (struct PipeliningReducer const *)reducer;
+        struct Pipe *pipe = pipeStart(self, state, current, allocator);
+
+        if (atomic_load_explicit(&pipe->halted, memory_order_acquire)) {
+                return reducedValue(current);
+        }
+        if (span.element_size == 0) {
+                return current;
+        }
+
+        pipeAppend(pipe, span.type_tag, span.element_size, span.first,
+                   span.indices,
+                   (size_t)(span.last - span.first) / span.element_size);
+
+        return current;
+}
+
+/* waits for the consumer to be done with the queue, then completes the
+ * step on the calling thread */
+static struct Value pipeliningReducerComplete(struct Reducer const *reducer,
+                                              void *state, struct Value result,
+                                              struct Allocator *allocator)
+{
+        struct PipeliningReducer const *self =
+            (struct PipeliningReducer const *)reducer;
+        struct PipeliningState *pipelining = state;
+        struct Pipe *pipe = pipelining->pipe;
+
+        if (!pipe) {
+                pipe = pipeStart(self, pipelining, result, allocator);
+        }
+        pipeOpen(pipe, PB_End);
+        pipePublish(pipe);
+        if (pipe->threaded) {
+                pthread_join(pipe->thread, NULL);
+        }
+
+        result = reducer_complete(self->super.step, pipe->stepState,
+                                  unreducedValue(pipe->result), allocator);
+        result = detachValue(result, pipe, pipe->size, allocator);
+        pthread_cond_destroy(&pipe->wakeup);
+        pthread_mutex_destroy(&pipe->mutex);
+        allocator_free(allocator, pipe);
+        pipelining->pipe = NULL;
+
+        return result;
+}
+
+static struct Reducer *
+pipeliningTransducerApply(struct Transducer *transducer,
+                          struct Reducer const *step,
+                          struct Allocator *allocator)
+{
+        struct PipeliningTransducer *self =
+            (struct PipeliningTransducer *)transducer;
+        struct PipeliningReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        /* the state of the step lives in the pipe, where the consumer
+         * reaches it */
+        result->super = chainedReducerMake(step, pipeliningReducerApply,
+                                           sizeof(struct PipeliningState));
+        result->super.super.apply_batch = pipeliningReducerApplyBatch;
+        result->super.super.complete = pipeliningReducerComplete;
+        result->super.super.state_size = sizeof(struct PipeliningState);
+        result->super.super.init_state = NULL;
+        result->queueLength = self->queueLength;
+
+        return &result->super.super;
+}
+
+struct Transducer *pipeliningTransducer(size_t queueLength,
+                                        struct Allocator *allocator)
+{
+        struct PipeliningTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct PipeliningTransducer){
+            .queueLength = queueLength,
+            .super = (struct Transducer){
+                .apply = pipeliningTransducerApply,
+            }};
+
+        return &transducer->super;
+}
+
+struct Transducer *pipelinedTransducer(struct Transducer **segments,
+                                       size_t segmentCount,
+                                       size_t queueLength,
+                                       struct Allocator *allocator)
+{
+        size_t const count = segmentCount ? 2 * segmentCount - 1 : 0;
+        struct Transducer **transducers =
+            allocator_alloc(allocator, (count ? count : 1) * sizeof(void *));
+
+        for (size_t i = 0; i < segmentCount; i++) {
+                if (i > 0) {
+                        transducers[2 * i - 1] =
+                            pipeliningTransducer(queueLength, allocator);
+                }
+                transducers[2 * i] = segments[i];
+        }
+
+        return composingTransducer(transducers, count, allocator);
+}
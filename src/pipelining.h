@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+ * @file
+ * Pipelining of the stages of a reduction over several threads.
+ *
+ * A pipelining stage runs the stages downstream of it on a thread of its
+ * own. The elements it receives are copied into batches which go through
+ * a bounded lock-free single-producer single-consumer queue, so that the
+ * stages upstream of it work on the next elements while downstream works
+ * on the previous ones. Upstream waits when the queue is full.
+ *
+ * Unlike parallelReduceStream, this needs no combine: each segment sees
+ * all elements, in order.
+ *
+ * The thread starts with the first element and completing the reduction
+ * waits for it to be done with the elements still queued. When
+ * downstream ends the reduction, upstream ends it with the next element.
+ *
+ * The allocator of the reduction must be usable from several threads at
+ * once. Array values are copied along with their elements.
+ */
+
+struct Allocator;
+struct Transducer;
+
+#include <stddef.h>
+
+/// hands the elements to the stages downstream of it on another thread,
+/// through a queue of queueLength batches, queueLength > 0
+struct Transducer *pipeliningTransducer(size_t queueLength,
+                                        struct Allocator *allocator);
+
+/// composes segments, each of them running on its own thread, the first
+/// one on the calling thread, with queues of queueLength batches between
+/// them
+struct Transducer *pipelinedTransducer(struct Transducer **segments,
+                                       size_t segmentCount,
+                                       size_t queueLength,
+                                       struct Allocator *allocator);
@@ -0,0 +1,369 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profiling.h"
+
+#include "allocator.h"
+#include "allocator_type.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <stdatomic.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+
+static uint64_t profilingTicks(void)
+{
+        return __rdtsc();
+}
+#else
+#include <time.h>
+
+static uint64_t profilingTicks(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* summed over all the reductions of a stage, which may run concurrently */
+struct ProfilingCounters
+{
+        _Atomic(uint64_t) elements_in;
+        _Atomic(uint64_t) elements_out;
+        _Atomic(uint64_t) cycles;
+        _Atomic(uint64_t) allocs;
+};
+
+struct ProfilingTransducer
+{
+        struct Transducer super;
+        struct Transducer *inner;
+        char const *name;
+        struct ProfilingCounters counters;
+        /* the profiled stages of a profiled composition */
+        struct Transducer **stages;
+        size_t stagesCount;
+};
+
+/*
+ * The reducer of a profiled stage is the reducer of the wrapped stage
+ * between two probes: an entry probe, which counts the elements coming in
+ * and starts the clock, and an exit probe, which counts the elements going
+ * out and stops the clock while downstream stages run.
+ *
+ * Time only ever adds up once the stage is done with an element, so the
+ * counters may wrap around in between.
+ */
+struct ProbeReducer
+{
+        struct ChainedReducer super;
+        struct ProfilingTransducer *owner;
+};
+
+/* handed to the wrapped stage, counts its allocations */
+struct ProbeAllocator
+{
+        struct Allocator super;
+        struct Allocator *parent;
+        struct ProfilingTransducer *owner;
+};
+
+struct EntryProbeState
+{
+        struct ProbeAllocator allocator;
+};
+
+static void addCount(_Atomic(uint64_t) *counter, uint64_t amount)
+{
+        atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+}
+
+static void *probeAlloc(struct Allocator *allocator, size_t size)
+{
+        struct ProbeAllocator *self = (struct ProbeAllocator *)allocator;
+        addCount(&self->owner->counters.allocs, 1);
+        return allocator_alloc(self->parent, size);
+}
+
+static void probeFree(struct Allocator *allocator, void *ptr)
+{
+        struct ProbeAllocator *self = (struct ProbeAllocator *)allocator;
+        allocator_free(self->parent, ptr);
+}
+
+static size_t spanCount(struct ValueSpan span)
+{
+        return span.element_size
+                   ? (size_t)(span.last - span.first) / span.element_size
+                   : 0;
+}
+
+static struct Allocator *stageAllocator(struct EntryProbeState *probe,
+                                        struct Allocator *allocator)
+{
+        probe->allocator.parent = allocator;
+        return &probe->allocator.super;
+}
+
+static struct Allocator *downstreamAllocator(struct ProbeReducer const *self,
+                                             struct Allocator *allocator)
+{
+        struct ProbeAllocator const *probe =
+            (struct ProbeAllocator const *)allocator;
+        if (allocator->alloc == probeAlloc && probe->owner == self->owner) {
+                return probe->parent;
+        }
+        return allocator;
+}
+
+static void entryProbeInitState(struct Reducer const *reducer, void *state,
+                                struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct EntryProbeState *probe = state;
+
+        chainedReducerInitState(reducer, state, allocator);
+        probe->allocator = (struct ProbeAllocator){
+            .super = {.alloc = probeAlloc, .free = probeFree},
+            .owner = self->owner,
+        };
+}
+
+static struct Value entryProbeApply(struct Reducer const *reducer, void *state,
+                                    struct Value input, struct Value current,
+                                    struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct EntryProbeState *probe = state;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        addCount(&counters->elements_in, 1);
+        uint64_t const start = profilingTicks();
+        struct Value result = reducer_apply(
+            self->super.step, chainedStepState(&self->super, state), input,
+            current, stageAllocator(probe, allocator));
+        addCount(&counters->cycles, profilingTicks() - start);
+
+        return result;
+}
+
+static struct Value entryProbeApplyBatch(struct Reducer const *reducer,
+                                         void *state, struct ValueSpan span,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct EntryProbeState *probe = state;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        /* a halting stage may not consume all of the span */
+        if (reducer->may_halt) {
+                for (uint8_t const *element = span.first;
+                     element < span.last && !isReduced(current);
+                     element += span.element_size) {
+                        current = entryProbeApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        addCount(&counters->elements_in, spanCount(span));
+        uint64_t const start = profilingTicks();
+        struct Value result = reducer_apply_batch(
+            self->super.step, chainedStepState(&self->super, state), span,
+            current, stageAllocator(probe, allocator));
+        addCount(&counters->cycles, profilingTicks() - start);
+
+        return result;
+}
+
+/* stages may flush what they hold downstream when completing */
+static struct Value entryProbeComplete(struct Reducer const *reducer,
+                                       void *state, struct Value result,
+                                       struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct EntryProbeState *probe = state;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        uint64_t const start = profilingTicks();
+        result = reducer_complete(self->super.step,
+                                  chainedStepState(&self->super, state), result,
+                                  stageAllocator(probe, allocator));
+        addCount(&counters->cycles, profilingTicks() - start);
+
+        return result;
+}
+
+static struct Value exitProbeApply(struct Reducer const *reducer, void *state,
+                                   struct Value input, struct Value current,
+                                   struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        addCount(&counters->elements_out, 1);
+        uint64_t const start = profilingTicks();
+        struct Value result = reducer_apply(
+            self->super.step, chainedStepState(&self->super, state), input,
+            current, downstreamAllocator(self, allocator));
+        addCount(&counters->cycles, start - profilingTicks());
+
+        return result;
+}
+
+static struct Value exitProbeApplyBatch(struct Reducer const *reducer,
+                                        void *state, struct ValueSpan span,
+                                        struct Value current,
+                                        struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        addCount(&counters->elements_out, spanCount(span));
+        uint64_t const start = profilingTicks();
+        struct Value result = reducer_apply_batch(
+            self->super.step, chainedStepState(&self->super, state), span,
+            current, downstreamAllocator(self, allocator));
+        addCount(&counters->cycles, start - profilingTicks());
+
+        return result;
+}
+
+static struct Value exitProbeComplete(struct Reducer const *reducer,
+                                      void *state, struct Value result,
+                                      struct Allocator *allocator)
+{
+        struct ProbeReducer const *self = (struct ProbeReducer const *)reducer;
+        struct ProfilingCounters *counters = &self->owner->counters;
+
+        uint64_t const start = profilingTicks();
+        result = reducer_complete(self->super.step,
+                                  chainedStepState(&self->super, state), result,
+                                  downstreamAllocator(self, allocator));
+        addCount(&counters->cycles, start - profilingTicks());
+
+        return result;
+}
+
+static struct Reducer *
+profilingTransducerApply(struct Transducer *transducer,
+                         struct Reducer const *step,
+                         struct Allocator *allocator)
+{
+        struct ProfilingTransducer *self =
+            (struct ProfilingTransducer *)transducer;
+
+        struct ProbeReducer *exit = allocator_alloc(allocator, sizeof *exit);
+        exit->super = chainedReducerMake(step, exitProbeApply, 0);
+        exit->super.super.apply_batch = exitProbeApplyBatch;
+        exit->super.super.complete = exitProbeComplete;
+        chainedReducerCombineThroughStep(&exit->super);
+        exit->owner = self;
+
+        struct ProbeReducer *entry = allocator_alloc(allocator, sizeof *entry);
+        entry->super = chainedReducerMake(
+            transducer_apply(self->inner, &exit->super.super, allocator),
+            entryProbeApply, sizeof(struct EntryProbeState));
+        entry->super.super.apply_batch = entryProbeApplyBatch;
+        entry->super.super.complete = entryProbeComplete;
+        entry->super.super.init_state = entryProbeInitState;
+        chainedReducerCombineThroughStep(&entry->super);
+        entry->owner = self;
+
+        return &entry->super.super;
+}
+
+struct Transducer *profilingTransducer(struct Transducer *inner,
+                                       char const *name,
+                                       struct Allocator *allocator)
+{
+        struct ProfilingTransducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct ProfilingTransducer){
+            .super = {.apply = profilingTransducerApply},
+            .inner = inner,
+            .name = name,
+        };
+        atomic_init(&result->counters.elements_in, 0);
+        atomic_init(&result->counters.elements_out, 0);
+        atomic_init(&result->counters.cycles, 0);
+        atomic_init(&result->counters.allocs, 0);
+
+        return &result->super;
+}
+
+struct Transducer *
+profiledComposingTransducer(struct Transducer **transducers,
+                            size_t transducerCount, char const *const *names,
+                            struct Allocator *allocator)
+{
+        struct Transducer **stages =
+            allocator_alloc(allocator, transducerCount * sizeof *stages);
+        for (size_t i = 0; i < transducerCount; i++) {
+                stages[i] = profilingTransducer(
+                    transducers[i], names ? names[i] : NULL, allocator);
+        }
+
+        struct ProfilingTransducer *result =
+            (struct ProfilingTransducer *)profilingTransducer(
+                composingTransducer(stages, transducerCount, allocator),
+                "total", allocator);
+        result->stages = stages;
+        result->stagesCount = transducerCount;
+
+        return &result->super;
+}
+
+struct StageProfile
+profilingTransducerProfile(struct Transducer const *profiling)
+{
+        struct ProfilingTransducer *self =
+            (struct ProfilingTransducer *)profiling;
+
+        return (struct StageProfile){
+            .name = self->name,
+            .elements_in = atomic_load(&self->counters.elements_in),
+            .elements_out = atomic_load(&self->counters.elements_out),
+            .cycles = atomic_load(&self->counters.cycles),
+            .allocs = atomic_load(&self->counters.allocs),
+        };
+}
+
+static void reportStage(FILE *out, struct StageProfile profile, size_t index)
+{
+        char indexName[32];
+        char const *name = profile.name;
+        if (!name) {
+                snprintf(indexName, sizeof indexName, "stage %zu", index);
+                name = indexName;
+        }
+
+        double const in = (double)profile.elements_in;
+        fprintf(out, "%-24s %12llu %12llu %8.3f %16llu %12.1f %10llu\n", name,
+                (unsigned long long)profile.elements_in,
+                (unsigned long long)profile.elements_out,
+                in > 0 ? (double)profile.elements_out / in : 0.0,
+                (unsigned long long)profile.cycles,
+                in > 0 ? (double)profile.cycles / in : 0.0,
+                (unsigned long long)profile.allocs);
+}
+
+void profilingReport(FILE *out, struct Transducer const *profiling)
+{
+        struct ProfilingTransducer const *self =
+            (struct ProfilingTransducer const *)profiling;
+
+        fprintf(out, "%-24s %12s %12s %8s %16s %12s %10s\n", "stage", "in",
+                "out", "pass", "cycles", "cycles/in", "allocs");
+        reportStage(out, profilingTransducerProfile(profiling), 0);
+        for (size_t i = 0; i < self->stagesCount; i++) {
+                reportStage(out, profilingTransducerProfile(self->stages[i]),
+                            i + 1);
+        }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/**
+ * @file
+ * Per-stage profiling of transducers.
+ *
+ * A profiling transducer wraps another one and counts, over all the
+ * reductions of the reducers obtained from it, the elements going into and
+ * out of the wrapped stage, the time spent in it (its downstream excluded)
+ * and the allocations it made. Each transducer keeps a single set of
+ * counters, so reductions add up without holding memory of their own. Time
+ * is counted in TSC cycles on x86 and in nanoseconds elsewhere.
+ */
+
+struct Allocator;
+struct Transducer;
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct StageProfile
+{
+        /// name of the stage, NULL when it was not given one
+        char const *name;
+        uint64_t elements_in;
+        uint64_t elements_out;
+        uint64_t cycles;
+        uint64_t allocs;
+};
+
+/// wraps inner, name may be NULL
+struct Transducer *profilingTransducer(struct Transducer *inner,
+                                       char const *name,
+                                       struct Allocator *allocator);
+
+/// composes transducers like composingTransducer, wrapping each of them and
+/// their composition (as "total") in a profiling transducer. names may be
+/// NULL
+struct Transducer *
+profiledComposingTransducer(struct Transducer **transducers,
+                            size_t transducerCount, char const *const *names,
+                            struct Allocator *allocator);
+
+/// counters of a profiling transducer, summed over all its reducers. Only
+/// meaningful once these reducers are no longer running
+struct StageProfile
+profilingTransducerProfile(struct Transducer const *profiling);
+
+/// prints the counters of a profiling transducer, followed by those of its
+/// stages when it comes from profiledComposingTransducer
+void profilingReport(FILE *out, struct Transducer const *profiling);
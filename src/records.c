@@ -0,0 +1,371 @@
+#include "records.h"
+
+#include "allocator.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* number of records projected at once, bounding the state */
+#define PROJECTION_CHUNK_SIZE 1024
+
+/* field of the records copied into the projected elements */
+struct ProjectedColumn
+{
+        size_t recordOffset;
+        size_t elementOffset;
+        size_t size;
+};
+
+/* predicate reading its field straight from the records */
+struct PushedPredicate
+{
+        uint32_t type_tag;
+        size_t offset;
+        enum RecordComparison comparison;
+        double operand;
+};
+
+struct Projection
+{
+        size_t recordSize;
+        uint32_t elementTypeTag;
+        size_t elementSize;
+        struct ProjectedColumn *columns;
+        size_t columnCount;
+        struct PushedPredicate *predicates;
+        size_t predicateCount;
+};
+
+struct ProjectingTransducer
+{
+        struct Transducer super;
+        struct Projection projection;
+};
+
+struct ProjectingReducer
+{
+        struct ChainedReducer super;
+        struct Projection projection;
+};
+
+/*
+ * state of the stage, holding no pointer into itself:
+ * - the projected elements of a chunk, of elementSize bytes each
+ * - the selection vector, positions in the chunk of the selected records
+ * - the indices of the selected records, when the records are indexed
+ */
+static size_t projectionStateSize(struct Projection const *projection)
+{
+        return reducer_state_align(PROJECTION_CHUNK_SIZE *
+                                   projection->elementSize) +
+               2 * PROJECTION_CHUNK_SIZE * sizeof(size_t);
+}
+
+static size_t *projectionSelection(struct Projection const *projection,
+                                   void *state)
+{
+        return (size_t *)((uint8_t *)state +
+                          reducer_state_align(PROJECTION_CHUNK_SIZE *
+                                              projection->elementSize));
+}
+
+static double fieldAsDouble(uint32_t type_tag, uint8_t const *field)
+{
+        switch (type_tag) {
+        case TTAG_FLOAT: {
+                float x;
+                memcpy(&x, field, sizeof x);
+                return x;
+        }
+        case TTAG_DOUBLE: {
+                double x;
+                memcpy(&x, field, sizeof x);
+                return x;
+        }
+        case TTAG_INT64: {
+                int64_t x;
+                memcpy(&x, field, sizeof x);
+                return (double)x;
+        }
+        case TTAG_INT32: {
+                int32_t x;
+                memcpy(&x, field, sizeof x);
+                return x;
+        }
+        case TTAG_INT16: {
+                int16_t x;
+                memcpy(&x, field, sizeof x);
+                return x;
+        }
+        case TTAG_UINT8:
+                return *field;
+        }
+        return 0.0;
+}
+
+static bool compare(enum RecordComparison comparison, double x, double operand)
+{
+        switch (comparison) {
+        case RC_Less:
+                return x < operand;
+        case RC_LessOrEqual:
+                return x <= operand;
+        case RC_Equal:
+                return x == operand;
+        case RC_NotEqual:
+                return x != operand;
+        case RC_GreaterOrEqual:
+                return x >= operand;
+        case RC_Greater:
+                return x > operand;
+        }
+        return false;
+}
+
+/* narrows the selection down to the records satisfying every predicate,
+ * one predicate at a time, and returns the number left */
+static size_t selectRecords(struct Projection const *projection,
+                            uint8_t const *records, size_t count,
+                            size_t *selection)
+{
+        for (size_t i = 0; i < count; i++) {
+                selection[i] = i;
+        }
+        for (size_t p = 0; p < projection->predicateCount && count > 0; p++) {
+                struct PushedPredicate const predicate =
+                    projection->predicates[p];
+                uint8_t const *fields = records + predicate.offset;
+                size_t selected = 0;
+                for (size_t i = 0; i < count; i++) {
+                        double const x = fieldAsDouble(
+                            predicate.type_tag,
+                            fields + selection[i] * projection->recordSize);
+                        selection[selected] = selection[i];
+                        selected += compare(predicate.comparison, x,
+                                            predicate.operand);
+                }
+                count = selected;
+        }
+        return count;
+}
+
+/* copies a field of size bytes from the selected records, or all of them
+ * without a selection, every stride bytes of elements */
+static inline void gatherField(uint8_t *elements, size_t stride,
+                               uint8_t const *fields, size_t recordSize,
+                               size_t const *selection, size_t count,
+                               size_t size)
+{
+        for (size_t i = 0; i < count; i++) {
+                size_t const record = selection ? selection[i] : i;
+                memcpy(elements + i * stride, fields + record * recordSize,
+                       size);
+        }
+}
+
+/* gathers a column, with the size of the common field types constant so
+ * that each copy is a single load and store */
+static void gatherColumn(struct Projection const *projection,
+                         struct ProjectedColumn column, uint8_t *elements,
+                         uint8_t const *records, size_t const *selection,
+                         size_t count)
+{
+        elements += column.elementOffset;
+        records += column.recordOffset;
+        size_t const stride = projection->elementSize;
+        size_t const recordSize = projection->recordSize;
+        switch (column.size) {
+        case 1:
+                gatherField(elements, stride, records, recordSize, selection,
+                            count, 1);
+                break;
+        case 2:
+                gatherField(elements, stride, records, recordSize, selection,
+                            count, 2);
+                break;
+        case 4:
+                gatherField(elements, stride, records, recordSize, selection,
+                            count, 4);
+                break;
+        case 8:
+                gatherField(elements, stride, records, recordSize, selection,
+                            count, 8);
+                break;
+        default:
+                gatherField(elements, stride, records, recordSize, selection,
+                            count, column.size);
+                break;
+        }
+}
+
+static struct Value projectingReducerApplyBatch(struct Reducer const *reducer,
+                                                void *state,
+                                                struct ValueSpan span,
+                                                struct Value current,
+                                                struct Allocator *allocator)
+{
+        struct ProjectingReducer const *self =
+            (struct ProjectingReducer const *)reducer;
+        struct Projection const *projection = &self->projection;
+        void *stepState = chainedStepState(&self->super, state);
+
+        if (span.type_tag != TTAG_RECORD ||
+            span.element_size != projection->recordSize) {
+                return current;
+        }
+
+        uint8_t *elements = state;
+        size_t *selection = projectionSelection(projection, state);
+        size_t *indices = selection + PROJECTION_CHUNK_SIZE;
+        size_t const total =
+            (size_t)(span.last - span.first) / projection->recordSize;
+        for (size_t start = 0; start < total && !isReduced(current);
+             start += PROJECTION_CHUNK_SIZE) {
+                uint8_t const *records =
+                    span.first + start * projection->recordSize;
+                size_t count = total - start < PROJECTION_CHUNK_SIZE
+                                   ? total - start
+                                   : PROJECTION_CHUNK_SIZE;
+                size_t const *selected = NULL;
+                if (projection->predicateCount > 0) {
+                        count = selectRecords(projection, records, count,
+                                              selection);
+                        selected = selection;
+                }
+                if (count == 0) {
+                        continue;
+                }
+
+                for (size_t c = 0; c < projection->columnCount; c++) {
+                        gatherColumn(projection, projection->columns[c],
+                                     elements, records, selected, count);
+                }
+                if (span.indices) {
+                        for (size_t i = 0; i < count; i++) {
+                                indices[i] = span.indices[
+                                    start + (selected ? selected[i] : i)];
+                        }
+                }
+
+                struct ValueSpan const projected = {
+                    .type_tag = projection->elementTypeTag,
+                    .element_size = projection->elementSize,
+                    .first = elements,
+                    .last = elements + count * projection->elementSize,
+                    .indices = span.indices ? indices : NULL,
+                };
+                current = reducer_apply_batch(self->super.step, stepState,
+                                              projected, current, allocator);
+        }
+
+        return current;
+}
+
+/* a record is projected as a batch of one */
+static struct Value projectingReducerApply(struct Reducer const *reducer,
+                                           void *state, struct Value input,
+                                           struct Value current,
+                                           struct Allocator *allocator)
+{
+        if (isArrayValue(input)) {
+                return projectingReducerApplyBatch(
+                    reducer, state, spanOfArrayValue(input), current,
+                    allocator);
+        }
+
+        uint8_t const *record = valueAddress(&input);
+        struct ValueSpan const span = {
+            .type_tag = input.type_tag,
+            .element_size = input.element_size,
+            .first = record,
+            .last = record + input.element_size,
+            .indices = isIndexed(input) ? &input.index : NULL,
+        };
+        return projectingReducerApplyBatch(reducer, state, span, current,
+                                           allocator);
+}
+
+static struct Reducer *
+projectingTransducerApply(struct Transducer *transducer,
+                          struct Reducer const *step,
+                          struct Allocator *allocator)
+{
+        struct ProjectingTransducer *self =
+            (struct ProjectingTransducer *)transducer;
+        struct ProjectingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->super =
+            chainedReducerMake(step, projectingReducerApply,
+                               projectionStateSize(&self->projection));
+        result->super.super.apply_batch = projectingReducerApplyBatch;
+        result->projection = self->projection;
+
+        return &result->super.super;
+}
+
+struct Transducer *
+projectingTransducer(struct RecordSchema const *schema, size_t const *fields,
+                     size_t field_count,
+                     struct RecordPredicate const *predicates,
+                     size_t predicate_count, struct Allocator *allocator)
+{
+        struct ProjectingTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+        struct ProjectedColumn *columns =
+            allocator_alloc(allocator, field_count * sizeof *columns);
+        struct PushedPredicate *pushed = allocator_alloc(
+            allocator, (predicate_count ? predicate_count : 1) *
+                           sizeof *pushed);
+
+        size_t elementSize = 0;
+        size_t elementAlignment = 1;
+        for (size_t c = 0; c < field_count; c++) {
+                struct RecordField const field = schema->fields[fields[c]];
+                size_t const size = typeTagSize(field.type_tag);
+                columns[c] = (struct ProjectedColumn){
+                    .recordOffset = field.offset,
+                    .elementOffset = tupleFieldOffset(elementSize, size),
+                    .size = size,
+                };
+                elementSize = columns[c].elementOffset + size;
+                if (tupleFieldAlignment(size) > elementAlignment) {
+                        elementAlignment = tupleFieldAlignment(size);
+                }
+        }
+        elementSize = (elementSize + elementAlignment - 1) / elementAlignment *
+                      elementAlignment;
+        for (size_t p = 0; p < predicate_count; p++) {
+                struct RecordField const field =
+                    schema->fields[predicates[p].field];
+                pushed[p] = (struct PushedPredicate){
+                    .type_tag = field.type_tag,
+                    .offset = field.offset,
+                    .comparison = predicates[p].comparison,
+                    .operand = predicates[p].operand,
+                };
+        }
+
+        *transducer = (struct ProjectingTransducer){
+            .projection =
+                {
+                    .recordSize = schema->record_size,
+                    .elementTypeTag = field_count == 1
+                                          ? schema->fields[fields[0]].type_tag
+                                          : TTAG_TUPLE,
+                    .elementSize = elementSize,
+                    .columns = columns,
+                    .columnCount = field_count,
+                    .predicates = pushed,
+                    .predicateCount = predicate_count,
+                },
+            .super = (struct Transducer){
+                .apply = projectingTransducerApply,
+            }};
+
+        return &transducer->super;
+}
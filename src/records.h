@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * @file
+ * Streams of fixed-layout binary records, e.g. the elements of an array of
+ * structs or the records of a log read by fileVSR, of type TTAG_RECORD.
+ *
+ * A schema tells where the numeric fields of such records lie, so that
+ * stages can read them from the raw bytes of the records rather than have
+ * each record turned into a value first.
+ */
+
+struct Allocator;
+struct Transducer;
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// numeric field of a record
+struct RecordField
+{
+        /// TTAG_FLOAT, TTAG_DOUBLE, TTAG_INT64, TTAG_INT32, TTAG_INT16 or
+        /// TTAG_UINT8
+        uint32_t type_tag;
+        /// position of the field from the start of the record, in bytes
+        size_t offset;
+};
+
+/// layout of the records of a stream
+struct RecordSchema
+{
+        size_t record_size;
+        struct RecordField const *fields;
+        size_t field_count;
+};
+
+enum RecordComparison {
+        RC_Less,
+        RC_LessOrEqual,
+        RC_Equal,
+        RC_NotEqual,
+        RC_GreaterOrEqual,
+        RC_Greater,
+};
+
+/// compares a field of a record, converted to a double, to an operand
+struct RecordPredicate
+{
+        /// index of the field in the schema
+        size_t field;
+        enum RecordComparison comparison;
+        double operand;
+};
+
+/**
+ * extracts the fields of index fields[0 .. field_count) in schema from the
+ * records which satisfy all of the predicates.
+ *
+ * Predicates are evaluated on the bytes of the records, before any value
+ * is built, and only the selected records are projected. Batches of
+ * records are processed by chunks: each predicate narrows down a selection
+ * vector of the records of the chunk, then each field is gathered from the
+ * selected records into a contiguous column, which is forwarded as a span.
+ *
+ * With a single field, forwards elements of the type of that field;
+ * otherwise, TTAG_TUPLE elements holding the fields in the given order,
+ * each at the offset tupleFieldOffset gives it. Indices of indexed records
+ * are kept. Elements other than TTAG_RECORD elements of
+ * schema->record_size bytes are dropped.
+ *
+ * The schema, fields and predicates are copied; field_count must not be 0.
+ */
+struct Transducer *
+projectingTransducer(struct RecordSchema const *schema, size_t const *fields,
+                     size_t field_count,
+                     struct RecordPredicate const *predicates,
+                     size_t predicate_count, struct Allocator *allocator);
@@ -0,0 +1,545 @@
+#include "reducers.h"
+
+#include "allocator.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* size in bytes of the chunks of a span a broadcasting reducer hands to
+ * each of its reducers in turn, small enough to stay in L1 */
+#define BROADCAST_CHUNK_SIZE 16384
+
+/* number of slots of the first table of a grouping reducer, a power of 2 */
+#define GROUPING_INITIAL_CAPACITY 16
+
+/* number of slots of the previous table moved to the new one per input
+ * while a grouping reducer grows, enough for the move to be over before
+ * the new table fills up */
+#define GROUPING_MIGRATION_STEP 4
+
+/* largest per-group state held in the slots of a grouping reducer, larger
+ * ones being allocated apart so that slots stay a few cache lines long */
+#define GROUPING_INLINE_STATE_SIZE 64
+
+/* broadcasting */
+
+/*
+ * The state starts with the current result of each reducer, followed by
+ * their states.
+ */
+struct BroadcastingReducer
+{
+        struct Reducer super;
+        struct Reducer const **reducers;
+        size_t count;
+        size_t *stateOffsets;
+};
+
+static struct Value *broadcastResults(void *state)
+{
+        return state;
+}
+
+static void *broadcastState(struct BroadcastingReducer const *self,
+                            void *state, size_t i)
+{
+        return (uint8_t *)state + self->stateOffsets[i];
+}
+
+static void broadcastingReducerInitState(struct Reducer const *reducer,
+                                         void *state,
+                                         struct Allocator *allocator)
+{
+        struct BroadcastingReducer const *self =
+            (struct BroadcastingReducer const *)reducer;
+        struct Value *results = broadcastResults(state);
+
+        for (size_t i = 0; i < self->count; i++) {
+                results[i] = reducer_identity(self->reducers[i], allocator);
+                reducer_init_state(self->reducers[i],
+                                   broadcastState(self, state, i), allocator);
+        }
+}
+
+/* current only tells whether all reducers halted */
+static struct Value broadcastingReducerApply(struct Reducer const *reducer,
+                                             void *state, struct Value input,
+                                             struct Value current,
+                                             struct Allocator *allocator)
+{
+        struct BroadcastingReducer const *self =
+            (struct BroadcastingReducer const *)reducer;
+        struct Value *results = broadcastResults(state);
+        bool halted = true;
+
+        for (size_t i = 0; i < self->count; i++) {
+                if (isReduced(results[i])) {
+                        continue;
+                }
+                results[i] = reducer_apply(self->reducers[i],
+                                           broadcastState(self, state, i),
+                                           input, results[i], allocator);
+                halted = halted && isReduced(results[i]);
+        }
+
+        return halted ? reducedValue(current) : current;
+}
+
+static struct Value
+broadcastingReducerApplyBatch(struct Reducer const *reducer, void *state,
+                              struct ValueSpan span, struct Value current,
+                              struct Allocator *allocator)
+{
+        struct BroadcastingReducer const *self =
+            (struct BroadcastingReducer const *)reducer;
+        struct Value *results = broadcastResults(state);
+        size_t chunkSize = BROADCAST_CHUNK_SIZE - BROADCAST_CHUNK_SIZE %
+                                                      span.element_size;
+        if (chunkSize == 0) {
+                chunkSize = span.element_size;
+        }
+
+        bool halted = false;
+        for (uint8_t const *first = span.first; first < span.last && !halted;
+             first += chunkSize) {
+                uint8_t const *last = (size_t)(span.last - first) > chunkSize
+                                          ? first + chunkSize
+                                          : span.last;
+                struct ValueSpan const chunk = subSpan(span, first, last);
+
+                halted = true;
+                for (size_t i = 0; i < self->count; i++) {
+                        if (isReduced(results[i])) {
+                                continue;
+                        }
+                        results[i] = reducer_apply_batch(
+                            self->reducers[i], broadcastState(self, state, i),
+                            chunk, results[i], allocator);
+                        halted = halted && isReduced(results[i]);
+                }
+        }
+
+        return halted ? reducedValue(current) : current;
+}
+
+static struct Value broadcastingReducerComplete(struct Reducer const *reducer,
+                                                void *state,
+                                                struct Value result,
+                                                struct Allocator *allocator)
+{
+        struct BroadcastingReducer const *self =
+            (struct BroadcastingReducer const *)reducer;
+        struct Value *results = broadcastResults(state);
+        struct Value const array = newArrayValue(
+            TTAG_VALUE, sizeof(struct Value), self->count, allocator);
+        struct Value *completed = arrayElements(array);
+
+        for (size_t i = 0; i < self->count; i++) {
+                completed[i] = detachValue(
+                    reducer_complete(self->reducers[i],
+                                     broadcastState(self, state, i),
+                                     unreducedValue(results[i]), allocator),
+                    state, self->super.state_size, allocator);
+        }
+
+        return array;
+}
+
+struct Reducer *broadcastingReducer(struct Reducer const **reducers,
+                                    size_t count, struct Allocator *allocator)
+{
+        struct BroadcastingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+        size_t const n = count ? count : 1;
+        struct Reducer const **ownReducers =
+            allocator_alloc(allocator, n * sizeof *ownReducers);
+        size_t *stateOffsets = allocator_alloc(allocator, n * sizeof(size_t));
+
+        size_t stateSize =
+            reducer_state_align(count * sizeof(struct Value));
+        bool mayHalt = count > 0;
+        for (size_t i = 0; i < count; i++) {
+                ownReducers[i] = reducers[i];
+                stateOffsets[i] = stateSize;
+                stateSize += reducer_state_align(reducers[i]->state_size);
+                mayHalt = mayHalt && reducers[i]->may_halt;
+        }
+
+        *result = (struct BroadcastingReducer){
+            .super =
+                {
+                    .complete = broadcastingReducerComplete,
+                    .apply = broadcastingReducerApply,
+                    .apply_batch = broadcastingReducerApplyBatch,
+                    .may_halt = mayHalt,
+                    .state_size = stateSize,
+                    .init_state = broadcastingReducerInitState,
+                },
+            .reducers = ownReducers,
+            .count = count,
+            .stateOffsets = stateOffsets,
+        };
+
+        return &result->super;
+}
+
+/* grouping */
+
+enum GroupSlotStatus {
+        GS_Empty,
+        GS_Full,
+        /// moved to the next table, keeps probe sequences going
+        GS_Moved,
+};
+
+/* start of a slot, followed by the state of the group, or by a pointer to
+ * it when the state is not inline */
+struct GroupSlot
+{
+        int64_t key;
+        enum GroupSlotStatus status;
+        struct Value current;
+};
+
+struct GroupTable
+{
+        uint8_t *slots;
+        /// a power of 2, 0 when not allocated
+        size_t capacity;
+        size_t count;
+};
+
+struct GroupingState
+{
+        struct Allocator *allocator;
+        struct GroupTable table;
+        /// table being moved to table
+        struct GroupTable previous;
+        /// next slot of previous to move
+        size_t moved;
+};
+
+struct GroupingReducer
+{
+        struct Reducer super;
+        int64_t (*keyFn)(struct Value value, void *data);
+        void *keyData;
+        struct Reducer const *group;
+        size_t slotSize;
+        size_t slotStateOffset;
+        bool inlineState;
+};
+
+/* splitmix64 finalizer, so that sequential keys spread over the table */
+static uint64_t groupHash(int64_t key)
+{
+        uint64_t x = (uint64_t)key;
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9u;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebu;
+        x ^= x >> 31;
+        return x;
+}
+
+static struct GroupSlot *groupSlot(struct GroupingReducer const *self,
+                                   struct GroupTable const *table, size_t i)
+{
+        return (struct GroupSlot *)(table->slots + i * self->slotSize);
+}
+
+static void *groupState(struct GroupingReducer const *self,
+                        struct GroupSlot *slot)
+{
+        void *state = (uint8_t *)slot + self->slotStateOffset;
+        return self->inlineState ? state : *(void **)state;
+}
+
+/* the slot of key in table, or the empty slot where it belongs */
+static struct GroupSlot *groupProbe(struct GroupingReducer const *self,
+                                    struct GroupTable const *table,
+                                    int64_t key)
+{
+        size_t const mask = table->capacity - 1;
+        for (size_t i = groupHash(key) & mask;; i = (i + 1) & mask) {
+                struct GroupSlot *slot = groupSlot(self, table, i);
+                if (slot->status == GS_Empty ||
+                    (slot->status == GS_Full && slot->key == key)) {
+                        return slot;
+                }
+        }
+}
+
+static void groupTableInit(struct GroupingReducer const *self,
+                           struct GroupTable *table, size_t capacity,
+                           struct Allocator *allocator)
+{
+        table->slots = allocator_alloc(allocator, capacity * self->slotSize);
+        table->capacity = capacity;
+        table->count = 0;
+        for (size_t i = 0; i < capacity; i++) {
+                groupSlot(self, table, i)->status = GS_Empty;
+        }
+}
+
+/* moves slot of the previous table to the current one, along with a
+ * current result pointing into its inline state */
+static struct GroupSlot *groupMove(struct GroupingReducer const *self,
+                                   struct GroupingState *grouping,
+                                   struct GroupSlot *slot)
+{
+        struct GroupSlot *destination =
+            groupProbe(self, &grouping->table, slot->key);
+        memcpy(destination, slot, self->slotSize);
+        struct Value *current = &destination->current;
+        uintptr_t const address = (uintptr_t)current->address;
+        if (self->inlineState && !(current->flags & VFLAG_INLINE) &&
+            address >= (uintptr_t)slot &&
+            address - (uintptr_t)slot < self->slotSize) {
+                current->address =
+                    (uint8_t *)destination + (address - (uintptr_t)slot);
+        }
+        grouping->table.count++;
+        slot->status = GS_Moved;
+        grouping->previous.count--;
+
+        return destination;
+}
+
+/* moves up to count slots of the previous table, releasing it once they
+ * all moved */
+static void groupMigrate(struct GroupingReducer const *self,
+                         struct GroupingState *grouping, size_t count)
+{
+        struct GroupTable *previous = &grouping->previous;
+        if (!previous->slots) {
+                return;
+        }
+
+        for (; count > 0 && grouping->moved < previous->capacity;
+             count--, grouping->moved++) {
+                struct GroupSlot *slot =
+                    groupSlot(self, previous, grouping->moved);
+                if (slot->status == GS_Full) {
+                        groupMove(self, grouping, slot);
+                }
+        }
+        if (grouping->moved == previous->capacity) {
+                allocator_free(grouping->allocator, previous->slots);
+                *previous = (struct GroupTable){0};
+        }
+}
+
+/* the slot of key, created if needed */
+static struct GroupSlot *groupFind(struct GroupingReducer const *self,
+                                   struct GroupingState *grouping, int64_t key,
+                                   struct Allocator *allocator)
+{
+        if (!grouping->table.slots) {
+                grouping->allocator = allocator;
+                groupTableInit(self, &grouping->table,
+                               GROUPING_INITIAL_CAPACITY, allocator);
+        }
+        groupMigrate(self, grouping, GROUPING_MIGRATION_STEP);
+
+        struct GroupSlot *slot = groupProbe(self, &grouping->table, key);
+        if (slot->status == GS_Full) {
+                return slot;
+        }
+        if (grouping->previous.slots) {
+                struct GroupSlot *previous =
+                    groupProbe(self, &grouping->previous, key);
+                if (previous->status == GS_Full) {
+                        return groupMove(self, grouping, previous);
+                }
+        }
+
+        /* grows past 3/4 of the slots, each table being full moved before
+         * the next one fills up */
+        if (4 * (grouping->table.count + 1) > 3 * grouping->table.capacity) {
+                groupMigrate(self, grouping, SIZE_MAX);
+                grouping->previous = grouping->table;
+                grouping->moved = 0;
+                groupTableInit(self, &grouping->table,
+                               2 * grouping->previous.capacity,
+                               grouping->allocator);
+                slot = groupProbe(self, &grouping->table, key);
+        }
+
+        slot->key = key;
+        slot->status = GS_Full;
+        slot->current = reducer_identity(self->group, allocator);
+        if (!self->inlineState) {
+                *(void **)((uint8_t *)slot + self->slotStateOffset) =
+                    allocator_alloc(grouping->allocator,
+                                    self->group->state_size);
+        }
+        reducer_init_state(self->group, groupState(self, slot), allocator);
+        grouping->table.count++;
+
+        return slot;
+}
+
+static struct Value groupingReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        struct GroupingReducer const *self =
+            (struct GroupingReducer const *)reducer;
+        struct GroupSlot *slot =
+            groupFind(self, state, self->keyFn(input, self->keyData),
+                      allocator);
+
+        if (!isReduced(slot->current)) {
+                slot->current =
+                    reducer_apply(self->group, groupState(self, slot), input,
+                                  slot->current, allocator);
+        }
+
+        return current;
+}
+
+/* hands runs of elements of the same key to their group at once */
+static struct Value groupingReducerApplyBatch(struct Reducer const *reducer,
+                                              void *state,
+                                              struct ValueSpan span,
+                                              struct Value current,
+                                              struct Allocator *allocator)
+{
+        struct GroupingReducer const *self =
+            (struct GroupingReducer const *)reducer;
+
+        uint8_t const *first = span.first;
+        int64_t key = first < span.last
+                          ? self->keyFn(valueOfSpanElement(span, first),
+                                        self->keyData)
+                          : 0;
+        while (first < span.last) {
+                uint8_t const *last = first + span.element_size;
+                int64_t nextKey = key;
+                while (last < span.last &&
+                       (nextKey = self->keyFn(valueOfSpanElement(span, last),
+                                              self->keyData)) == key) {
+                        last += span.element_size;
+                }
+
+                struct GroupSlot *slot = groupFind(self, state, key, allocator);
+                if (!isReduced(slot->current)) {
+                        slot->current = reducer_apply_batch(
+                            self->group, groupState(self, slot),
+                            subSpan(span, first, last), slot->current,
+                            allocator);
+                }
+                first = last;
+                key = nextKey;
+        }
+
+        return current;
+}
+
+static int compareGroupResults(void const *a, void const *b)
+{
+        int64_t const left = ((struct GroupResult const *)a)->key;
+        int64_t const right = ((struct GroupResult const *)b)->key;
+        return (left > right) - (left < right);
+}
+
+/* completes the groups of table, releasing the states allocated apart
+ * from grouping->allocator */
+static size_t groupComplete(struct GroupingReducer const *self,
+                            struct GroupingState const *grouping,
+                            struct GroupTable const *table,
+                            struct GroupResult *results,
+                            struct Allocator *allocator)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < table->capacity; i++) {
+                struct GroupSlot *slot = groupSlot(self, table, i);
+                if (slot->status != GS_Full) {
+                        continue;
+                }
+                void *state = groupState(self, slot);
+                struct Value const result =
+                    reducer_complete(self->group, state,
+                                     unreducedValue(slot->current), allocator);
+                results[count++] = (struct GroupResult){
+                    .key = slot->key,
+                    .result = detachValue(result, state,
+                                          self->group->state_size, allocator),
+                };
+                if (!self->inlineState) {
+                        allocator_free(grouping->allocator, state);
+                }
+        }
+        return count;
+}
+
+static struct Value groupingReducerComplete(struct Reducer const *reducer,
+                                            void *state, struct Value result,
+                                            struct Allocator *allocator)
+{
+        struct GroupingReducer const *self =
+            (struct GroupingReducer const *)reducer;
+        struct GroupingState *grouping = state;
+        size_t const count = grouping->table.count + grouping->previous.count;
+        struct Value const array = newArrayValue(
+            TTAG_GROUP_RESULT, sizeof(struct GroupResult), count, allocator);
+        struct GroupResult *results = arrayElements(array);
+
+        size_t n = groupComplete(self, grouping, &grouping->table, results,
+                                 allocator);
+        n += groupComplete(self, grouping, &grouping->previous, results + n,
+                           allocator);
+        qsort(results, n, sizeof *results, compareGroupResults);
+
+        if (grouping->previous.slots) {
+                allocator_free(grouping->allocator, grouping->previous.slots);
+        }
+        if (grouping->table.slots) {
+                allocator_free(grouping->allocator, grouping->table.slots);
+        }
+        *grouping = (struct GroupingState){0};
+
+        return array;
+}
+
+struct Reducer *groupingReducer(int64_t (*keyFn)(struct Value value,
+                                                 void *data),
+                                void *keyData,
+                                struct Reducer const *perGroupReducer,
+                                struct Allocator *allocator)
+{
+        struct GroupingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+        size_t const slotStateOffset =
+            reducer_state_align(sizeof(struct GroupSlot));
+        bool const inlineState =
+            perGroupReducer->state_size <= GROUPING_INLINE_STATE_SIZE;
+
+        *result = (struct GroupingReducer){
+            .super =
+                {
+                    .complete = groupingReducerComplete,
+                    .apply = groupingReducerApply,
+                    .apply_batch = groupingReducerApplyBatch,
+                    .state_size = sizeof(struct GroupingState),
+                },
+            .keyFn = keyFn,
+            .keyData = keyData,
+            .group = perGroupReducer,
+            .slotSize = slotStateOffset +
+                        (inlineState
+                             ? reducer_state_align(perGroupReducer->state_size)
+                             : sizeof(void *)),
+            .slotStateOffset = slotStateOffset,
+            .inlineState = inlineState,
+        };
+
+        return &result->super;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * @file
+ * Reducers running other reducers.
+ */
+
+struct Allocator;
+struct Reducer;
+
+#include "values.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * feeds every input to each of reducers, in one pass over the input.
+ *
+ * Spans are handed to the reducers a cache-sized chunk at a time, each
+ * chunk going through all of them before the next one is read. The
+ * reduction ends once all reducers halted.
+ *
+ * Completes into an array value of count TTAG_VALUE elements, the
+ * completed result of each reducer, allocated from the allocator of the
+ * reduction and released by freeValue.
+ */
+struct Reducer *broadcastingReducer(struct Reducer const **reducers,
+                                    size_t count, struct Allocator *allocator);
+
+/// element of the result of a grouping reducer
+struct GroupResult
+{
+        int64_t key;
+        struct Value result;
+};
+
+/**
+ * reduces the inputs of each key keyFn gives with its own instance of
+ * perGroupReducer.
+ *
+ * Groups live in an open-addressing hash table allocated from the
+ * allocator of the reduction, each slot holding the current result and
+ * the state of its group. States larger than a cache line, e.g. those of
+ * stages staging their elements, are allocated apart and the slot holds a
+ * pointer to them. The table grows incrementally: a few slots of the
+ * previous table move to the new one with every input, so that no single
+ * input pays for a full rehash. Inline states must therefore hold no
+ * pointer into themselves.
+ *
+ * Completes into an array value of TTAG_GROUP_RESULT elements sorted by
+ * key, allocated from the allocator of the reduction and released by
+ * freeValue.
+ */
+struct Reducer *groupingReducer(int64_t (*keyFn)(struct Value value,
+                                                 void *data),
+                                void *keyData,
+                                struct Reducer const *perGroupReducer,
+                                struct Allocator *allocator);
@@ -0,0 +1,504 @@
+#include "sampling.h"
+
+#include "allocator.h"
+#include "reducers.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* copy of an element small enough to be held inline by a value */
+struct SampledElement
+{
+        uint32_t type_tag;
+        uint32_t size;
+        uint8_t bytes[VALUE_INLINE_SIZE];
+};
+
+static bool isSampleable(size_t element_size)
+{
+        return element_size > 0 && element_size <= VALUE_INLINE_SIZE;
+}
+
+static struct SampledElement sampledElement(uint32_t type_tag, size_t size,
+                                            void const *bytes)
+{
+        struct SampledElement result = {
+            .type_tag = type_tag, .size = (uint32_t)size,
+        };
+        memcpy(result.bytes, bytes, size);
+        return result;
+}
+
+static struct Value valueOfSampledElement(struct SampledElement const *element)
+{
+        return inlineValue(element->type_tag, element->bytes, element->size);
+}
+
+/* top k */
+
+struct TopKReducer
+{
+        struct Reducer super;
+        size_t k;
+        int64_t (*keyFn)(struct Value value, void *data);
+        void *keyData;
+};
+
+struct TopKEntry
+{
+        int64_t key;
+        /// position of the element in the stream, to tell equal keys apart
+        uint64_t sequence;
+        struct SampledElement element;
+};
+
+/* followed by k entries, a min-heap whose root is the entry to drop next */
+struct TopKHeap
+{
+        size_t count;
+        /// number of elements received
+        uint64_t seen;
+};
+
+static struct TopKEntry *topKEntries(struct TopKHeap *heap)
+{
+        return (struct TopKEntry *)(heap + 1);
+}
+
+/* a is dropped before b: lower key, or equal key and later */
+static bool topKDropsFirst(struct TopKEntry const *a, struct TopKEntry const *b)
+{
+        return a->key < b->key ||
+               (a->key == b->key && a->sequence > b->sequence);
+}
+
+static void topKSiftUp(struct TopKEntry *entries, size_t i)
+{
+        while (i > 0) {
+                size_t const parent = (i - 1) / 2;
+                if (!topKDropsFirst(&entries[i], &entries[parent])) {
+                        break;
+                }
+                struct TopKEntry const swapped = entries[i];
+                entries[i] = entries[parent];
+                entries[parent] = swapped;
+                i = parent;
+        }
+}
+
+static void topKSiftDown(struct TopKEntry *entries, size_t count, size_t i)
+{
+        for (;;) {
+                size_t first = i;
+                size_t const left = 2 * i + 1;
+                size_t const right = left + 1;
+                if (left < count && topKDropsFirst(&entries[left],
+                                                   &entries[first])) {
+                        first = left;
+                }
+                if (right < count && topKDropsFirst(&entries[right],
+                                                    &entries[first])) {
+                        first = right;
+                }
+                if (first == i) {
+                        return;
+                }
+                struct TopKEntry const swapped = entries[i];
+                entries[i] = entries[first];
+                entries[first] = swapped;
+                i = first;
+        }
+}
+
+static void topKOffer(struct TopKReducer const *self, struct TopKHeap *heap,
+                      struct TopKEntry const *entry)
+{
+        struct TopKEntry *entries = topKEntries(heap);
+
+        if (heap->count < self->k) {
+                entries[heap->count] = *entry;
+                topKSiftUp(entries, heap->count++);
+        } else if (self->k > 0 && topKDropsFirst(&entries[0], entry)) {
+                entries[0] = *entry;
+                topKSiftDown(entries, heap->count, 0);
+        }
+}
+
+static struct Value topKReducerIdentity(struct Reducer const *reducer,
+                                        struct Allocator *allocator)
+{
+        struct TopKReducer const *self = (struct TopKReducer const *)reducer;
+        size_t const size =
+            sizeof(struct TopKHeap) + self->k * sizeof(struct TopKEntry);
+        struct Value const result =
+            newArrayValue(TTAG_UINT8, 1, size, allocator);
+        struct TopKHeap *heap = arrayElements(result);
+
+        *heap = (struct TopKHeap){0};
+
+        return result;
+}
+
+static struct Value topKReducerApply(struct Reducer const *reducer,
+                                     void *state, struct Value input,
+                                     struct Value current,
+                                     struct Allocator *allocator)
+{
+        struct TopKReducer const *self = (struct TopKReducer const *)reducer;
+        struct TopKHeap *heap = arrayElements(current);
+
+        if (isArrayValue(input) || !isSampleable(input.element_size)) {
+                return current;
+        }
+
+        struct TopKEntry const entry = {
+            .key = self->keyFn(input, self->keyData),
+            .sequence = heap->seen++,
+            .element = sampledElement(input.type_tag, input.element_size,
+                                      valueAddress(&input)),
+        };
+        topKOffer(self, heap, &entry);
+
+        return current;
+}
+
+/* once the heap is full, elements not above its root are only compared to
+ * the key of the root */
+static struct Value topKReducerApplyBatch(struct Reducer const *reducer,
+                                          void *state, struct ValueSpan span,
+                                          struct Value current,
+                                          struct Allocator *allocator)
+{
+        struct TopKReducer const *self = (struct TopKReducer const *)reducer;
+        struct TopKHeap *heap = arrayElements(current);
+        struct TopKEntry const *root = topKEntries(heap);
+
+        if (!isSampleable(span.element_size) || self->k == 0) {
+                return current;
+        }
+
+        for (uint8_t const *element = span.first; element < span.last;
+             element += span.element_size) {
+                int64_t const key = self->keyFn(
+                    valueOfSpanElement(span, element), self->keyData);
+                uint64_t const sequence = heap->seen++;
+                if (heap->count == self->k && key <= root->key) {
+                        continue;
+                }
+                struct TopKEntry const entry = {
+                    .key = key,
+                    .sequence = sequence,
+                    .element = sampledElement(span.type_tag,
+                                              span.element_size, element),
+                };
+                topKOffer(self, heap, &entry);
+        }
+
+        return current;
+}
+
+/* the elements of right come after those of left */
+static struct Value topKReducerCombine(struct Reducer const *reducer,
+                                       struct Value left, struct Value right,
+                                       struct Allocator *allocator)
+{
+        struct TopKReducer const *self = (struct TopKReducer const *)reducer;
+        struct TopKHeap *leftHeap = arrayElements(left);
+        struct TopKHeap *rightHeap = arrayElements(right);
+        struct TopKEntry const *rightEntries = topKEntries(rightHeap);
+
+        for (size_t i = 0; i < rightHeap->count; i++) {
+                struct TopKEntry entry = rightEntries[i];
+                entry.sequence += leftHeap->seen;
+                topKOffer(self, leftHeap, &entry);
+        }
+        leftHeap->seen += rightHeap->seen;
+        freeValue(&right);
+
+        return left;
+}
+
+/* highest key first, then first received */
+static int compareTopKEntries(void const *a, void const *b)
+{
+        struct TopKEntry const *left = a;
+        struct TopKEntry const *right = b;
+        if (left->key != right->key) {
+                return left->key < right->key ? 1 : -1;
+        }
+        return (left->sequence > right->sequence) -
+               (left->sequence < right->sequence);
+}
+
+static struct Value topKReducerComplete(struct Reducer const *reducer,
+                                        void *state, struct Value result,
+                                        struct Allocator *allocator)
+{
+        struct TopKHeap *heap = arrayElements(result);
+        struct TopKEntry *entries = topKEntries(heap);
+        size_t const count = heap->count;
+        struct Value const array = newArrayValue(
+            TTAG_GROUP_RESULT, sizeof(struct GroupResult), count, allocator);
+        struct GroupResult *results = arrayElements(array);
+
+        qsort(entries, count, sizeof *entries, compareTopKEntries);
+        for (size_t i = 0; i < count; i++) {
+                results[i] = (struct GroupResult){
+                    .key = entries[i].key,
+                    .result = valueOfSampledElement(&entries[i].element),
+                };
+        }
+        freeValue(&result);
+
+        return array;
+}
+
+struct Reducer *topKReducer(size_t k,
+                            int64_t (*keyFn)(struct Value value, void *data),
+                            void *keyData, struct Allocator *allocator)
+{
+        struct TopKReducer *result = allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct TopKReducer){
+            .super =
+                {
+                    .identity = topKReducerIdentity,
+                    .complete = topKReducerComplete,
+                    .apply = topKReducerApply,
+                    .apply_batch = topKReducerApplyBatch,
+                    .combine = topKReducerCombine,
+                },
+            .k = k,
+            .keyFn = keyFn,
+            .keyData = keyData,
+        };
+
+        return &result->super;
+}
+
+/* reservoir sampling */
+
+struct ReservoirSamplingTransducer
+{
+        struct Transducer super;
+        size_t k;
+        uint64_t seed;
+};
+
+struct ReservoirSamplingReducer
+{
+        struct ChainedReducer super;
+        size_t k;
+        uint64_t seed;
+};
+
+/* followed by k elements */
+struct ReservoirState
+{
+        uint64_t random;
+        /// number of elements received
+        size_t seen;
+        /// number of elements in the reservoir
+        size_t count;
+        /// position of the next element to keep once the reservoir is full
+        size_t next;
+        /// of Algorithm L, the largest of k uniform draws
+        double w;
+};
+
+static struct SampledElement *reservoirElements(struct ReservoirState *state)
+{
+        return (struct SampledElement *)(state + 1);
+}
+
+/* xorshift64*, uniform in (0, 1) */
+static double reservoirUniform(struct ReservoirState *reservoir)
+{
+        uint64_t x = reservoir->random;
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        reservoir->random = x;
+        x *= 0x2545f4914f6cdd1du;
+        return ((double)(x >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* moves next past the elements to skip before the next one to keep */
+static void reservoirSkip(struct ReservoirSamplingReducer const *self,
+                          struct ReservoirState *reservoir)
+{
+        reservoir->w *= exp(log(reservoirUniform(reservoir)) / (double)self->k);
+        double const skip = floor(log(reservoirUniform(reservoir)) /
+                                  log1p(-reservoir->w));
+        reservoir->next = skip < (double)(SIZE_MAX / 2)
+                              ? reservoir->seen + (size_t)skip
+                              : SIZE_MAX;
+}
+
+/* keeps the element at position seen, which the reservoir takes until it
+ * is full, then in place of one of its elements at random */
+static void reservoirKeep(struct ReservoirSamplingReducer const *self,
+                          struct ReservoirState *reservoir,
+                          struct SampledElement const *element)
+{
+        struct SampledElement *elements = reservoirElements(reservoir);
+
+        if (reservoir->count < self->k) {
+                elements[reservoir->count++] = *element;
+        } else {
+                size_t const slot =
+                    (size_t)(reservoirUniform(reservoir) * (double)self->k);
+                elements[slot < self->k ? slot : self->k - 1] = *element;
+        }
+        reservoir->seen++;
+        if (reservoir->count == self->k) {
+                reservoirSkip(self, reservoir);
+        }
+}
+
+static void reservoirInitState(struct Reducer const *reducer, void *state,
+                               struct Allocator *allocator)
+{
+        struct ReservoirSamplingReducer const *self =
+            (struct ReservoirSamplingReducer const *)reducer;
+        struct ReservoirState *reservoir = state;
+
+        chainedReducerInitState(reducer, state, allocator);
+        /* splitmix64 of the seed, xorshift never leaving 0 */
+        uint64_t x = self->seed + 0x9e3779b97f4a7c15u;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+        x ^= x >> 31;
+        reservoir->random = x ? x : 1;
+        reservoir->w = 1.0;
+}
+
+static struct Value reservoirSamplingReducerApply(struct Reducer const *reducer,
+                                                  void *state,
+                                                  struct Value input,
+                                                  struct Value current,
+                                                  struct Allocator *allocator)
+{
+        struct ReservoirSamplingReducer const *self =
+            (struct ReservoirSamplingReducer const *)reducer;
+        struct ReservoirState *reservoir = state;
+
+        if (isArrayValue(input) || !isSampleable(input.element_size) ||
+            self->k == 0) {
+                return current;
+        }
+        if (reservoir->count == self->k && reservoir->seen < reservoir->next) {
+                reservoir->seen++;
+                return current;
+        }
+
+        struct SampledElement const element = sampledElement(
+            input.type_tag, input.element_size, valueAddress(&input));
+        reservoirKeep(self, reservoir, &element);
+
+        return current;
+}
+
+/* jumps from one element to keep to the next */
+static struct Value
+reservoirSamplingReducerApplyBatch(struct Reducer const *reducer, void *state,
+                                   struct ValueSpan span, struct Value current,
+                                   struct Allocator *allocator)
+{
+        struct ReservoirSamplingReducer const *self =
+            (struct ReservoirSamplingReducer const *)reducer;
+        struct ReservoirState *reservoir = state;
+
+        if (!isSampleable(span.element_size) || self->k == 0) {
+                return current;
+        }
+
+        uint8_t const *element = span.first;
+        while (element < span.last) {
+                size_t const remaining =
+                    (size_t)(span.last - element) / span.element_size;
+                if (reservoir->count == self->k) {
+                        size_t const skip = reservoir->next - reservoir->seen;
+                        if (skip >= remaining) {
+                                reservoir->seen += remaining;
+                                break;
+                        }
+                        reservoir->seen += skip;
+                        element += skip * span.element_size;
+                }
+
+                struct SampledElement const kept = sampledElement(
+                    span.type_tag, span.element_size, element);
+                reservoirKeep(self, reservoir, &kept);
+                element += span.element_size;
+        }
+
+        return current;
+}
+
+/* forwards the reservoir, then completes downstream */
+static struct Value
+reservoirSamplingReducerComplete(struct Reducer const *reducer, void *state,
+                                 struct Value result,
+                                 struct Allocator *allocator)
+{
+        struct ReservoirSamplingReducer const *self =
+            (struct ReservoirSamplingReducer const *)reducer;
+        struct ReservoirState *reservoir = state;
+        struct SampledElement const *elements = reservoirElements(reservoir);
+        void *stepState = chainedStepState(&self->super, state);
+
+        for (size_t i = 0; i < reservoir->count && !isReduced(result); i++) {
+                result = reducer_apply(self->super.step, stepState,
+                                       valueOfSampledElement(&elements[i]),
+                                       result, allocator);
+        }
+
+        return reducer_complete(self->super.step, stepState,
+                                unreducedValue(result), allocator);
+}
+
+static struct Reducer *
+reservoirSamplingTransducerApply(struct Transducer *transducer,
+                                 struct Reducer const *step,
+                                 struct Allocator *allocator)
+{
+        struct ReservoirSamplingTransducer *self =
+            (struct ReservoirSamplingTransducer *)transducer;
+        struct ReservoirSamplingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->super = chainedReducerMake(
+            step, reservoirSamplingReducerApply,
+            sizeof(struct ReservoirState) +
+                self->k * sizeof(struct SampledElement));
+        result->super.super.apply_batch = reservoirSamplingReducerApplyBatch;
+        result->super.super.complete = reservoirSamplingReducerComplete;
+        result->super.super.init_state = reservoirInitState;
+        result->k = self->k;
+        result->seed = self->seed;
+
+        return &result->super.super;
+}
+
+struct Transducer *reservoirSamplingTransducer(size_t k, uint64_t seed,
+                                               struct Allocator *allocator)
+{
+        struct ReservoirSamplingTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct ReservoirSamplingTransducer){
+            .k = k,
+            .seed = seed,
+            .super = (struct Transducer){
+                .apply = reservoirSamplingTransducerApply,
+            }};
+
+        return &transducer->super;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * @file
+ * Bounded selections of the elements of a stream.
+ *
+ * Both keep at most k elements, in memory allocated once for all when the
+ * reduction starts, rather than gathering the whole stream to sort or
+ * draw from it. Elements are copied in that memory, so only those of up
+ * to VALUE_INLINE_SIZE bytes, the numeric ones, are selected.
+ */
+
+struct Allocator;
+struct Reducer;
+struct Transducer;
+struct Value;
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * keeps the k elements to which keyFn gives the highest keys, the first
+ * ones among elements of equal keys.
+ *
+ * The elements are kept in a min-heap, allocated by identity as the result
+ * of the reduction: once it is full, an element whose key is not above its
+ * root is dropped after a single comparison. combine merges two heaps.
+ *
+ * Completes into an array value of at most k TTAG_GROUP_RESULT elements,
+ * each holding the key and a copy of an element, from the highest key. The
+ * array is allocated from the allocator of the reduction and released by
+ * freeValue.
+ */
+struct Reducer *topKReducer(size_t k,
+                            int64_t (*keyFn)(struct Value value, void *data),
+                            void *keyData, struct Allocator *allocator);
+
+/**
+ * forwards, once the reduction completes, k elements drawn uniformly at
+ * random from those it received, or all of them when they are fewer.
+ *
+ * The reservoir lives in the state of the reduction. Draws follow
+ * Algorithm L, which computes how many elements to skip before the next
+ * one to keep, so that the random generator, seeded by seed, is called
+ * once per kept element rather than once per element.
+ */
+struct Transducer *reservoirSamplingTransducer(size_t k, uint64_t seed,
+                                               struct Allocator *allocator);
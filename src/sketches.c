@@ -0,0 +1,715 @@
+#include "sketches.h"
+
+#include "allocator.h"
+#include "reducers.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* most levels of a KLL sketch, each one weighing twice the previous one */
+#define KLL_MAX_LEVELS 32
+
+/* a zeroed sketch of size bytes, owned by the value */
+static struct Value newSketch(size_t size, struct Allocator *allocator)
+{
+        struct Value result = newArrayValue(TTAG_UINT8, 1, size, allocator);
+        memset(arrayElements(result), 0, size);
+        return result;
+}
+
+static void *sketchOf(struct Value value)
+{
+        return arrayElements(value);
+}
+
+/* splitmix64 finalizer */
+static uint64_t sketchMix(uint64_t x)
+{
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9u;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebu;
+        x ^= x >> 31;
+        return x;
+}
+
+static uint64_t sketchHash(uint8_t const *bytes, size_t size)
+{
+        uint64_t hash = 0x9e3779b97f4a7c15u ^ size;
+        for (; size >= sizeof(uint64_t);
+             bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+                uint64_t word;
+                memcpy(&word, bytes, sizeof word);
+                hash = sketchMix(hash ^ word);
+        }
+        if (size > 0) {
+                uint64_t word = 0;
+                memcpy(&word, bytes, size);
+                hash = sketchMix(hash ^ word);
+        }
+        return hash;
+}
+
+/* HyperLogLog */
+
+struct HyperLogLogReducer
+{
+        struct Reducer super;
+        unsigned precision;
+};
+
+static struct Value hyperLogLogReducerIdentity(struct Reducer const *reducer,
+                                               struct Allocator *allocator)
+{
+        struct HyperLogLogReducer const *self =
+            (struct HyperLogLogReducer const *)reducer;
+        return newSketch((size_t)1 << self->precision, allocator);
+}
+
+/* the first bits of hash pick a register, which keeps the longest run of
+ * leading zeros of the others plus one */
+static void hyperLogLogAdd(unsigned precision, uint8_t *registers,
+                           uint64_t hash)
+{
+        uint64_t const rest = hash << precision;
+        uint8_t const rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1)
+                                  : (uint8_t)(64 - precision + 1);
+        uint8_t *registerOfHash = &registers[hash >> (64 - precision)];
+
+        if (rank > *registerOfHash) {
+                *registerOfHash = rank;
+        }
+}
+
+static struct Value hyperLogLogReducerApply(struct Reducer const *reducer,
+                                            void *state, struct Value input,
+                                            struct Value current,
+                                            struct Allocator *allocator)
+{
+        struct HyperLogLogReducer const *self =
+            (struct HyperLogLogReducer const *)reducer;
+
+        hyperLogLogAdd(self->precision, sketchOf(current),
+                       sketchHash(valueAddress(&input), input.element_size));
+
+        return current;
+}
+
+static struct Value hyperLogLogReducerApplyBatch(struct Reducer const *reducer,
+                                                 void *state,
+                                                 struct ValueSpan span,
+                                                 struct Value current,
+                                                 struct Allocator *allocator)
+{
+        struct HyperLogLogReducer const *self =
+            (struct HyperLogLogReducer const *)reducer;
+        uint8_t *registers = sketchOf(current);
+
+        for (uint8_t const *element = span.first; element < span.last;
+             element += span.element_size) {
+                hyperLogLogAdd(self->precision, registers,
+                               sketchHash(element, span.element_size));
+        }
+
+        return current;
+}
+
+static struct Value hyperLogLogReducerCombine(struct Reducer const *reducer,
+                                              struct Value left,
+                                              struct Value right,
+                                              struct Allocator *allocator)
+{
+        uint8_t *leftRegisters = sketchOf(left);
+        uint8_t const *rightRegisters = sketchOf(right);
+
+        for (size_t i = 0; i < arrayCount(left); i++) {
+                if (rightRegisters[i] > leftRegisters[i]) {
+                        leftRegisters[i] = rightRegisters[i];
+                }
+        }
+        freeValue(&right);
+
+        return left;
+}
+
+static struct Value hyperLogLogReducerComplete(struct Reducer const *reducer,
+                                               void *state, struct Value result,
+                                               struct Allocator *allocator)
+{
+        uint8_t const *registers = sketchOf(result);
+        size_t const count = arrayCount(result);
+        double const m = (double)count;
+        double sum = 0.0;
+        size_t zeros = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                sum += ldexp(1.0, -registers[i]);
+                zeros += registers[i] == 0;
+        }
+        freeValue(&result);
+
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        if (m == 16.0) {
+                alpha = 0.673;
+        } else if (m == 32.0) {
+                alpha = 0.697;
+        } else if (m == 64.0) {
+                alpha = 0.709;
+        }
+        double estimate = alpha * m * m / sum;
+        /* few distinct elements are better counted by the empty registers */
+        if (estimate <= 2.5 * m && zeros > 0) {
+                estimate = m * log(m / (double)zeros);
+        }
+
+        return inlineDoubleValue(estimate);
+}
+
+struct Reducer *hyperLogLogReducer(unsigned precision,
+                                   struct Allocator *allocator)
+{
+        struct HyperLogLogReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct HyperLogLogReducer){
+            .super =
+                {
+                    .identity = hyperLogLogReducerIdentity,
+                    .complete = hyperLogLogReducerComplete,
+                    .apply = hyperLogLogReducerApply,
+                    .apply_batch = hyperLogLogReducerApplyBatch,
+                    .combine = hyperLogLogReducerCombine,
+                },
+            .precision = precision,
+        };
+
+        return &result->super;
+}
+
+/* Count-Min */
+
+struct CountMinReducer
+{
+        struct Reducer super;
+        int64_t (*keyFn)(struct Value value, void *data);
+        void *keyData;
+        size_t width;
+        size_t depth;
+        size_t count;
+};
+
+struct HeavyHitter
+{
+        int64_t key;
+        uint64_t estimate;
+};
+
+/* followed by count heavy hitters, then by depth rows of width counters */
+struct CountMinSketch
+{
+        size_t hittersCount;
+};
+
+static struct HeavyHitter *countMinHitters(struct CountMinSketch *sketch)
+{
+        return (struct HeavyHitter *)(sketch + 1);
+}
+
+static uint64_t *countMinCounters(struct CountMinReducer const *self,
+                                  struct CountMinSketch *sketch)
+{
+        return (uint64_t *)(countMinHitters(sketch) + self->count);
+}
+
+static size_t countMinSize(struct CountMinReducer const *self)
+{
+        return sizeof(struct CountMinSketch) +
+               self->count * sizeof(struct HeavyHitter) +
+               self->depth * self->width * sizeof(uint64_t);
+}
+
+static struct Value countMinReducerIdentity(struct Reducer const *reducer,
+                                            struct Allocator *allocator)
+{
+        struct CountMinReducer const *self =
+            (struct CountMinReducer const *)reducer;
+        return newSketch(countMinSize(self), allocator);
+}
+
+/* column of key in row, each row hashing keys its own way */
+static size_t countMinColumn(struct CountMinReducer const *self, size_t row,
+                             int64_t key)
+{
+        uint64_t const seed = (uint64_t)(row + 1) * 0x9e3779b97f4a7c15u;
+        return (size_t)(sketchMix((uint64_t)key ^ seed) % self->width);
+}
+
+/* adds n occurrences of key, returns its new estimate */
+static uint64_t countMinAdd(struct CountMinReducer const *self,
+                            struct CountMinSketch *sketch, int64_t key,
+                            uint64_t n)
+{
+        uint64_t *counters = countMinCounters(self, sketch);
+        uint64_t estimate = UINT64_MAX;
+
+        for (size_t row = 0; row < self->depth; row++) {
+                uint64_t *counter = &counters[row * self->width +
+                                              countMinColumn(self, row, key)];
+                *counter += n;
+                estimate = *counter < estimate ? *counter : estimate;
+        }
+
+        return estimate;
+}
+
+static uint64_t countMinEstimate(struct CountMinReducer const *self,
+                                 struct CountMinSketch *sketch, int64_t key)
+{
+        return countMinAdd(self, sketch, key, 0);
+}
+
+/* keeps key among the heavy hitters if its estimate is among the highest */
+static void countMinTrack(struct CountMinReducer const *self,
+                          struct CountMinSketch *sketch, int64_t key,
+                          uint64_t estimate)
+{
+        struct HeavyHitter *hitters = countMinHitters(sketch);
+        size_t lowest = 0;
+
+        for (size_t i = 0; i < sketch->hittersCount; i++) {
+                if (hitters[i].key == key) {
+                        hitters[i].estimate = estimate;
+                        return;
+                }
+                if (hitters[i].estimate < hitters[lowest].estimate) {
+                        lowest = i;
+                }
+        }
+
+        if (sketch->hittersCount < self->count) {
+                hitters[sketch->hittersCount++] =
+                    (struct HeavyHitter){.key = key, .estimate = estimate};
+        } else if (self->count > 0 && estimate > hitters[lowest].estimate) {
+                hitters[lowest] =
+                    (struct HeavyHitter){.key = key, .estimate = estimate};
+        }
+}
+
+static struct Value countMinReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        struct CountMinReducer const *self =
+            (struct CountMinReducer const *)reducer;
+        struct CountMinSketch *sketch = sketchOf(current);
+        int64_t const key = self->keyFn(input, self->keyData);
+
+        countMinTrack(self, sketch, key, countMinAdd(self, sketch, key, 1));
+
+        return current;
+}
+
+/* counts runs of elements of the same key at once */
+static struct Value countMinReducerApplyBatch(struct Reducer const *reducer,
+                                              void *state,
+                                              struct ValueSpan span,
+                                              struct Value current,
+                                              struct Allocator *allocator)
+{
+        struct CountMinReducer const *self =
+            (struct CountMinReducer const *)reducer;
+        struct CountMinSketch *sketch = sketchOf(current);
+
+        uint8_t const *first = span.first;
+        int64_t key = first < span.last
+                          ? self->keyFn(valueOfSpanElement(span, first),
+                                        self->keyData)
+                          : 0;
+        while (first < span.last) {
+                uint8_t const *last = first + span.element_size;
+                int64_t nextKey = key;
+                while (last < span.last &&
+                       (nextKey = self->keyFn(valueOfSpanElement(span, last),
+                                              self->keyData)) == key) {
+                        last += span.element_size;
+                }
+
+                uint64_t const n = (uint64_t)(last - first) / span.element_size;
+                countMinTrack(self, sketch, key,
+                              countMinAdd(self, sketch, key, n));
+                first = last;
+                key = nextKey;
+        }
+
+        return current;
+}
+
+/* adds the counters, then picks the heavy hitters of both sketches again */
+static struct Value countMinReducerCombine(struct Reducer const *reducer,
+                                           struct Value left,
+                                           struct Value right,
+                                           struct Allocator *allocator)
+{
+        struct CountMinReducer const *self =
+            (struct CountMinReducer const *)reducer;
+        struct CountMinSketch *leftSketch = sketchOf(left);
+        struct CountMinSketch *rightSketch = sketchOf(right);
+        uint64_t *leftCounters = countMinCounters(self, leftSketch);
+        uint64_t const *rightCounters = countMinCounters(self, rightSketch);
+
+        for (size_t i = 0; i < self->depth * self->width; i++) {
+                leftCounters[i] += rightCounters[i];
+        }
+
+        struct HeavyHitter *leftHitters = countMinHitters(leftSketch);
+        for (size_t i = 0; i < leftSketch->hittersCount; i++) {
+                leftHitters[i].estimate =
+                    countMinEstimate(self, leftSketch, leftHitters[i].key);
+        }
+        struct HeavyHitter const *rightHitters = countMinHitters(rightSketch);
+        for (size_t i = 0; i < rightSketch->hittersCount; i++) {
+                int64_t const key = rightHitters[i].key;
+                countMinTrack(self, leftSketch, key,
+                              countMinEstimate(self, leftSketch, key));
+        }
+        freeValue(&right);
+
+        return left;
+}
+
+/* most frequent first, then by key */
+static int compareHeavyHitters(void const *a, void const *b)
+{
+        struct HeavyHitter const *left = a;
+        struct HeavyHitter const *right = b;
+        if (left->estimate != right->estimate) {
+                return left->estimate < right->estimate ? 1 : -1;
+        }
+        return (left->key > right->key) - (left->key < right->key);
+}
+
+static struct Value countMinReducerComplete(struct Reducer const *reducer,
+                                            void *state, struct Value result,
+                                            struct Allocator *allocator)
+{
+        struct CountMinSketch *sketch = sketchOf(result);
+        struct HeavyHitter *hitters = countMinHitters(sketch);
+        size_t const count = sketch->hittersCount;
+        struct Value const array = newArrayValue(
+            TTAG_GROUP_RESULT, sizeof(struct GroupResult), count, allocator);
+        struct GroupResult *results = arrayElements(array);
+
+        qsort(hitters, count, sizeof *hitters, compareHeavyHitters);
+        for (size_t i = 0; i < count; i++) {
+                results[i] = (struct GroupResult){
+                    .key = hitters[i].key,
+                    .result = inlineInt64Value((int64_t)hitters[i].estimate),
+                };
+        }
+        freeValue(&result);
+
+        return array;
+}
+
+struct Reducer *countMinReducer(int64_t (*keyFn)(struct Value value,
+                                                 void *data),
+                                void *keyData, size_t width, size_t depth,
+                                size_t count, struct Allocator *allocator)
+{
+        struct CountMinReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct CountMinReducer){
+            .super =
+                {
+                    .identity = countMinReducerIdentity,
+                    .complete = countMinReducerComplete,
+                    .apply = countMinReducerApply,
+                    .apply_batch = countMinReducerApplyBatch,
+                    .combine = countMinReducerCombine,
+                },
+            .keyFn = keyFn,
+            .keyData = keyData,
+            .width = width,
+            .depth = depth,
+            .count = count,
+        };
+
+        return &result->super;
+}
+
+/* KLL quantiles */
+
+struct QuantilesReducer
+{
+        struct Reducer super;
+        double const *quantiles;
+        size_t count;
+        size_t k;
+};
+
+/*
+ * Followed by the floats of each level, 2 * k of them at most. A float of
+ * level h stands for 2^h floats of the stream.
+ *
+ * Once a level holds k floats it is compacted: it is sorted and every
+ * other float, starting at random from the first or the second one, goes
+ * to the next level.
+ */
+struct KllSketch
+{
+        uint64_t random;
+        size_t counts[KLL_MAX_LEVELS];
+};
+
+static float *kllLevel(struct QuantilesReducer const *self,
+                       struct KllSketch *sketch, size_t level)
+{
+        return (float *)(sketch + 1) + level * 2 * self->k;
+}
+
+static size_t kllSize(struct QuantilesReducer const *self)
+{
+        return sizeof(struct KllSketch) +
+               KLL_MAX_LEVELS * 2 * self->k * sizeof(float);
+}
+
+/* xorshift64 */
+static bool kllCoin(struct KllSketch *sketch)
+{
+        uint64_t x = sketch->random;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sketch->random = x;
+        return x & 1;
+}
+
+static int compareFloats(void const *a, void const *b)
+{
+        float const left = *(float const *)a;
+        float const right = *(float const *)b;
+        return (left > right) - (left < right);
+}
+
+/* the last level compacts into itself, which only happens past k * 2^31
+ * floats */
+static void kllCompact(struct QuantilesReducer const *self,
+                       struct KllSketch *sketch, size_t level)
+{
+        float *floats = kllLevel(self, sketch, level);
+        size_t const count = sketch->counts[level];
+        size_t const next = level + 1 < KLL_MAX_LEVELS ? level + 1 : level;
+        size_t const offset = kllCoin(sketch);
+
+        qsort(floats, count, sizeof *floats, compareFloats);
+        /* an odd float out, the largest one, stays */
+        float const odd = floats[count - 1];
+        size_t const promoted = count / 2;
+        float *destination = kllLevel(self, sketch, next);
+        if (next == level) {
+                sketch->counts[level] = 0;
+        }
+        destination += sketch->counts[next];
+        for (size_t i = 0; i < promoted; i++) {
+                destination[i] = floats[offset + 2 * i];
+        }
+        sketch->counts[next] += promoted;
+        if (next != level) {
+                sketch->counts[level] = count % 2;
+                floats[0] = odd;
+        } else if (count % 2) {
+                floats[sketch->counts[level]++] = odd;
+        }
+
+        if (next != level && sketch->counts[next] >= self->k) {
+                kllCompact(self, sketch, next);
+        }
+}
+
+/* count < 2 * k - sketch->counts[level] */
+static void kllPush(struct QuantilesReducer const *self,
+                    struct KllSketch *sketch, size_t level,
+                    float const *floats, size_t count)
+{
+        memcpy(kllLevel(self, sketch, level) + sketch->counts[level], floats,
+               count * sizeof *floats);
+        sketch->counts[level] += count;
+        if (sketch->counts[level] >= self->k) {
+                kllCompact(self, sketch, level);
+        }
+}
+
+static struct Value quantilesReducerIdentity(struct Reducer const *reducer,
+                                             struct Allocator *allocator)
+{
+        struct QuantilesReducer const *self =
+            (struct QuantilesReducer const *)reducer;
+        struct Value const result = newSketch(kllSize(self), allocator);
+        struct KllSketch *sketch = sketchOf(result);
+
+        sketch->random = 0x2545f4914f6cdd1du;
+
+        return result;
+}
+
+static struct Value quantilesReducerApply(struct Reducer const *reducer,
+                                          void *state, struct Value input,
+                                          struct Value current,
+                                          struct Allocator *allocator)
+{
+        struct QuantilesReducer const *self =
+            (struct QuantilesReducer const *)reducer;
+
+        if (input.type_tag == TTAG_FLOAT) {
+                float const x = floatOfValue(input);
+                kllPush(self, sketchOf(current), 0, &x, 1);
+        }
+
+        return current;
+}
+
+/* fills the first level a compaction at a time */
+static struct Value quantilesReducerApplyBatch(struct Reducer const *reducer,
+                                               void *state,
+                                               struct ValueSpan span,
+                                               struct Value current,
+                                               struct Allocator *allocator)
+{
+        struct QuantilesReducer const *self =
+            (struct QuantilesReducer const *)reducer;
+        struct KllSketch *sketch = sketchOf(current);
+
+        if (span.type_tag != TTAG_FLOAT || span.element_size != sizeof(float)) {
+                return current;
+        }
+
+        float const *floats = (float const *)span.first;
+        size_t count = (size_t)(span.last - span.first) / sizeof(float);
+        while (count > 0) {
+                size_t const room = self->k - sketch->counts[0];
+                size_t const n = count < room ? count : room;
+                kllPush(self, sketch, 0, floats, n);
+                floats += n;
+                count -= n;
+        }
+
+        return current;
+}
+
+/* pushes each level of right to the same level of left, from the bottom */
+static struct Value quantilesReducerCombine(struct Reducer const *reducer,
+                                            struct Value left,
+                                            struct Value right,
+                                            struct Allocator *allocator)
+{
+        struct QuantilesReducer const *self =
+            (struct QuantilesReducer const *)reducer;
+        struct KllSketch *leftSketch = sketchOf(left);
+        struct KllSketch *rightSketch = sketchOf(right);
+
+        for (size_t level = 0; level < KLL_MAX_LEVELS; level++) {
+                if (rightSketch->counts[level] > 0) {
+                        kllPush(self, leftSketch, level,
+                                kllLevel(self, rightSketch, level),
+                                rightSketch->counts[level]);
+                }
+        }
+        freeValue(&right);
+
+        return left;
+}
+
+struct KllItem
+{
+        float value;
+        uint64_t weight;
+};
+
+static int compareKllItems(void const *a, void const *b)
+{
+        return compareFloats(&((struct KllItem const *)a)->value,
+                             &((struct KllItem const *)b)->value);
+}
+
+/* sorts the floats of all levels with their weights, each quantile being
+ * the first float at which their cumulated weight reaches it */
+static struct Value quantilesReducerComplete(struct Reducer const *reducer,
+                                             void *state, struct Value result,
+                                             struct Allocator *allocator)
+{
+        struct QuantilesReducer const *self =
+            (struct QuantilesReducer const *)reducer;
+        struct KllSketch *sketch = sketchOf(result);
+
+        size_t itemsCount = 0;
+        for (size_t level = 0; level < KLL_MAX_LEVELS; level++) {
+                itemsCount += sketch->counts[level];
+        }
+        struct KllItem *items = allocator_alloc(
+            allocator, (itemsCount ? itemsCount : 1) * sizeof *items);
+        uint64_t total = 0;
+        size_t n = 0;
+        for (size_t level = 0; level < KLL_MAX_LEVELS; level++) {
+                float const *floats = kllLevel(self, sketch, level);
+                for (size_t i = 0; i < sketch->counts[level]; i++) {
+                        items[n++] = (struct KllItem){
+                            .value = floats[i], .weight = (uint64_t)1 << level,
+                        };
+                }
+                total += sketch->counts[level] << level;
+        }
+        freeValue(&result);
+        qsort(items, n, sizeof *items, compareKllItems);
+
+        struct Value const array =
+            newArrayValue(TTAG_FLOAT, sizeof(float), self->count, allocator);
+        float *estimates = arrayElements(array);
+        for (size_t q = 0; q < self->count; q++) {
+                double const rank = self->quantiles[q] * (double)total;
+                uint64_t cumulated = 0;
+                size_t i = 0;
+                while (i + 1 < n &&
+                       (double)(cumulated + items[i].weight) < rank) {
+                        cumulated += items[i].weight;
+                        i++;
+                }
+                estimates[q] = n > 0 ? items[i].value : NAN;
+        }
+        allocator_free(allocator, items);
+
+        return array;
+}
+
+struct Reducer *quantilesReducer(double const *quantiles, size_t count,
+                                 size_t k, struct Allocator *allocator)
+{
+        struct QuantilesReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+        double *ownQuantiles = allocator_alloc(
+            allocator, (count ? count : 1) * sizeof *ownQuantiles);
+
+        memcpy(ownQuantiles, quantiles, count * sizeof *quantiles);
+        *result = (struct QuantilesReducer){
+            .super =
+                {
+                    .identity = quantilesReducerIdentity,
+                    .complete = quantilesReducerComplete,
+                    .apply = quantilesReducerApply,
+                    .apply_batch = quantilesReducerApplyBatch,
+                    .combine = quantilesReducerCombine,
+                },
+            .quantiles = ownQuantiles,
+            .count = count,
+            .k = k,
+        };
+
+        return &result->super;
+}
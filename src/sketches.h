@@ -0,0 +1,59 @@
+#pragma once
+
+/**
+ * @file
+ * Reducers estimating properties of a stream in bounded memory.
+ *
+ * The result of these reducers is their sketch until they complete it
+ * into an estimate. Sketches are allocated by identity from the allocator
+ * of the reduction and updated in place; combine merges two of them, so
+ * that reductions of parts of a stream, e.g. by parallelReduceStream, give
+ * the sketch of the whole stream.
+ */
+
+struct Allocator;
+struct Reducer;
+struct Value;
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * estimates the number of distinct elements with a HyperLogLog sketch of
+ * 2^precision one-byte registers, 4 <= precision <= 16. Elements are told
+ * apart by their bytes.
+ *
+ * The standard error is about 1.04 / sqrt(2^precision). Completes into a
+ * TTAG_DOUBLE.
+ */
+struct Reducer *hyperLogLogReducer(unsigned precision,
+                                   struct Allocator *allocator);
+
+/**
+ * estimates the number of occurrences of the keys keyFn gives with a
+ * Count-Min sketch of depth rows of width counters, and keeps track of the
+ * count keys estimated to occur the most.
+ *
+ * Estimates are never below the actual count, and above it by at most
+ * e / width of the number of elements with probability 1 - exp(-depth).
+ * Completes into an array value of at most count TTAG_GROUP_RESULT
+ * elements, each holding the estimated number of occurrences of its key as
+ * a TTAG_INT64, from the most frequent key. The array is allocated from
+ * the allocator of the reduction and released by freeValue.
+ */
+struct Reducer *countMinReducer(int64_t (*keyFn)(struct Value value,
+                                                 void *data),
+                                void *keyData, size_t width, size_t depth,
+                                size_t count, struct Allocator *allocator);
+
+/**
+ * estimates quantiles of a TTAG_FLOAT stream with a KLL sketch keeping up
+ * to 2 * k floats per level, k >= 8.
+ *
+ * The rank of an estimate is off by a small multiple of n / k for n
+ * elements. Completes into an array value of the count estimates of
+ * quantiles, in [0, 1], allocated from the allocator of the reduction and
+ * released by freeValue. Elements other than floats are ignored.
+ */
+struct Reducer *quantilesReducer(double const *quantiles, size_t count,
+                                 size_t k, struct Allocator *allocator);
@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream_types.h"
+#include "stream.h"
+
+#include "allocator.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+struct AsyncStreamBuffer
+{
+        uint8_t *data;
+        size_t size;
+        /// error of the source once this buffer was filled
+        enum StreamErrorCode error;
+};
+
+struct AsyncStreamState
+{
+        struct StreamRange *source;
+        struct Allocator *allocator;
+        struct AsyncStreamBuffer *buffers;
+        size_t buffer_count;
+        size_t buffer_size;
+
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t filled;
+        pthread_cond_t released;
+        /// buffers filled by the producer so far
+        size_t filled_count;
+        /// buffers given back by the consumer so far
+        size_t released_count;
+        /// the consumer holds buffer released_count when true
+        bool consuming;
+        bool stop;
+};
+
+/* copies from source until the buffer is full or the source fails */
+static void fill_buffer(struct AsyncStreamState *state,
+                        struct AsyncStreamBuffer *buffer)
+{
+        struct StreamRange *source = state->source;
+
+        buffer->size = 0;
+        while (buffer->size < state->buffer_size &&
+               source->error == S_NoError) {
+                if (source->cursor == source->end) {
+                        source->next(source);
+                        continue;
+                }
+                size_t size = (size_t)(source->end - source->cursor);
+                size_t const room = state->buffer_size - buffer->size;
+                size = size < room ? size : room;
+                memcpy(buffer->data + buffer->size, source->cursor, size);
+                buffer->size += size;
+                source->cursor += size;
+        }
+        buffer->error = source->error;
+}
+
+static void *produce(void *data)
+{
+        struct AsyncStreamState *state = data;
+
+        pthread_mutex_lock(&state->mutex);
+        while (!state->stop) {
+                if (state->filled_count - state->released_count ==
+                    state->buffer_count) {
+                        pthread_cond_wait(&state->released, &state->mutex);
+                        continue;
+                }
+
+                struct AsyncStreamBuffer *buffer =
+                    &state->buffers[state->filled_count % state->buffer_count];
+                pthread_mutex_unlock(&state->mutex);
+                fill_buffer(state, buffer);
+                pthread_mutex_lock(&state->mutex);
+
+                state->filled_count++;
+                pthread_cond_signal(&state->filled);
+                if (buffer->error != S_NoError) {
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&state->mutex);
+
+        return NULL;
+}
+
+static enum StreamErrorCode fail(struct StreamRange *range,
+                                 enum StreamErrorCode error)
+{
+        stream_of_zeros(range);
+        range->error = error;
+
+        return range->error;
+}
+
+static enum StreamErrorCode next_async(struct StreamRange *range)
+{
+        struct AsyncStreamRange *self = (struct AsyncStreamRange *)range;
+        struct AsyncStreamState *state = self->state;
+
+        pthread_mutex_lock(&state->mutex);
+        if (state->consuming) {
+                size_t const current =
+                    state->released_count % state->buffer_count;
+                enum StreamErrorCode const error =
+                    state->buffers[current].error;
+                state->consuming = false;
+                state->released_count++;
+                pthread_cond_signal(&state->released);
+                if (error != S_NoError) {
+                        pthread_mutex_unlock(&state->mutex);
+                        return fail(range, error);
+                }
+        }
+
+        while (state->filled_count == state->released_count) {
+                pthread_cond_wait(&state->filled, &state->mutex);
+        }
+        struct AsyncStreamBuffer const *buffer =
+            &state->buffers[state->released_count % state->buffer_count];
+        state->consuming = true;
+        pthread_mutex_unlock(&state->mutex);
+
+        if (buffer->size == 0) {
+                return next_async(range);
+        }
+
+        range->start = buffer->data;
+        range->cursor = buffer->data;
+        range->end = buffer->data + buffer->size;
+
+        return range->error;
+}
+
+int stream_async(struct AsyncStreamRange *range, struct StreamRange *source,
+                 size_t buffer_count, size_t buffer_size,
+                 struct Allocator *allocator)
+{
+        struct AsyncStreamState *state =
+            allocator_alloc(allocator, sizeof *state);
+        buffer_count = buffer_count < 2 ? 2 : buffer_count;
+        buffer_size = buffer_size == 0 ? 1 : buffer_size;
+
+        *state = (struct AsyncStreamState){
+            .source = source,
+            .allocator = allocator,
+            .buffers = allocator_alloc(allocator,
+                                       buffer_count * sizeof *state->buffers),
+            .buffer_count = buffer_count,
+            .buffer_size = buffer_size,
+        };
+        for (size_t i = 0; i < buffer_count; i++) {
+                state->buffers[i] = (struct AsyncStreamBuffer){
+                    .data = allocator_alloc(allocator, buffer_size),
+                };
+        }
+        pthread_mutex_init(&state->mutex, NULL);
+        pthread_cond_init(&state->filled, NULL);
+        pthread_cond_init(&state->released, NULL);
+
+        range->state = state;
+        range->super.error = S_NoError;
+        range->super.next = next_async;
+        if (0 != pthread_create(&state->thread, NULL, produce, state)) {
+                state->thread = pthread_self();
+                fail(&range->super, S_IOError);
+                return -1;
+        }
+
+        range->super.next(&range->super);
+
+        return 0;
+}
+
+void stream_async_release(struct AsyncStreamRange *range)
+{
+        struct AsyncStreamState *state = range->state;
+        if (!state) {
+                return;
+        }
+
+        pthread_mutex_lock(&state->mutex);
+        state->stop = true;
+        pthread_cond_signal(&state->released);
+        pthread_mutex_unlock(&state->mutex);
+        if (!pthread_equal(state->thread, pthread_self())) {
+                pthread_join(state->thread, NULL);
+        }
+
+        pthread_cond_destroy(&state->released);
+        pthread_cond_destroy(&state->filled);
+        pthread_mutex_destroy(&state->mutex);
+        for (size_t i = 0; i < state->buffer_count; i++) {
+                allocator_free(state->allocator, state->buffers[i].data);
+        }
+        allocator_free(state->allocator, state->buffers);
+        allocator_free(state->allocator, state);
+        range->state = NULL;
+}
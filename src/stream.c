@@ -1,6 +1,13 @@
+#define _DEFAULT_SOURCE
+
 #include "stream_types.h"
 #include "stream.h"
 
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 static enum StreamErrorCode next_zeros(struct StreamRange *range)
 {
         static uint8_t const zeros[256] = {0};
@@ -43,3 +50,135 @@ void stream_on_memory(struct StreamRange *range, uint8_t const *mem,
         range->error = S_NoError;
         range->next = next_on_memory_buffer;
 }
+
+static enum StreamErrorCode next_on_file(struct StreamRange *range)
+{
+        struct FileStreamRange *self = (struct FileStreamRange *)range;
+
+        ssize_t count;
+        do {
+                count = read(self->fd, self->buffer, self->buffer_size);
+        } while (count < 0 && errno == EINTR);
+
+        if (count == 0) {
+                return fail(range, S_ReadPastEnd);
+        }
+        if (count < 0) {
+                return fail(range, S_IOError);
+        }
+
+        range->start = self->buffer;
+        range->cursor = self->buffer;
+        range->end = self->buffer + count;
+
+        return range->error;
+}
+
+void stream_on_file(struct FileStreamRange *range, int fd, uint8_t *buffer,
+                    size_t buffer_size)
+{
+        range->fd = fd;
+        range->buffer = buffer;
+        range->buffer_size = buffer_size;
+        range->super.error = S_NoError;
+        range->super.next = next_on_file;
+
+        range->super.next(&range->super);
+}
+
+static size_t page_size(void)
+{
+        long size = sysconf(_SC_PAGESIZE);
+        return size > 0 ? (size_t)size : 4096;
+}
+
+/* hints the kernel about the window following end, and the one before
+ * start which the consumer is done with */
+static void advise_window(struct MappedFileStreamRange *self)
+{
+        uint8_t const *mappingEnd = self->mapping + self->size;
+        uint8_t const *start = self->super.start;
+        uint8_t const *end = self->super.end;
+
+        if (end < mappingEnd) {
+                size_t const size = (size_t)(mappingEnd - end);
+                madvise((void *)end,
+                        size < self->window_size ? size : self->window_size,
+                        MADV_WILLNEED);
+        }
+        if (start > self->mapping) {
+                madvise((void *)(start - self->window_size), self->window_size,
+                        MADV_DONTNEED);
+        }
+}
+
+static enum StreamErrorCode next_on_mapped_file(struct StreamRange *range)
+{
+        struct MappedFileStreamRange *self =
+            (struct MappedFileStreamRange *)range;
+        uint8_t const *mappingEnd = self->mapping + self->size;
+
+        if (range->end >= mappingEnd) {
+                return fail(range, S_ReadPastEnd);
+        }
+
+        size_t const remaining = (size_t)(mappingEnd - range->end);
+        range->start = range->end;
+        range->cursor = range->start;
+        range->end = range->start + (remaining < self->window_size
+                                         ? remaining
+                                         : self->window_size);
+        advise_window(self);
+
+        return range->error;
+}
+
+int stream_on_mapped_file(struct MappedFileStreamRange *range, int fd,
+                          size_t window_size)
+{
+        size_t const page = page_size();
+        struct stat status;
+
+        *range = (struct MappedFileStreamRange){
+            .super = {.error = S_NoError, .next = next_on_mapped_file},
+            .window_size = (window_size + page - 1) / page * page,
+        };
+        if (range->window_size == 0) {
+                range->window_size = page;
+        }
+
+        if (fstat(fd, &status) != 0) {
+                fail(&range->super, S_IOError);
+                return -1;
+        }
+
+        range->size = (size_t)status.st_size;
+        if (range->size == 0) {
+                stream_on_memory(&range->super, NULL, 0);
+                return 0;
+        }
+
+        void *mapping = mmap(NULL, range->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+                range->size = 0;
+                fail(&range->super, S_IOError);
+                return -1;
+        }
+        madvise(mapping, range->size, MADV_SEQUENTIAL);
+
+        range->mapping = mapping;
+        range->super.start = range->mapping;
+        range->super.cursor = range->mapping;
+        range->super.end = range->mapping;
+        range->super.next(&range->super);
+
+        return 0;
+}
+
+void stream_unmap_file(struct MappedFileStreamRange *range)
+{
+        if (range->mapping) {
+                munmap((void *)range->mapping, range->size);
+                range->mapping = NULL;
+        }
+}
@@ -3,8 +3,43 @@
 #include <stddef.h>
 #include <stdint.h>
 
+struct Allocator;
+struct AsyncStreamRange;
 struct StreamRange;
+struct FileStreamRange;
+struct MappedFileStreamRange;
 
 void stream_of_zeros(struct StreamRange *range);
 void stream_on_memory(struct StreamRange *range, uint8_t const *mem,
                       size_t size);
+
+/// reads fd buffer_size bytes at a time into buffer
+void stream_on_file(struct FileStreamRange *range, int fd, uint8_t *buffer,
+                    size_t buffer_size);
+
+/**
+ * maps the file fd in memory and hands it out window_size bytes at a time
+ * (rounded up to whole pages), hinting the kernel about sequential access.
+ *
+ * @return 0 or -1 when the file could not be mapped, in which case the
+ * stream fails with S_IOError.
+ */
+int stream_on_mapped_file(struct MappedFileStreamRange *range, int fd,
+                          size_t window_size);
+
+void stream_unmap_file(struct MappedFileStreamRange *range);
+
+/**
+ * consumes source from a background thread, which copies it into
+ * buffer_count buffers of buffer_size bytes while the consumer reads the
+ * previous ones.
+ *
+ * @return 0 or -1 when the thread could not be started, in which case the
+ * stream fails with S_IOError.
+ */
+int stream_async(struct AsyncStreamRange *range, struct StreamRange *source,
+                 size_t buffer_count, size_t buffer_size,
+                 struct Allocator *allocator);
+
+/// stops the background thread and frees the buffers
+void stream_async_release(struct AsyncStreamRange *range);
@@ -5,6 +5,7 @@
  * Buffered stream I/O
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -15,6 +16,8 @@ enum StreamErrorCode {
         S_NoError,
         /// the consumer attempted to read past the end
         S_ReadPastEnd,
+        /// the producer failed to obtain more data
+        S_IOError,
 };
 
 /**
@@ -65,3 +68,38 @@ struct StreamRange
          */
         enum StreamErrorCode (*next)(struct StreamRange *);
 };
+
+/**
+ * Stream refilled by reading a file descriptor into a buffer owned by the
+ * caller.
+ */
+struct FileStreamRange
+{
+        struct StreamRange super;
+        int fd;
+        uint8_t *buffer;
+        size_t buffer_size;
+};
+
+/**
+ * Stream handing out consecutive windows of a file mapped in memory.
+ */
+struct MappedFileStreamRange
+{
+        struct StreamRange super;
+        uint8_t const *mapping;
+        size_t size;
+        size_t window_size;
+};
+
+struct AsyncStreamState;
+
+/**
+ * Stream filled from another stream by a background thread, in a ring of
+ * buffers, so that next() only swaps buffers.
+ */
+struct AsyncStreamRange
+{
+        struct StreamRange super;
+        struct AsyncStreamState *state;
+};
@@ -1,22 +1,87 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct Allocator;
+struct ValueSpan;
 
-// reducer closure
+/**
+ * reducer closure.
+ *
+ * Reducers are immutable once built: what changes during a reduction
+ * lives in a separate state of state_size bytes, which every call but
+ * identity and combine receives. Several reductions can therefore run
+ * with the same reducer at once, each with its own state.
+ */
 struct Reducer
 {
         struct Value (*identity)(struct Reducer const *reducer,
                                  struct Allocator *allocator);
 
-        struct Value (*complete)(struct Reducer const *reducer,
+        struct Value (*complete)(struct Reducer const *reducer, void *state,
                                  struct Value result,
                                  struct Allocator *allocator);
 
-        struct Value (*apply)(struct Reducer const *reducer, struct Value input,
-                              struct Value current,
+        struct Value (*apply)(struct Reducer const *reducer, void *state,
+                              struct Value input, struct Value current,
                               struct Allocator *allocator);
+
+        /**
+         * optional, reduces all elements of a span in one call.
+         *
+         * @see reducer_apply_batch for the per-element fallback
+         */
+        struct Value (*apply_batch)(struct Reducer const *reducer, void *state,
+                                    struct ValueSpan span, struct Value current,
+                                    struct Allocator *allocator);
+
+        /**
+         * optional, merges the results of the reductions of two consecutive
+         * parts of an input, left coming before right.
+         *
+         * required for parallel reductions.
+         */
+        struct Value (*combine)(struct Reducer const *reducer,
+                                struct Value left, struct Value right,
+                                struct Allocator *allocator);
+
+        /**
+         * true when apply may return a reduced value before the input is
+         * exhausted, in which case upstream stages do not process
+         * elements ahead of it.
+         */
+        bool may_halt;
+
+        /// size of the state of a reduction, including the state of the
+        /// reducers this one forwards to
+        size_t state_size;
+
+        /// optional, prepares the state of a reduction, which is otherwise
+        /// zeroed
+        void (*init_state)(struct Reducer const *reducer, void *state,
+                           struct Allocator *allocator);
 };
 
+/**
+ * base of the reducers created by transducers, which forward to step.
+ *
+ * The state of step follows the state of the stage itself.
+ */
+struct ChainedReducer
+{
+        struct Reducer super;
+        struct Reducer const *step;
+        size_t step_state_offset;
+};
+
+static inline void *chainedStepState(struct ChainedReducer const *reducer,
+                                     void *state)
+{
+        return (uint8_t *)state + reducer->step_state_offset;
+}
+
 /* transducers */
 
 struct Transducer
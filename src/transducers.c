@@ -3,6 +3,22 @@
 
 #include "allocator.h"
 
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+/* size in bytes of the buffer in which mapping stages gather their outputs
+ * before forwarding them downstream as a span */
+#define STAGING_BUFFER_SIZE 16384
+
+/* number of indexed elements a staging buffer holds at most, along with
+ * their indices */
+#define STAGING_INDICES_COUNT 512
+
+/* number of indices an indexing stage writes before forwarding them
+ * downstream along with their elements */
+#define INDEXING_CHUNK_SIZE 1024
+
 struct Value reducer_identity(struct Reducer const *reducer,
                               struct Allocator *allocator)
 {
@@ -13,35 +29,102 @@ struct Value reducer_identity(struct Reducer const *reducer,
         return reducer->identity(reducer, allocator);
 }
 
-struct Value reducer_complete(struct Reducer const *reducer,
+struct Value reducer_complete(struct Reducer const *reducer, void *state,
                               struct Value result, struct Allocator *allocator)
 {
         if (!reducer->complete) {
                 return result;
         }
 
-        return reducer->complete(reducer, result, allocator);
+        return reducer->complete(reducer, state, result, allocator);
 }
 
-struct Value reducer_apply(struct Reducer const *reducer, struct Value input,
-                           struct Value current, struct Allocator *allocator)
+struct Value reducer_apply(struct Reducer const *reducer, void *state,
+                           struct Value input, struct Value current,
+                           struct Allocator *allocator)
 {
-        return reducer->apply(reducer, input, current, allocator);
+        return reducer->apply(reducer, state, input, current, allocator);
 }
 
-static struct Value idReducerApply(struct Reducer const *reducer,
+struct Value reducer_apply_batch(struct Reducer const *reducer, void *state,
+                                 struct ValueSpan span, struct Value current,
+                                 struct Allocator *allocator)
+{
+        if (reducer->apply_batch) {
+                return reducer->apply_batch(reducer, state, span, current,
+                                            allocator);
+        }
+
+        struct SpanCursor cursor;
+        spanCursorInit(&cursor, span);
+        for (struct Value const *value;
+             !isReduced(current) && (value = spanCursorNext(&cursor));) {
+                current =
+                    reducer->apply(reducer, state, *value, current, allocator);
+        }
+
+        return current;
+}
+
+struct Value reducer_combine(struct Reducer const *reducer, struct Value left,
+                             struct Value right, struct Allocator *allocator)
+{
+        return reducer->combine(reducer, left, right, allocator);
+}
+
+size_t reducer_state_align(size_t size)
+{
+        size_t const alignment = alignof(max_align_t);
+        return (size + alignment - 1) / alignment * alignment;
+}
+
+void reducer_init_state(struct Reducer const *reducer, void *state,
+                        struct Allocator *allocator)
+{
+        if (reducer->init_state) {
+                reducer->init_state(reducer, state, allocator);
+        } else if (reducer->state_size > 0) {
+                memset(state, 0, reducer->state_size);
+        }
+}
+
+void *reducer_new_state(struct Reducer const *reducer,
+                        struct Allocator *allocator)
+{
+        void *state = allocator_alloc(
+            allocator, reducer->state_size > 0 ? reducer->state_size : 1);
+        reducer_init_state(reducer, state, allocator);
+
+        return state;
+}
+
+static struct Value idReducerApply(struct Reducer const *reducer, void *state,
                                    struct Value input, struct Value current,
                                    struct Allocator *allocator)
 {
         return input;
 }
 
+/* the last element of the span */
+static struct Value idReducerApplyBatch(struct Reducer const *reducer,
+                                        void *state, struct ValueSpan span,
+                                        struct Value current,
+                                        struct Allocator *allocator)
+{
+        if (span.first == span.last) {
+                return current;
+        }
+
+        return valueOfSpanElement(span, span.last - span.element_size);
+}
+
 struct Reducer *idReducer(struct Allocator *allocator)
 {
         struct Reducer *result = allocator_alloc(allocator, sizeof *result);
 
         *result = (struct Reducer){
             .apply = idReducerApply,
+            .apply_batch = idReducerApplyBatch,
         };
 
         return result;
@@ -55,42 +138,221 @@ struct Reducer *transducer_apply(struct Transducer *transducer,
         return transducer->apply(transducer, step, allocator);
 }
 
-struct ChainedReducer
-{
-        struct Reducer super;
-        struct Reducer const *step;
-};
-
 static struct Value chainedReducerIdentity(struct Reducer const *reducer,
                                            struct Allocator *allocator)
 {
-        struct ChainedReducer *self = (struct ChainedReducer *)reducer;
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
         return reducer_identity(self->step, allocator);
 }
 
 static struct Value chainedReducerComplete(struct Reducer const *reducer,
-                                           struct Value result,
+                                           void *state, struct Value result,
                                            struct Allocator *allocator)
 {
-        struct ChainedReducer *self = (struct ChainedReducer *)reducer;
-        return reducer_complete(self->step, result, allocator);
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        return reducer_complete(self->step, chainedStepState(self, state),
+                                result, allocator);
+}
+
+static struct Value chainedReducerCombine(struct Reducer const *reducer,
+                                          struct Value left, struct Value right,
+                                          struct Allocator *allocator)
+{
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        return reducer_combine(self->step, left, right, allocator);
+}
+
+void chainedReducerInitState(struct Reducer const *reducer, void *state,
+                             struct Allocator *allocator)
+{
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        memset(state, 0, self->step_state_offset);
+        reducer_init_state(self->step, chainedStepState(self, state),
+                           allocator);
 }
 
-static struct ChainedReducer chainedReducerMake(
+struct ChainedReducer chainedReducerMake(
     struct Reducer const *step,
-    struct Value (*reducingFn)(struct Reducer const *, struct Value,
-                               struct Value, struct Allocator *))
+    struct Value (*reducingFn)(struct Reducer const *, void *, struct Value,
+                               struct Value, struct Allocator *),
+    size_t stateSize)
 {
-        struct ChainedReducer result = {.super = (struct Reducer){
-                                            .identity = chainedReducerIdentity,
-                                            .complete = chainedReducerComplete,
-                                            .apply = reducingFn,
-                                        },
-                                        .step = step};
+        size_t const stepStateOffset = reducer_state_align(stateSize);
+        struct ChainedReducer result = {
+            .super = (struct Reducer){
+                .identity = chainedReducerIdentity,
+                .complete = chainedReducerComplete,
+                .apply = reducingFn,
+                .may_halt = step->may_halt,
+                .state_size = stepStateOffset + step->state_size,
+                .init_state = chainedReducerInitState,
+            },
+            .step = step,
+            .step_state_offset = stepStateOffset,
+        };
 
         return result;
 }
 
+void chainedReducerCombineThroughStep(struct ChainedReducer *reducer)
+{
+        reducer->super.combine =
+            reducer->step->combine ? chainedReducerCombine : NULL;
+}
+
+/*
+ * Staging area where a stage gathers the values it produces, so they can be
+ * forwarded downstream as a span rather than one at a time. It is part of
+ * the state of the stage.
+ *
+ * Indexed values are staged along with their index, which the span
+ * carries in its indices. Values are forwarded one at a time to steps
+ * which may halt, so that no element is processed past the end of the
+ * reduction, to steps without a batch path, which would only unstage
+ * them, and when they are arrays, whose elements do not lie in the value.
+ *
+ * It holds no pointer into itself, so that states can be moved.
+ */
+struct Staging
+{
+        uint32_t type_tag;
+        size_t element_size;
+        /// bytes in use in buffer
+        size_t size;
+        /// elements in buffer
+        size_t count;
+        /// the staged elements are indexed, each by its entry of indices
+        bool indexed;
+        size_t indices[STAGING_INDICES_COUNT];
+        alignas(max_align_t) uint8_t buffer[STAGING_BUFFER_SIZE];
+};
+
+static void stagingInit(struct Staging *staging)
+{
+        staging->type_tag = 0;
+        staging->element_size = 0;
+        staging->size = 0;
+        staging->count = 0;
+        staging->indexed = false;
+}
+
+/* for stages whose own state is a staging area */
+static void stagingInitState(struct Reducer const *reducer, void *state,
+                             struct Allocator *allocator)
+{
+        chainedReducerInitState(reducer, state, allocator);
+        stagingInit(state);
+}
+
+static struct Value stagingFlush(struct Staging *staging,
+                                 struct Reducer const *step, void *stepState,
+                                 struct Value current,
+                                 struct Allocator *allocator)
+{
+        if (staging->size > 0) {
+                struct ValueSpan const span = {
+                    .type_tag = staging->type_tag,
+                    .element_size = staging->element_size,
+                    .first = staging->buffer,
+                    .last = staging->buffer + staging->size,
+                    .indices = staging->indexed ? staging->indices : NULL,
+                };
+                staging->size = 0;
+                staging->count = 0;
+                current = reducer_apply_batch(step, stepState, span, current,
+                                              allocator);
+        }
+
+        return current;
+}
+
+/* whether value goes on with the elements being staged */
+static inline bool stagingContinues(struct Staging const *staging,
+                                    struct Value const *value,
+                                    void const *payload)
+{
+        return staging->size > 0 && payload &&
+               value->type_tag == staging->type_tag &&
+               value->element_size == staging->element_size &&
+               isIndexed(*value) == staging->indexed &&
+               STAGING_BUFFER_SIZE - staging->size >= value->element_size &&
+               (!staging->indexed || staging->count < STAGING_INDICES_COUNT);
+}
+
+static inline void stagingAppend(struct Staging *staging,
+                                 struct Value const *value,
+                                 void const *payload)
+{
+        uint8_t *element = staging->buffer + staging->size;
+        /* the common sizes are copied inline rather than by a call */
+        switch (value->element_size) {
+        case 4:
+                memcpy(element, payload, 4);
+                break;
+        case 8:
+                memcpy(element, payload, 8);
+                break;
+        default:
+                memcpy(element, payload, value->element_size);
+                break;
+        }
+        if (staging->indexed) {
+                staging->indices[staging->count] = value->index;
+        }
+        staging->size += value->element_size;
+        staging->count++;
+}
+
+/* forwards value, or flushes the staged elements to stage it anew */
+static void stagingRestart(struct Staging *staging,
+                           struct Reducer const *step, void *stepState,
+                           struct Value const *value, struct Value *current,
+                           struct Allocator *allocator)
+{
+        void const *payload = valueAddress(value);
+        if (step->may_halt || !step->apply_batch) {
+                *current = reducer_apply(step, stepState, *value, *current,
+                                         allocator);
+                return;
+        }
+
+        *current =
+            stagingFlush(staging, step, stepState, *current, allocator);
+        if (isReduced(*current)) {
+                return;
+        }
+        if (isArrayValue(*value) || !payload || value->element_size == 0 ||
+            value->element_size > STAGING_BUFFER_SIZE) {
+                *current = reducer_apply(step, stepState, *value, *current,
+                                         allocator);
+                return;
+        }
+        staging->type_tag = value->type_tag;
+        staging->element_size = value->element_size;
+        staging->indexed = isIndexed(*value);
+        stagingAppend(staging, value, payload);
+}
+
+/* stages value, or forwards it when it cannot be staged. Both are passed
+ * by address, as this runs for every element of a span */
+static inline void stagingPush(struct Staging *staging,
+                               struct Reducer const *step, void *stepState,
+                               struct Value const *value,
+                               struct Value *current,
+                               struct Allocator *allocator)
+{
+        void const *payload = valueAddress(value);
+        if (stagingContinues(staging, value, payload)) {
+                stagingAppend(staging, value, payload);
+                return;
+        }
+        stagingRestart(staging, step, stepState, value, current, allocator);
+}
+
 struct FilteringTransducer
 {
         struct Transducer super;
@@ -106,14 +368,69 @@ struct FilteringReducer
 };
 
 static struct Value filteringReducerApply(struct Reducer const *reducer,
-                                          struct Value const input,
+                                          void *state, struct Value const input,
                                           struct Value const current,
                                           struct Allocator *allocator)
 {
-        struct FilteringReducer *self = (struct FilteringReducer *)reducer;
+        struct FilteringReducer const *self =
+            (struct FilteringReducer const *)reducer;
         if (self->predicate(input, self->predicateData)) {
-                return reducer_apply(self->super.step, input, current,
-                                     allocator);
+                return reducer_apply(self->super.step,
+                                     chainedStepState(&self->super, state),
+                                     input, current, allocator);
+        }
+
+        return current;
+}
+
+/* stages the accepted elements, unless the step may halt, in which case
+ * the runs of consecutive accepted elements go as sub-spans so that no
+ * predicate runs past the end of the reduction */
+static struct Value filteringReducerApplyBatch(struct Reducer const *reducer,
+                                               void *state,
+                                               struct ValueSpan span,
+                                               struct Value current,
+                                               struct Allocator *allocator)
+{
+        struct FilteringReducer const *self =
+            (struct FilteringReducer const *)reducer;
+        struct Reducer const *step = self->super.step;
+        void *stepState = chainedStepState(&self->super, state);
+        struct SpanCursor cursor;
+        spanCursorInit(&cursor, span);
+        if (!step->may_halt) {
+                for (struct Value const *value;
+                     (value = spanCursorNext(&cursor));) {
+                        if (self->predicate(*value, self->predicateData)) {
+                                stagingPush(state, step, stepState, value,
+                                            &current, allocator);
+                        }
+                }
+                return stagingFlush(state, step, stepState, current,
+                                    allocator);
+        }
+
+        uint8_t const *runFirst = span.first;
+        for (struct Value const *value; (value = spanCursorNext(&cursor));) {
+                if (self->predicate(*value, self->predicateData)) {
+                        continue;
+                }
+                uint8_t const *element = value->address;
+                if (element > runFirst) {
+                        current = reducer_apply_batch(
+                            self->super.step, stepState,
+                            subSpan(span, runFirst, element), current,
+                            allocator);
+                        if (isReduced(current)) {
+                                return current;
+                        }
+                }
+                runFirst = element + span.element_size;
+        }
+        if (span.last > runFirst) {
+                current = reducer_apply_batch(
+                    self->super.step, stepState,
+                    subSpan(span, runFirst, span.last), current, allocator);
         }
 
         return current;
@@ -130,7 +447,11 @@ static struct Reducer *filteringTransducerApply(struct Transducer *transducer,
 
         result->predicate = self->predicate;
         result->predicateData = self->predicateData;
-        result->super = chainedReducerMake(step, filteringReducerApply);
+        result->super = chainedReducerMake(step, filteringReducerApply,
+                                           sizeof(struct Staging));
+        result->super.super.apply_batch = filteringReducerApplyBatch;
+        result->super.super.init_state = stagingInitState;
+        chainedReducerCombineThroughStep(&result->super);
 
         return &result->super.super;
 }
@@ -152,6 +473,187 @@ filteringTransducer(bool (*predicate)(struct Value value, void *data),
         return &transducer->super;
 }
 
+struct TakingTransducer
+{
+        struct Transducer super;
+        size_t n;
+};
+
+struct TakingReducer
+{
+        struct ChainedReducer super;
+        size_t n;
+};
+
+struct TakingState
+{
+        size_t remaining;
+};
+
+static void takingReducerInitState(struct Reducer const *reducer, void *state,
+                                   struct Allocator *allocator)
+{
+        struct TakingReducer const *self =
+            (struct TakingReducer const *)reducer;
+        struct TakingState *taking = state;
+
+        chainedReducerInitState(reducer, state, allocator);
+        taking->remaining = self->n;
+}
+
+static struct Value takingReducerApply(struct Reducer const *reducer,
+                                       void *state, struct Value input,
+                                       struct Value current,
+                                       struct Allocator *allocator)
+{
+        struct TakingReducer const *self =
+            (struct TakingReducer const *)reducer;
+        struct TakingState *taking = state;
+        if (taking->remaining == 0) {
+                return reducedValue(current);
+        }
+
+        current = reducer_apply(self->super.step,
+                                chainedStepState(&self->super, state), input,
+                                current, allocator);
+        taking->remaining--;
+
+        return taking->remaining == 0 ? reducedValue(current) : current;
+}
+
+static struct Value takingReducerApplyBatch(struct Reducer const *reducer,
+                                            void *state, struct ValueSpan span,
+                                            struct Value current,
+                                            struct Allocator *allocator)
+{
+        struct TakingReducer const *self =
+            (struct TakingReducer const *)reducer;
+        struct TakingState *taking = state;
+        size_t count = (size_t)(span.last - span.first) / span.element_size;
+        if (count > taking->remaining) {
+                span.last = span.first + taking->remaining * span.element_size;
+                count = taking->remaining;
+        }
+
+        if (count > 0) {
+                current = reducer_apply_batch(
+                    self->super.step, chainedStepState(&self->super, state),
+                    span, current, allocator);
+                taking->remaining -= count;
+        }
+
+        return taking->remaining == 0 ? reducedValue(current) : current;
+}
+
+static struct Reducer *takingTransducerApply(struct Transducer *transducer,
+                                             struct Reducer const *step,
+                                             struct Allocator *allocator)
+{
+        struct TakingTransducer *self = (struct TakingTransducer *)transducer;
+        struct TakingReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->super = chainedReducerMake(step, takingReducerApply,
+                                           sizeof(struct TakingState));
+        result->super.super.apply_batch = takingReducerApplyBatch;
+        result->super.super.init_state = takingReducerInitState;
+        result->super.super.may_halt = true;
+        result->n = self->n;
+
+        return &result->super.super;
+}
+
+struct Transducer *takingTransducer(size_t n, struct Allocator *allocator)
+{
+        struct TakingTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct TakingTransducer){
+            .n = n,
+            .super = (struct Transducer){
+                .apply = takingTransducerApply,
+            }};
+
+        return &transducer->super;
+}
+
+static struct Value takingWhileReducerApply(struct Reducer const *reducer,
+                                            void *state, struct Value input,
+                                            struct Value current,
+                                            struct Allocator *allocator)
+{
+        struct FilteringReducer const *self =
+            (struct FilteringReducer const *)reducer;
+        if (!self->predicate(input, self->predicateData)) {
+                return reducedValue(current);
+        }
+
+        return reducer_apply(self->super.step,
+                             chainedStepState(&self->super, state), input,
+                             current, allocator);
+}
+
+static struct Value takingWhileReducerApplyBatch(struct Reducer const *reducer,
+                                                 void *state,
+                                                 struct ValueSpan span,
+                                                 struct Value current,
+                                                 struct Allocator *allocator)
+{
+        struct FilteringReducer const *self =
+            (struct FilteringReducer const *)reducer;
+        struct ValueSpan run = span;
+        for (run.last = span.first; run.last < span.last;
+             run.last += span.element_size) {
+                if (!self->predicate(valueOfSpanElement(span, run.last),
+                                     self->predicateData)) {
+                        break;
+                }
+        }
+
+        if (run.last > run.first) {
+                current = reducer_apply_batch(
+                    self->super.step, chainedStepState(&self->super, state),
+                    run, current, allocator);
+        }
+
+        return run.last < span.last ? reducedValue(current) : current;
+}
+
+static struct Reducer *takingWhileTransducerApply(struct Transducer *transducer,
+                                                  struct Reducer const *step,
+                                                  struct Allocator *allocator)
+{
+        struct FilteringTransducer *self =
+            (struct FilteringTransducer *)transducer;
+        struct FilteringReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        result->predicate = self->predicate;
+        result->predicateData = self->predicateData;
+        result->super = chainedReducerMake(step, takingWhileReducerApply, 0);
+        result->super.super.apply_batch = takingWhileReducerApplyBatch;
+        result->super.super.may_halt = true;
+
+        return &result->super.super;
+}
+
+struct Transducer *
+takingWhileTransducer(bool (*predicate)(struct Value value, void *data),
+                      void *predicateData, struct Allocator *allocator)
+{
+        struct FilteringTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct FilteringTransducer){
+            .predicate = predicate,
+            .predicateData = predicateData,
+            .super = (struct Transducer){
+                .apply = takingWhileTransducerApply,
+            }};
+
+        return &transducer->super;
+}
+
 struct MappingTransducer
 {
         struct Transducer super;
@@ -162,31 +664,105 @@ struct MappingReducer
 {
         struct ChainedReducer super;
         struct Reducer const *reducer;
+};
+
+/* followed by the state of the mapped reducer */
+struct MappingState
+{
         struct Value reducerResult;
+        struct Staging staging;
 };
 
+static void *mappedReducerState(struct MappingState *mapping)
+{
+        return (uint8_t *)mapping + reducer_state_align(sizeof *mapping);
+}
+
+static void mappingReducerInitState(struct Reducer const *reducer, void *state,
+                                    struct Allocator *allocator)
+{
+        struct MappingReducer const *self =
+            (struct MappingReducer const *)reducer;
+        struct MappingState *mapping = state;
+
+        chainedReducerInitState(reducer, state, allocator);
+        reducer_init_state(self->reducer, mappedReducerState(mapping),
+                           allocator);
+        mapping->reducerResult = reducer_identity(self->reducer, allocator);
+        stagingInit(&mapping->staging);
+}
+
 static struct Value mappingReducerComplete(struct Reducer const *reducer,
-                                           struct Value result,
+                                           void *state, struct Value result,
                                            struct Allocator *allocator)
 {
-        struct MappingReducer *self = (struct MappingReducer *)reducer;
+        struct MappingReducer const *self =
+            (struct MappingReducer const *)reducer;
+        struct MappingState *mapping = state;
         return reducer_complete(
-            self->super.step,
-            reducer_complete(self->reducer, result, allocator), allocator);
+            self->super.step, chainedStepState(&self->super, state),
+            reducer_complete(self->reducer, mappedReducerState(mapping),
+                             result, allocator),
+            allocator);
 }
 
 static struct Value mappingReducerApply(struct Reducer const *reducer,
-                                        struct Value input,
+                                        void *state, struct Value input,
                                         struct Value current,
                                         struct Allocator *allocator)
 {
-        struct MappingReducer *self = (struct MappingReducer *)reducer;
+        struct MappingReducer const *self =
+            (struct MappingReducer const *)reducer;
+        struct MappingState *mapping = state;
 
-        self->reducerResult =
-            reducer_apply(self->reducer, input, self->reducerResult, allocator);
+        struct Value reducerResult =
+            reducer_apply(self->reducer, mappedReducerState(mapping), input,
+                          mapping->reducerResult, allocator);
+        mapping->reducerResult = unreducedValue(reducerResult);
 
-        return reducer_apply(self->super.step, self->reducerResult, current,
-                             allocator);
+        struct Value result = reducer_apply(
+            self->super.step, chainedStepState(&self->super, state),
+            mapping->reducerResult, current, allocator);
+
+        return isReduced(reducerResult) ? reducedValue(result) : result;
+}
+
+static struct Value mappingReducerApplyBatch(struct Reducer const *reducer,
+                                             void *state, struct ValueSpan span,
+                                             struct Value current,
+                                             struct Allocator *allocator)
+{
+        struct MappingReducer const *self =
+            (struct MappingReducer const *)reducer;
+        struct MappingState *mapping = state;
+        void *reducerState = mappedReducerState(mapping);
+        void *stepState = chainedStepState(&self->super, state);
+
+        /* the result is kept in a local rather than in the state while
+         * elements go through, and only unreduced when it is */
+        struct Value reducerResult = mapping->reducerResult;
+        bool halted = false;
+        struct SpanCursor cursor;
+        spanCursorInit(&cursor, span);
+        for (struct Value const *value;
+             !isReduced(current) && (value = spanCursorNext(&cursor));) {
+                reducerResult = reducer_apply(self->reducer, reducerState,
+                                              *value, reducerResult, allocator);
+                if (isReduced(reducerResult)) {
+                        reducerResult = unreducedValue(reducerResult);
+                        halted = true;
+                }
+                stagingPush(&mapping->staging, self->super.step, stepState,
+                            &reducerResult, &current, allocator);
+                if (halted) {
+                        break;
+                }
+        }
+        mapping->reducerResult = reducerResult;
+
+        current = stagingFlush(&mapping->staging, self->super.step, stepState,
+                               current, allocator);
+        return halted ? reducedValue(current) : current;
 }
 
 static struct Reducer *newMappingReducer(struct Reducer const *reducer,
@@ -197,12 +773,17 @@ static struct Reducer *newMappingReducer(struct Reducer const *reducer,
             allocator_alloc(allocator, sizeof *result);
 
         *result = (struct MappingReducer){
-            .super = chainedReducerMake(step, mappingReducerApply),
-            reducer,
-            reducer_identity(reducer, allocator),
+            .super = chainedReducerMake(
+                step, mappingReducerApply,
+                reducer_state_align(sizeof(struct MappingState)) +
+                    reducer->state_size),
+            .reducer = reducer,
         };
 
+        result->super.super.init_state = mappingReducerInitState;
         result->super.super.complete = mappingReducerComplete;
+        result->super.super.apply_batch = mappingReducerApplyBatch;
+        result->super.super.may_halt = step->may_halt || reducer->may_halt;
 
         return &result->super.super;
 }
@@ -250,18 +831,44 @@ struct MappingFnTransducer
 };
 
 static struct Value mappingFnReducerApply(struct Reducer const *reducer,
-                                          struct Value input,
+                                          void *state, struct Value input,
                                           struct Value current,
                                           struct Allocator *allocator)
 {
-        struct MappingFnReducer *self = (struct MappingFnReducer *)reducer;
+        struct MappingFnReducer const *self =
+            (struct MappingFnReducer const *)reducer;
 
         return reducer_apply(
-            self->super.step,
+            self->super.step, chainedStepState(&self->super, state),
             self->input.mapperFn(input, self->input.mapperData), current,
             allocator);
 }
 
+static struct Value mappingFnReducerApplyBatch(struct Reducer const *reducer,
+                                               void *state,
+                                               struct ValueSpan span,
+                                               struct Value current,
+                                               struct Allocator *allocator)
+{
+        struct MappingFnReducer const *self =
+            (struct MappingFnReducer const *)reducer;
+        struct Staging *staging = state;
+        void *stepState = chainedStepState(&self->super, state);
+
+        struct SpanCursor cursor;
+        spanCursorInit(&cursor, span);
+        for (struct Value const *value;
+             !isReduced(current) && (value = spanCursorNext(&cursor));) {
+                struct Value const mapped =
+                    self->input.mapperFn(*value, self->input.mapperData);
+                stagingPush(staging, self->super.step, stepState, &mapped,
+                            &current, allocator);
+        }
+
+        return stagingFlush(staging, self->super.step, stepState, current,
+                            allocator);
+}
+
 static struct Reducer *mappingFnTransducerApply(struct Transducer *transducer,
                                                 struct Reducer const *step,
                                                 struct Allocator *allocator)
@@ -271,7 +878,11 @@ static struct Reducer *mappingFnTransducerApply(struct Transducer *transducer,
 
         struct MappingFnReducer *result =
             allocator_alloc(allocator, sizeof *result);
-        result->super = chainedReducerMake(step, mappingFnReducerApply);
+        result->super = chainedReducerMake(step, mappingFnReducerApply,
+                                           sizeof(struct Staging));
+        result->super.super.apply_batch = mappingFnReducerApplyBatch;
+        result->super.super.init_state = stagingInitState;
+        chainedReducerCombineThroughStep(&result->super);
         result->input = self->input;
 
         return &result->super.super;
@@ -295,6 +906,86 @@ mappingFnTransducer(struct Value (*mapperFn)(struct Value, void *data),
         return &result->super;
 }
 
+struct IndexingState
+{
+        size_t next;
+        size_t indices[INDEXING_CHUNK_SIZE];
+};
+
+static struct Value indexingReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        struct IndexingState *indexing = state;
+
+        return reducer_apply(self->step, chainedStepState(self, state),
+                             indexedValue(input, indexing->next++), current,
+                             allocator);
+}
+
+/* forwards the span in chunks, each with its array of indices */
+static struct Value indexingReducerApplyBatch(struct Reducer const *reducer,
+                                              void *state,
+                                              struct ValueSpan span,
+                                              struct Value current,
+                                              struct Allocator *allocator)
+{
+        struct ChainedReducer const *self =
+            (struct ChainedReducer const *)reducer;
+        struct IndexingState *indexing = state;
+        void *stepState = chainedStepState(self, state);
+        size_t const chunkSize = INDEXING_CHUNK_SIZE * span.element_size;
+
+        for (uint8_t const *first = span.first;
+             first < span.last && !isReduced(current); first += chunkSize) {
+                struct ValueSpan chunk = span;
+                chunk.first = first;
+                if ((size_t)(span.last - first) > chunkSize) {
+                        chunk.last = first + chunkSize;
+                }
+                size_t const count =
+                    (size_t)(chunk.last - chunk.first) / span.element_size;
+                for (size_t i = 0; i < count; i++) {
+                        indexing->indices[i] = indexing->next + i;
+                }
+                indexing->next += count;
+                chunk.indices = indexing->indices;
+
+                current = reducer_apply_batch(self->step, stepState, chunk,
+                                              current, allocator);
+        }
+
+        return current;
+}
+
+static struct Reducer *indexingTransducerApply(struct Transducer *transducer,
+                                               struct Reducer const *step,
+                                               struct Allocator *allocator)
+{
+        struct ChainedReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        *result = chainedReducerMake(step, indexingReducerApply,
+                                     sizeof(struct IndexingState));
+        result->super.apply_batch = indexingReducerApplyBatch;
+
+        return &result->super;
+}
+
+struct Transducer *indexingTransducer(struct Allocator *allocator)
+{
+        struct Transducer *result = allocator_alloc(allocator, sizeof *result);
+
+        *result = (struct Transducer){
+            .apply = indexingTransducerApply,
+        };
+
+        return result;
+}
+
 struct ComposingTransducer
 {
         struct Transducer super;
@@ -302,6 +993,8 @@ struct ComposingTransducer
         size_t transducersCount;
 };
 
+/* the composed reducer is the one of the outermost transducer, so spans
+ * reach every stage through its own apply_batch (or the fallback) */
 static struct Reducer *composingTransducerApply(struct Transducer *transducer,
                                                 struct Reducer const *step,
                                                 struct Allocator *allocator)
@@ -1,6 +1,7 @@
 #pragma once
 
 struct Allocator;
+struct ChainedReducer;
 struct Reducer;
 struct Transducer;
 
@@ -13,15 +14,57 @@ struct Value reducer_identity(struct Reducer const *reducer,
                               struct Allocator *allocator);
 
 /// produce a final value and/or flush state.
-struct Value reducer_complete(struct Reducer const *reducer,
+struct Value reducer_complete(struct Reducer const *reducer, void *state,
                               struct Value result, struct Allocator *allocator);
 
 /// reduction function
-struct Value reducer_apply(struct Reducer const *reducer, struct Value input,
-                           struct Value current, struct Allocator *allocator);
+struct Value reducer_apply(struct Reducer const *reducer, void *state,
+                           struct Value input, struct Value current,
+                           struct Allocator *allocator);
+
+/// reduction of a whole span, falling back to apply for each element when
+/// the reducer has no apply_batch
+struct Value reducer_apply_batch(struct Reducer const *reducer, void *state,
+                                 struct ValueSpan span, struct Value current,
+                                 struct Allocator *allocator);
+
+/// merges the results of two consecutive reductions, the reducer must
+/// have a combine function
+struct Value reducer_combine(struct Reducer const *reducer, struct Value left,
+                             struct Value right, struct Allocator *allocator);
+
+/// prepares state, of reducer->state_size bytes, for a new reduction
+void reducer_init_state(struct Reducer const *reducer, void *state,
+                        struct Allocator *allocator);
+
+/// allocates and prepares the state of a new reduction, to be freed with
+/// allocator_free once the reduction is complete
+void *reducer_new_state(struct Reducer const *reducer,
+                        struct Allocator *allocator);
+
+/// size rounded up so that states can be laid out one after the other
+size_t reducer_state_align(size_t size);
 
 struct Reducer *idReducer(struct Allocator *allocator);
 
+/// reducer forwarding identity and complete to step, and applying with
+/// reducingFn. Its state is made of stateSize bytes of its own, then the
+/// state of step. It cannot combine unless its stage opts in.
+struct ChainedReducer chainedReducerMake(
+    struct Reducer const *step,
+    struct Value (*reducingFn)(struct Reducer const *, void *, struct Value,
+                               struct Value, struct Allocator *),
+    size_t stateSize);
+
+/// lets reducer combine by forwarding to its step, when the step combines.
+/// Only for stages whose elements do not depend on the ones before them.
+void chainedReducerCombineThroughStep(struct ChainedReducer *reducer);
+
+/// default init_state of chained reducers: zeroes the state of the stage
+/// and prepares the state of its step
+void chainedReducerInitState(struct Reducer const *reducer, void *state,
+                             struct Allocator *allocator);
+
 struct Reducer *transducer_apply(struct Transducer *transducer,
                                  struct Reducer const *step,
                                  struct Allocator *allocator);
@@ -30,6 +73,14 @@ struct Transducer *
 filteringTransducer(bool (*predicate)(struct Value value, void *data),
                     void *predicateData, struct Allocator *allocator);
 
+/// lets the first n elements through, then ends the reduction
+struct Transducer *takingTransducer(size_t n, struct Allocator *allocator);
+
+/// lets elements through until predicate fails, then ends the reduction
+struct Transducer *
+takingWhileTransducer(bool (*predicate)(struct Value value, void *data),
+                      void *predicateData, struct Allocator *allocator);
+
 struct Transducer *mappingTransducer(struct Reducer *reducer,
                                      struct Allocator *allocator);
 
@@ -40,3 +91,7 @@ struct Transducer *composingTransducer(struct Transducer **transducers,
 struct Transducer *
 mappingFnTransducer(struct Value (*mapperFn)(struct Value, void *data),
                     void *mapperData, struct Allocator *allocator);
+
+/// attaches to each element its position in the reduction, starting at 0.
+/// Spans go downstream with an array of their indices rather than boxed
+struct Transducer *indexingTransducer(struct Allocator *allocator);
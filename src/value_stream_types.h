@@ -1,8 +1,14 @@
 #pragma once
 
 #include "stream_types.h"
+#include "values.h"
 
+struct Allocator;
+struct Reducer;
+
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct ValueStreamRange
 {
@@ -14,3 +20,142 @@ struct ValueStreamRange
         enum StreamErrorCode error;
         enum StreamErrorCode (*next)(struct ValueStreamRange *);
 };
+
+/**
+ * Stream refilled by reading a file descriptor into a buffer owned by the
+ * caller.
+ *
+ * Elements split by a read are completed by the next one.
+ */
+struct FileValueStreamRange
+{
+        struct ValueStreamRange super;
+        int fd;
+        uint8_t *buffer;
+        size_t buffer_size;
+        /// bytes of an incomplete element, stored at end
+        size_t tail_size;
+};
+
+/**
+ * Stream handing out consecutive windows of a file mapped in memory.
+ */
+struct MappedFileValueStreamRange
+{
+        struct ValueStreamRange super;
+        /// owns the mapping
+        struct MappedFileStreamRange file;
+        size_t window_size;
+};
+
+/**
+ * Stream of the tuples made of the next element of each of its sources,
+ * which it consumes in lockstep. It ends with its shortest source.
+ *
+ * Tuples are gathered in a buffer owned by the caller, their elements laid
+ * out one after the other in the order of the sources, each aligned as
+ * tupleFieldOffset says.
+ */
+struct ZipValueStreamRange
+{
+        struct ValueStreamRange super;
+        struct ValueStreamRange **sources;
+        size_t sources_count;
+        uint8_t *buffer;
+        size_t buffer_size;
+};
+
+/// most sources a MergeValueStreamRange can merge
+#define MERGE_VSR_MAX_SOURCES 64
+
+/// source of a MergeValueStreamRange, ordered by the key of its next
+/// element
+struct MergeSource
+{
+        int64_t key;
+        size_t index;
+};
+
+/**
+ * Stream of the elements of sources sorted by key, merged into one sorted
+ * stream. Elements of equal keys come in the order of their sources.
+ *
+ * Elements are gathered in a buffer owned by the caller.
+ */
+struct MergeValueStreamRange
+{
+        struct ValueStreamRange super;
+        struct ValueStreamRange **sources;
+        int64_t (*key_fn)(struct Value value, void *data);
+        void *key_data;
+        uint8_t *buffer;
+        size_t buffer_size;
+        /// min-heap of the sources which have elements left
+        struct MergeSource heap[MERGE_VSR_MAX_SOURCES];
+        size_t heap_size;
+        /// set when a source failed
+        bool io_error;
+};
+
+/**
+ * Stream of the elements a transducer produces from the elements of its
+ * source, which it pulls as it goes.
+ *
+ * Each refill feeds the transducer about as many elements as the buffer
+ * holds, the buffer growing when stages produce more elements than they
+ * receive. Elements the transducer produces with another type tag or
+ * element size than the previous ones come with the next refill.
+ */
+struct EductionValueStreamRange
+{
+        struct ValueStreamRange super;
+        struct ValueStreamRange *source;
+        struct Allocator *allocator;
+        struct Reducer *reducer;
+        void *state;
+        struct Value result;
+        uint8_t *buffer;
+        size_t buffer_size;
+        /// bytes a refill aims for
+        size_t fill_size;
+        /// bytes of runs of elements in the buffer
+        size_t used;
+        /// offset of the run the reduction appends to
+        size_t last_run;
+        /// offset of the next run to hand out
+        size_t next_run;
+        /// set once the reduction is complete
+        bool completed;
+        /// error to end with once the buffer is exhausted
+        enum StreamErrorCode end_error;
+};
+
+/// longest token a TextValueStreamRange parses
+#define TEXT_VSR_MAX_TOKEN_SIZE 64
+
+/**
+ * Stream of the numbers written as text in a byte stream, separated by a
+ * delimiter or by newlines.
+ *
+ * Numbers are parsed straight from the buffers of the source into a
+ * buffer owned by the caller. Only a token a refill of the source splits
+ * is copied, into token.
+ */
+struct TextValueStreamRange
+{
+        struct ValueStreamRange super;
+        struct StreamRange *source;
+        uint8_t delimiter;
+        uint8_t *buffer;
+        size_t buffer_size;
+        /// start of the token at the end of the previous buffer of source
+        char token[TEXT_VSR_MAX_TOKEN_SIZE];
+        size_t token_size;
+        /// delimiters among the 64 bytes of source from mask_base, which
+        /// is NULL when they were not scanned yet
+        uint64_t mask;
+        uint8_t const *mask_base;
+        /// error to end with once the source ended or a token was invalid
+        enum StreamErrorCode end_error;
+        bool ended;
+};
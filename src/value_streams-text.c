@@ -0,0 +1,436 @@
+#include "kernel_dispatch.h"
+#include "stream_types.h"
+#include "value_stream_types.h"
+#include "value_streams.h"
+#include "values.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of bytes the kernels scan for delimiters at once */
+#define TEXT_BLOCK_SIZE 64
+
+struct TextKernels
+{
+        /// bit i set when byte i of block is delimiter or a newline
+        uint64_t (*delimiters)(uint8_t const *block, uint8_t delimiter);
+};
+
+static uint64_t scalarDelimiters(uint8_t const *block, uint8_t delimiter)
+{
+        uint64_t mask = 0;
+        for (size_t i = 0; i < TEXT_BLOCK_SIZE; i++) {
+                mask |= (uint64_t)(block[i] == delimiter || block[i] == '\n')
+                        << i;
+        }
+        return mask;
+}
+
+static struct TextKernels const scalarKernels = {
+    .delimiters = scalarDelimiters,
+};
+
+#if defined(KERNELS_X86)
+
+TARGET("sse2")
+static uint64_t sse2Delimiters(uint8_t const *block, uint8_t delimiter)
+{
+        __m128i const delimiters = _mm_set1_epi8((char)delimiter);
+        __m128i const newlines = _mm_set1_epi8('\n');
+        uint64_t mask = 0;
+        for (size_t i = 0; i < TEXT_BLOCK_SIZE; i += 16) {
+                __m128i const bytes =
+                    _mm_loadu_si128((__m128i const *)(block + i));
+                __m128i const found =
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, delimiters),
+                                 _mm_cmpeq_epi8(bytes, newlines));
+                mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(found) << i;
+        }
+        return mask;
+}
+
+static struct TextKernels const sse2Kernels = {
+    .delimiters = sse2Delimiters,
+};
+
+TARGET("avx2")
+static uint64_t avx2Delimiters(uint8_t const *block, uint8_t delimiter)
+{
+        __m256i const delimiters = _mm256_set1_epi8((char)delimiter);
+        __m256i const newlines = _mm256_set1_epi8('\n');
+        uint64_t mask = 0;
+        for (size_t i = 0; i < TEXT_BLOCK_SIZE; i += 32) {
+                __m256i const bytes =
+                    _mm256_loadu_si256((__m256i const *)(block + i));
+                __m256i const found =
+                    _mm256_or_si256(_mm256_cmpeq_epi8(bytes, delimiters),
+                                    _mm256_cmpeq_epi8(bytes, newlines));
+                mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(found) << i;
+        }
+        return mask;
+}
+
+static struct TextKernels const avx2Kernels = {
+    .delimiters = avx2Delimiters,
+};
+
+#endif
+
+static void const *selectKernels(enum KernelLevel level)
+{
+#if defined(KERNELS_X86)
+        if (level == KL_AVX2) {
+                return &avx2Kernels;
+        }
+        if (level == KL_SSE2) {
+                return &sse2Kernels;
+        }
+#endif
+        return &scalarKernels;
+}
+
+static struct TextKernels const *textKernels(void)
+{
+        static struct KernelDispatch dispatch = {.select = selectKernels};
+        return dispatchKernels(&dispatch);
+}
+
+/* first delimiter or newline of [first, last), or last, scanning a block
+ * at a time and keeping the delimiters of the last block for the tokens
+ * that follow within it */
+static uint8_t const *textFindDelimiter(struct TextValueStreamRange *self,
+                                        uint8_t const *first,
+                                        uint8_t const *last)
+{
+        while (first < last) {
+                if (self->mask_base && first >= self->mask_base &&
+                    first < self->mask_base + TEXT_BLOCK_SIZE) {
+                        uint64_t const mask =
+                            self->mask >> (first - self->mask_base)
+                                       << (first - self->mask_base);
+                        if (mask) {
+                                return self->mask_base +
+                                       __builtin_ctzll(mask);
+                        }
+                        first = self->mask_base + TEXT_BLOCK_SIZE;
+                        continue;
+                }
+                if (last - first < TEXT_BLOCK_SIZE) {
+                        break;
+                }
+                self->mask_base = first;
+                self->mask = textKernels()->delimiters(first, self->delimiter);
+        }
+
+        while (first < last && *first != self->delimiter && *first != '\n') {
+                first++;
+        }
+        return first < last ? first : last;
+}
+
+static bool textIsSpace(char c)
+{
+        return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* [-+]digits */
+static bool textParseInt64(char const *first, char const *last,
+                           int64_t *result)
+{
+        bool const negative = first < last && *first == '-';
+        first += first < last && (*first == '-' || *first == '+');
+        if (first == last) {
+                return false;
+        }
+
+        uint64_t const limit = (uint64_t)INT64_MAX + negative;
+        uint64_t magnitude = 0;
+        for (; first < last; first++) {
+                unsigned const digit = (unsigned)(*first - '0');
+                if (digit > 9 || magnitude > (limit - digit) / 10) {
+                        return false;
+                }
+                magnitude = 10 * magnitude + digit;
+        }
+
+        *result = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+        return true;
+}
+
+/*
+ * [-+]digits[.digits] whose digits make an integer mantissa small enough
+ * to be exact in floating point, as is the power of ten dividing it, in
+ * which case the division rounds correctly.
+ */
+static bool textParseDecimal(char const *first, char const *last,
+                             uint64_t *mantissa, unsigned *decimals,
+                             bool *negative)
+{
+        *negative = first < last && *first == '-';
+        first += first < last && (*first == '-' || *first == '+');
+
+        uint64_t value = 0;
+        unsigned digits = 0;
+        int point = -1;
+        for (; first < last; first++) {
+                if (*first == '.' && point < 0) {
+                        point = (int)digits;
+                        continue;
+                }
+                unsigned const digit = (unsigned)(*first - '0');
+                if (digit > 9 || digits == 19) {
+                        return false;
+                }
+                value = 10 * value + digit;
+                digits++;
+        }
+
+        *mantissa = value;
+        *decimals = point < 0 ? 0 : digits - (unsigned)point;
+        return digits > 0;
+}
+
+/* other numbers go through strtod, on a terminated copy */
+static bool textParseDouble(char const *first, char const *last,
+                            double *result)
+{
+        static double const powers[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        uint64_t mantissa;
+        unsigned decimals;
+        bool negative;
+        if (textParseDecimal(first, last, &mantissa, &decimals, &negative) &&
+            mantissa <= (uint64_t)1 << 53 && decimals <= 22) {
+                double const value = (double)mantissa / powers[decimals];
+                *result = negative ? -value : value;
+                return true;
+        }
+
+        char copy[TEXT_VSR_MAX_TOKEN_SIZE + 1];
+        size_t const size = (size_t)(last - first);
+        memcpy(copy, first, size);
+        copy[size] = '\0';
+        char *end;
+        *result = strtod(copy, &end);
+        return size > 0 && end == copy + size;
+}
+
+static bool textParseFloat(char const *first, char const *last,
+                           float *result)
+{
+        static float const powers[] = {
+            1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+        };
+        uint64_t mantissa;
+        unsigned decimals;
+        bool negative;
+        if (textParseDecimal(first, last, &mantissa, &decimals, &negative) &&
+            mantissa <= (uint64_t)1 << 24 && decimals <= 10) {
+                float const value = (float)mantissa / powers[decimals];
+                *result = negative ? -value : value;
+                return true;
+        }
+
+        char copy[TEXT_VSR_MAX_TOKEN_SIZE + 1];
+        size_t const size = (size_t)(last - first);
+        memcpy(copy, first, size);
+        copy[size] = '\0';
+        char *end;
+        *result = strtof(copy, &end);
+        return size > 0 && end == copy + size;
+}
+
+/* writes the number of [first, last) as an element at output, returns
+ * false when it is not one */
+static bool textParse(int type_tag, char const *first, char const *last,
+                      uint8_t *output)
+{
+        while (first < last && textIsSpace(*first)) {
+                first++;
+        }
+        while (first < last && textIsSpace(last[-1])) {
+                last--;
+        }
+        if (last - first > TEXT_VSR_MAX_TOKEN_SIZE) {
+                return false;
+        }
+
+        switch (type_tag) {
+        case TTAG_FLOAT: {
+                float value;
+                bool const parsed = textParseFloat(first, last, &value);
+                memcpy(output, &value, sizeof value);
+                return parsed;
+        }
+        case TTAG_DOUBLE: {
+                double value;
+                bool const parsed = textParseDouble(first, last, &value);
+                memcpy(output, &value, sizeof value);
+                return parsed;
+        }
+        case TTAG_INT64: {
+                int64_t value;
+                bool const parsed = textParseInt64(first, last, &value);
+                memcpy(output, &value, sizeof value);
+                return parsed;
+        }
+        case TTAG_INT32: {
+                int64_t value;
+                bool const parsed = textParseInt64(first, last, &value) &&
+                                    value >= INT32_MIN && value <= INT32_MAX;
+                int32_t const narrowed = parsed ? (int32_t)value : 0;
+                memcpy(output, &narrowed, sizeof narrowed);
+                return parsed;
+        }
+        }
+        return false;
+}
+
+static bool textIsBlank(char const *first, char const *last)
+{
+        while (first < last && textIsSpace(*first)) {
+                first++;
+        }
+        return first == last;
+}
+
+/* parses the token, unless blank, into the next element of the buffer */
+static bool textEmit(struct TextValueStreamRange *self, char const *first,
+                     char const *last, size_t *count)
+{
+        if (textIsBlank(first, last)) {
+                return true;
+        }
+        if (!textParse(self->super.type_tag, first, last,
+                       self->buffer + *count * self->super.element_size)) {
+                self->end_error = S_IOError;
+                self->ended = true;
+                return false;
+        }
+        (*count)++;
+        return true;
+}
+
+/* keeps the bytes of a token the end of the buffer of source splits */
+static bool textCarry(struct TextValueStreamRange *self, uint8_t const *first,
+                      uint8_t const *last)
+{
+        size_t const size = (size_t)(last - first);
+        if (self->token_size + size > TEXT_VSR_MAX_TOKEN_SIZE) {
+                if (textIsBlank((char const *)first, (char const *)last)) {
+                        return true;
+                }
+                self->end_error = S_IOError;
+                self->ended = true;
+                return false;
+        }
+        memcpy(self->token + self->token_size, first, size);
+        self->token_size += size;
+        return true;
+}
+
+/* parses tokens until the buffer is full or the source ends */
+static enum StreamErrorCode textNext(struct ValueStreamRange *range)
+{
+        struct TextValueStreamRange *self =
+            (struct TextValueStreamRange *)range;
+        struct StreamRange *source = self->source;
+        size_t const capacity = self->buffer_size / range->element_size;
+        size_t count = 0;
+
+        while (count < capacity && !self->ended) {
+                if (source->cursor == source->end) {
+                        self->mask_base = NULL;
+                        if (source->error == S_NoError) {
+                                source->next(source);
+                        }
+                        if (source->error != S_NoError) {
+                                /* the last token needs no delimiter */
+                                self->ended = true;
+                                if (source->error == S_IOError) {
+                                        self->end_error = S_IOError;
+                                } else if (!textEmit(self, self->token,
+                                                     self->token +
+                                                         self->token_size,
+                                                     &count)) {
+                                        break;
+                                }
+                                self->token_size = 0;
+                        }
+                        continue;
+                }
+
+                uint8_t const *delimiter =
+                    textFindDelimiter(self, source->cursor, source->end);
+                if (delimiter == source->end) {
+                        if (!textCarry(self, source->cursor, source->end)) {
+                                break;
+                        }
+                        source->cursor = source->end;
+                        continue;
+                }
+
+                bool emitted;
+                if (self->token_size > 0) {
+                        emitted = textCarry(self, source->cursor, delimiter) &&
+                                  textEmit(self, self->token,
+                                           self->token + self->token_size,
+                                           &count);
+                        self->token_size = 0;
+                } else {
+                        emitted = textEmit(self, (char const *)source->cursor,
+                                           (char const *)delimiter, &count);
+                }
+                source->cursor = delimiter + 1;
+                if (!emitted) {
+                        break;
+                }
+        }
+
+        if (count == 0) {
+                return failVSR(range, self->end_error);
+        }
+        range->start = self->buffer;
+        range->cursor = self->buffer;
+        range->end = self->buffer + count * range->element_size;
+
+        return range->error;
+}
+
+void textVSR(struct TextValueStreamRange *range, int type_tag,
+             char delimiter, struct StreamRange *source, uint8_t *buffer,
+             size_t buffer_size)
+{
+        size_t const elementSize = typeTagSize((uint32_t)type_tag);
+
+        *range = (struct TextValueStreamRange){
+            .super =
+                {
+                    .type_tag = type_tag,
+                    .element_size = elementSize,
+                    .start = buffer,
+                    .end = buffer,
+                    .cursor = buffer,
+                    .error = S_NoError,
+                    .next = textNext,
+                },
+            .source = source,
+            .delimiter = (uint8_t)delimiter,
+            .buffer = buffer,
+            .buffer_size = buffer_size,
+            .end_error = S_ReadPastEnd,
+        };
+        if ((type_tag != TTAG_FLOAT && type_tag != TTAG_DOUBLE &&
+             type_tag != TTAG_INT64 && type_tag != TTAG_INT32) ||
+            buffer_size < elementSize) {
+                failVSR(&range->super, S_IOError);
+                return;
+        }
+
+        range->super.next(&range->super);
+}
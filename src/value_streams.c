@@ -1,7 +1,19 @@
+#define _DEFAULT_SOURCE
+
+#include "allocator.h"
+#include "stream.h"
 #include "stream_types.h"
+#include "transducer_types.h"
+#include "transducers.h"
 #include "value_stream_types.h"
+#include "value_streams.h"
 #include "values.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 static enum StreamErrorCode zerosVSRNext(struct ValueStreamRange *range)
 {
         static uint8_t const zeros[256] = {0};
@@ -15,27 +27,762 @@ static enum StreamErrorCode zerosVSRNext(struct ValueStreamRange *range)
         return range->error;
 }
 
-static enum StreamErrorCode failVSR(struct ValueStreamRange *range,
-                                    enum StreamErrorCode error)
+enum StreamErrorCode failVSR(struct ValueStreamRange *range,
+                             enum StreamErrorCode error)
 {
         range->error = error;
         range->next = zerosVSRNext;
         return range->next(range);
 }
 
-static enum StreamErrorCode floatArrayNext(struct ValueStreamRange *range)
+static enum StreamErrorCode arrayNext(struct ValueStreamRange *range)
 {
         return failVSR(range, S_ReadPastEnd);
 }
 
+static void arrayVSR(struct ValueStreamRange *range, int type_tag,
+                     size_t element_size, void const *values, size_t count)
+{
+        range->type_tag = type_tag;
+        range->element_size = element_size;
+        range->start = values;
+        range->cursor = values;
+        range->end = (uint8_t const *)values + count * element_size;
+        range->error = S_NoError;
+        range->next = arrayNext;
+}
+
 void floatArrayVSR(struct ValueStreamRange *range, float const *values,
                    size_t count)
 {
-        range->type_tag = TTAG_FLOAT;
-        range->element_size = sizeof(float);
-        range->start = (uint8_t *)values;
-        range->cursor = (uint8_t *)values;
-        range->end = (uint8_t *)(values + count);
-        range->error = S_NoError;
-        range->next = floatArrayNext;
+        arrayVSR(range, TTAG_FLOAT, sizeof *values, values, count);
+}
+
+void doubleArrayVSR(struct ValueStreamRange *range, double const *values,
+                    size_t count)
+{
+        arrayVSR(range, TTAG_DOUBLE, sizeof *values, values, count);
+}
+
+void int64ArrayVSR(struct ValueStreamRange *range, int64_t const *values,
+                   size_t count)
+{
+        arrayVSR(range, TTAG_INT64, sizeof *values, values, count);
+}
+
+void int32ArrayVSR(struct ValueStreamRange *range, int32_t const *values,
+                   size_t count)
+{
+        arrayVSR(range, TTAG_INT32, sizeof *values, values, count);
+}
+
+void int16ArrayVSR(struct ValueStreamRange *range, int16_t const *values,
+                   size_t count)
+{
+        arrayVSR(range, TTAG_INT16, sizeof *values, values, count);
+}
+
+void uint8ArrayVSR(struct ValueStreamRange *range, uint8_t const *values,
+                   size_t count)
+{
+        arrayVSR(range, TTAG_UINT8, sizeof *values, values, count);
+}
+
+void recordArrayVSR(struct ValueStreamRange *range, void const *records,
+                    size_t record_size, size_t count)
+{
+        arrayVSR(range, TTAG_RECORD, record_size, records, count);
+}
+
+static enum StreamErrorCode fileNext(struct ValueStreamRange *range)
+{
+        struct FileValueStreamRange *self = (struct FileValueStreamRange *)range;
+        size_t const elementSize = range->element_size;
+
+        memmove(self->buffer, range->end, self->tail_size);
+        size_t size = self->tail_size;
+        while (size < elementSize) {
+                ssize_t count = read(self->fd, self->buffer + size,
+                                     self->buffer_size - size);
+                if (count < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (count == 0) {
+                        return failVSR(range, S_ReadPastEnd);
+                }
+                if (count < 0) {
+                        return failVSR(range, S_IOError);
+                }
+                size += (size_t)count;
+        }
+
+        self->tail_size = size % elementSize;
+        range->start = self->buffer;
+        range->cursor = self->buffer;
+        range->end = self->buffer + (size - self->tail_size);
+
+        return range->error;
+}
+
+void fileVSR(struct FileValueStreamRange *range, int type_tag,
+             size_t element_size, int fd, uint8_t *buffer, size_t buffer_size)
+{
+        *range = (struct FileValueStreamRange){
+            .super =
+                {
+                    .type_tag = type_tag,
+                    .element_size = element_size,
+                    .start = buffer,
+                    .end = buffer,
+                    .cursor = buffer,
+                    .error = S_NoError,
+                    .next = fileNext,
+                },
+            .fd = fd,
+            .buffer = buffer,
+            .buffer_size = buffer_size,
+        };
+        if (element_size == 0 || buffer_size < element_size) {
+                failVSR(&range->super, S_IOError);
+                return;
+        }
+
+        range->super.next(&range->super);
+}
+
+static enum StreamErrorCode mappedFileNext(struct ValueStreamRange *range)
+{
+        struct MappedFileValueStreamRange *self =
+            (struct MappedFileValueStreamRange *)range;
+        uint8_t const *mapping = self->file.mapping;
+        size_t const elementsSize =
+            self->file.size - self->file.size % range->element_size;
+        size_t const offset = (size_t)(range->end - mapping);
+
+        if (offset >= elementsSize) {
+                return failVSR(range, S_ReadPastEnd);
+        }
+
+        size_t const size = elementsSize - offset < self->window_size
+                                ? elementsSize - offset
+                                : self->window_size;
+        range->start = range->end;
+        range->cursor = range->start;
+        range->end = range->start + size;
+
+        /* madvise wants page aligned addresses */
+        size_t const pageOffset = (offset + size) % self->file.window_size;
+        if (offset + size < elementsSize) {
+                madvise((void *)(range->end - pageOffset),
+                        self->file.window_size, MADV_WILLNEED);
+        }
+        if (offset >= self->file.window_size) {
+                size_t const previous = offset - offset % self->file.window_size;
+                madvise((void *)(mapping + previous - self->file.window_size),
+                        self->file.window_size, MADV_DONTNEED);
+        }
+
+        return range->error;
+}
+
+int mappedFileVSR(struct MappedFileValueStreamRange *range, int type_tag,
+                  size_t element_size, int fd, size_t window_size)
+{
+        *range = (struct MappedFileValueStreamRange){
+            .super =
+                {
+                    .type_tag = type_tag,
+                    .element_size = element_size,
+                    .error = S_NoError,
+                    .next = mappedFileNext,
+                },
+        };
+
+        if (element_size == 0 ||
+            0 != stream_on_mapped_file(&range->file, fd, window_size)) {
+                failVSR(&range->super, S_IOError);
+                return -1;
+        }
+
+        /* windows of whole elements, at least one */
+        range->window_size = range->file.window_size -
+                             range->file.window_size % element_size;
+        if (range->window_size == 0) {
+                range->window_size = element_size;
+        }
+        range->super.start = range->file.mapping;
+        range->super.cursor = range->file.mapping;
+        range->super.end = range->file.mapping;
+        if (!range->file.mapping) {
+                failVSR(&range->super, S_ReadPastEnd);
+                return 0;
+        }
+
+        range->super.next(&range->super);
+
+        return 0;
+}
+
+void unmapFileVSR(struct MappedFileValueStreamRange *range)
+{
+        stream_unmap_file(&range->file);
+}
+
+/* calls next until source has elements, returns false once it ended */
+static bool sourceHasElements(struct ValueStreamRange *source)
+{
+        while (source->cursor == source->end && source->error == S_NoError) {
+                source->next(source);
+        }
+        return source->error == S_NoError;
+}
+
+/* fills the buffer a source at a time, each source writing its elements
+ * at their aligned offset within the tuples */
+static enum StreamErrorCode zipNext(struct ValueStreamRange *range)
+{
+        struct ZipValueStreamRange *self = (struct ZipValueStreamRange *)range;
+        size_t const tupleSize = range->element_size;
+        size_t count = self->buffer_size / tupleSize;
+        enum StreamErrorCode error = S_ReadPastEnd;
+        size_t offset = 0;
+
+        for (size_t k = 0; k < self->sources_count && count > 0; k++) {
+                struct ValueStreamRange *source = self->sources[k];
+                size_t const elementSize = source->element_size;
+                size_t filled = 0;
+                offset = tupleFieldOffset(offset, elementSize);
+                while (filled < count) {
+                        if (!sourceHasElements(source)) {
+                                error = source->error;
+                                count = filled;
+                                break;
+                        }
+                        size_t n = (size_t)(source->end - source->cursor) /
+                                   elementSize;
+                        n = n < count - filled ? n : count - filled;
+                        uint8_t *tuple =
+                            self->buffer + filled * tupleSize + offset;
+                        for (size_t i = 0; i < n; i++) {
+                                memcpy(tuple, source->cursor, elementSize);
+                                tuple += tupleSize;
+                                source->cursor += elementSize;
+                        }
+                        filled += n;
+                }
+                offset += elementSize;
+        }
+
+        if (count == 0) {
+                return failVSR(range, error);
+        }
+        range->start = self->buffer;
+        range->cursor = self->buffer;
+        range->end = self->buffer + count * tupleSize;
+
+        return range->error;
+}
+
+void zipVSR(struct ZipValueStreamRange *range,
+            struct ValueStreamRange **sources, size_t sources_count,
+            uint8_t *buffer, size_t buffer_size)
+{
+        size_t tupleSize = 0;
+        size_t tupleAlignment = 1;
+        bool valid = sources_count > 0;
+        for (size_t k = 0; k < sources_count; k++) {
+                size_t const elementSize = sources[k]->element_size;
+                size_t const alignment = tupleFieldAlignment(elementSize);
+                tupleSize = tupleFieldOffset(tupleSize, elementSize) +
+                            elementSize;
+                tupleAlignment =
+                    alignment > tupleAlignment ? alignment : tupleAlignment;
+                valid = valid && elementSize > 0;
+        }
+        tupleSize = (tupleSize + tupleAlignment - 1) / tupleAlignment *
+                    tupleAlignment;
+
+        *range = (struct ZipValueStreamRange){
+            .super =
+                {
+                    .type_tag = TTAG_TUPLE,
+                    .element_size = tupleSize,
+                    .start = buffer,
+                    .end = buffer,
+                    .cursor = buffer,
+                    .error = S_NoError,
+                    .next = zipNext,
+                },
+            .sources = sources,
+            .sources_count = sources_count,
+            .buffer = buffer,
+            .buffer_size = buffer_size,
+        };
+        if (!valid || buffer_size < tupleSize) {
+                failVSR(&range->super, S_IOError);
+                return;
+        }
+
+        range->super.next(&range->super);
+}
+
+static int64_t mergeKey(struct MergeValueStreamRange const *self,
+                        struct ValueStreamRange const *source,
+                        uint8_t const *element)
+{
+        struct Value const value = {
+            .type_tag = source->type_tag,
+            .element_size = source->element_size,
+            .address = element,
+        };
+        return self->key_fn(value, self->key_data);
+}
+
+static bool mergeSourcePrecedes(struct MergeSource a, struct MergeSource b)
+{
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+}
+
+static void mergeSiftDown(struct MergeValueStreamRange *self, size_t i)
+{
+        struct MergeSource *heap = self->heap;
+        size_t const size = self->heap_size;
+        for (;;) {
+                size_t first = i;
+                size_t const left = 2 * i + 1;
+                size_t const right = left + 1;
+                if (left < size &&
+                    mergeSourcePrecedes(heap[left], heap[first])) {
+                        first = left;
+                }
+                if (right < size &&
+                    mergeSourcePrecedes(heap[right], heap[first])) {
+                        first = right;
+                }
+                if (first == i) {
+                        return;
+                }
+                struct MergeSource const source = heap[i];
+                heap[i] = heap[first];
+                heap[first] = source;
+                i = first;
+        }
+}
+
+/* copies from the first source the run of elements which come before the
+ * next element of any other source, so that the heap is only updated once
+ * per run rather than once per element */
+static enum StreamErrorCode mergeNext(struct ValueStreamRange *range)
+{
+        struct MergeValueStreamRange *self =
+            (struct MergeValueStreamRange *)range;
+        size_t const elementSize = range->element_size;
+        struct MergeSource *heap = self->heap;
+        uint8_t *output = self->buffer;
+        uint8_t *const outputEnd =
+            self->buffer + self->buffer_size - self->buffer_size % elementSize;
+
+        while (output < outputEnd && self->heap_size > 0) {
+                struct MergeSource *top = &heap[0];
+                struct ValueStreamRange *source = self->sources[top->index];
+                struct MergeSource const *bound = NULL;
+                if (self->heap_size > 1) {
+                        bound = &heap[1];
+                }
+                if (self->heap_size > 2 &&
+                    mergeSourcePrecedes(heap[2], heap[1])) {
+                        bound = &heap[2];
+                }
+
+                uint8_t const *first = source->cursor;
+                uint8_t const *last = first + elementSize;
+                struct MergeSource next = {.index = top->index};
+                bool hasNext = false;
+                while (last < source->end &&
+                       (size_t)(outputEnd - output) >
+                           (size_t)(last - first)) {
+                        next.key = mergeKey(self, source, last);
+                        hasNext = true;
+                        if (bound && !mergeSourcePrecedes(next, *bound)) {
+                                break;
+                        }
+                        last += elementSize;
+                        hasNext = false;
+                }
+                memcpy(output, first, (size_t)(last - first));
+                output += last - first;
+                source->cursor = last;
+
+                if (hasNext) {
+                        top->key = next.key;
+                } else if (sourceHasElements(source)) {
+                        top->key = mergeKey(self, source, source->cursor);
+                } else {
+                        self->io_error |= source->error == S_IOError;
+                        heap[0] = heap[--self->heap_size];
+                }
+                mergeSiftDown(self, 0);
+        }
+
+        if (output == self->buffer) {
+                return failVSR(range,
+                               self->io_error ? S_IOError : S_ReadPastEnd);
+        }
+        range->start = self->buffer;
+        range->cursor = self->buffer;
+        range->end = output;
+
+        return range->error;
+}
+
+void mergeVSR(struct MergeValueStreamRange *range,
+              struct ValueStreamRange **sources, size_t sources_count,
+              int64_t (*key_fn)(struct Value value, void *data),
+              void *key_data, uint8_t *buffer, size_t buffer_size)
+{
+        *range = (struct MergeValueStreamRange){
+            .super =
+                {
+                    .type_tag = sources_count ? sources[0]->type_tag : 0,
+                    .element_size =
+                        sources_count ? sources[0]->element_size : 0,
+                    .start = buffer,
+                    .end = buffer,
+                    .cursor = buffer,
+                    .error = S_NoError,
+                    .next = mergeNext,
+                },
+            .sources = sources,
+            .key_fn = key_fn,
+            .key_data = key_data,
+            .buffer = buffer,
+            .buffer_size = buffer_size,
+        };
+
+        bool valid = sources_count > 0 &&
+                     sources_count <= MERGE_VSR_MAX_SOURCES &&
+                     range->super.element_size > 0 &&
+                     buffer_size >= range->super.element_size;
+        for (size_t k = 0; valid && k < sources_count; k++) {
+                valid = sources[k]->type_tag == range->super.type_tag &&
+                        sources[k]->element_size == range->super.element_size;
+        }
+        if (!valid) {
+                failVSR(&range->super, S_IOError);
+                return;
+        }
+
+        for (size_t k = 0; k < sources_count; k++) {
+                struct ValueStreamRange *source = sources[k];
+                if (!sourceHasElements(source)) {
+                        range->io_error |= source->error == S_IOError;
+                        continue;
+                }
+                range->heap[range->heap_size++] = (struct MergeSource){
+                    .key = mergeKey(range, source, source->cursor),
+                    .index = k,
+                };
+        }
+        for (size_t i = range->heap_size / 2; i-- > 0;) {
+                mergeSiftDown(range, i);
+        }
+
+        range->super.next(&range->super);
+}
+
+/*
+ * Run of elements of one type in the buffer of an eduction, followed by
+ * its elements. Runs start at offsets aligned like states.
+ */
+struct EductionRun
+{
+        uint32_t type_tag;
+        size_t element_size;
+        size_t count;
+};
+
+/* last step of the reduction of an eduction, appending to its buffer */
+struct EductionReducer
+{
+        struct Reducer super;
+        struct EductionValueStreamRange *range;
+};
+
+static size_t eductionRunHeaderSize(void)
+{
+        return reducer_state_align(sizeof(struct EductionRun));
+}
+
+/* grows the buffer so that it holds size bytes, keeping the runs */
+static void eductionReserve(struct EductionValueStreamRange *self, size_t size)
+{
+        if (size <= self->buffer_size) {
+                return;
+        }
+
+        size_t const capacity =
+            2 * self->buffer_size > size ? 2 * self->buffer_size : size;
+        uint8_t *buffer = allocator_alloc(self->allocator, capacity);
+        memcpy(buffer, self->buffer, self->used);
+        allocator_free(self->allocator, self->buffer);
+        self->buffer = buffer;
+        self->buffer_size = capacity;
+}
+
+static void eductionAppend(struct EductionValueStreamRange *self,
+                           uint32_t type_tag, size_t element_size,
+                           void const *elements, size_t count)
+{
+        if (count == 0 || element_size == 0) {
+                return;
+        }
+
+        struct EductionRun *run =
+            (struct EductionRun *)(self->buffer + self->last_run);
+        if (self->used == 0 || run->type_tag != type_tag ||
+            run->element_size != element_size) {
+                size_t const offset = reducer_state_align(self->used);
+                eductionReserve(self, offset + eductionRunHeaderSize());
+                self->last_run = offset;
+                self->used = offset + eductionRunHeaderSize();
+                run = (struct EductionRun *)(self->buffer + offset);
+                *run = (struct EductionRun){
+                    .type_tag = type_tag, .element_size = element_size,
+                };
+        }
+
+        size_t const size = count * element_size;
+        eductionReserve(self, self->used + size);
+        memcpy(self->buffer + self->used, elements, size);
+        self->used += size;
+        ((struct EductionRun *)(self->buffer + self->last_run))->count +=
+            count;
+}
+
+static struct Value eductionReducerApply(struct Reducer const *reducer,
+                                         void *state, struct Value input,
+                                         struct Value current,
+                                         struct Allocator *allocator)
+{
+        struct EductionReducer const *self =
+            (struct EductionReducer const *)reducer;
+
+        if (isArrayValue(input)) {
+                struct ValueSpan const span = spanOfArrayValue(input);
+                eductionAppend(self->range, span.type_tag, span.element_size,
+                               span.first, arrayCount(input));
+        } else {
+                eductionAppend(self->range, input.type_tag, input.element_size,
+                               valueAddress(&input), 1);
+        }
+
+        return current;
+}
+
+static struct Value eductionReducerApplyBatch(struct Reducer const *reducer,
+                                              void *state,
+                                              struct ValueSpan span,
+                                              struct Value current,
+                                              struct Allocator *allocator)
+{
+        struct EductionReducer const *self =
+            (struct EductionReducer const *)reducer;
+
+        if (span.element_size > 0) {
+                eductionAppend(self->range, span.type_tag, span.element_size,
+                               span.first,
+                               (size_t)(span.last - span.first) /
+                                   span.element_size);
+        }
+
+        return current;
+}
+
+/* feeds the reduction about fill_size bytes of the source, or completes
+ * it once the source ended or the reduction halted */
+static void eductionFill(struct EductionValueStreamRange *self)
+{
+        struct ValueStreamRange *source = self->source;
+
+        self->used = 0;
+        self->next_run = 0;
+        while (!self->completed && self->used < self->fill_size) {
+                if (isReduced(self->result) || !sourceHasElements(source)) {
+                        if (!isReduced(self->result) &&
+                            source->error == S_IOError) {
+                                self->end_error = S_IOError;
+                        }
+                        self->result = reducer_complete(
+                            self->reducer, self->state,
+                            unreducedValue(self->result), self->allocator);
+                        self->completed = true;
+                        break;
+                }
+
+                size_t const elementSize = source->element_size;
+                size_t count = (self->fill_size - self->used) / elementSize;
+                size_t const available =
+                    (size_t)(source->end - source->cursor) / elementSize;
+                count = count == 0 ? 1 : count;
+                count = count < available ? count : available;
+
+                struct ValueSpan const span = {
+                    .type_tag = source->type_tag,
+                    .element_size = elementSize,
+                    .first = source->cursor,
+                    .last = source->cursor + count * elementSize,
+                };
+                source->cursor = span.last;
+                self->result =
+                    reducer_apply_batch(self->reducer, self->state, span,
+                                        self->result, self->allocator);
+        }
+}
+
+/* hands out the runs of the buffer one at a time, refilling it once they
+ * all were */
+static enum StreamErrorCode eductionNext(struct ValueStreamRange *range)
+{
+        struct EductionValueStreamRange *self =
+            (struct EductionValueStreamRange *)range;
+
+        if (self->next_run >= self->used) {
+                eductionFill(self);
+        }
+        if (self->next_run >= self->used) {
+                releaseEductionVSR(self);
+                return failVSR(range, self->end_error);
+        }
+
+        struct EductionRun const *run =
+            (struct EductionRun const *)(self->buffer + self->next_run);
+        range->type_tag = run->type_tag;
+        range->element_size = run->element_size;
+        range->start = (uint8_t const *)run + eductionRunHeaderSize();
+        range->cursor = range->start;
+        range->end = range->start + run->count * run->element_size;
+        self->next_run = reducer_state_align(
+            (size_t)(range->end - self->buffer));
+
+        return range->error;
+}
+
+void eductionVSR(struct EductionValueStreamRange *range,
+                 struct ValueStreamRange *source, struct Transducer *transducer,
+                 size_t buffer_size, struct Allocator *allocator)
+{
+        *range = (struct EductionValueStreamRange){
+            .super =
+                {
+                    .error = S_NoError,
+                    .next = eductionNext,
+                },
+            .source = source,
+            .allocator = allocator,
+            .fill_size = buffer_size,
+            .end_error = S_ReadPastEnd,
+        };
+        if (buffer_size == 0) {
+                failVSR(&range->super, S_IOError);
+                return;
+        }
+
+        struct EductionReducer *step = allocator_alloc(allocator, sizeof *step);
+        *step = (struct EductionReducer){
+            .super =
+                {
+                    .apply = eductionReducerApply,
+                    .apply_batch = eductionReducerApplyBatch,
+                },
+            .range = range,
+        };
+        range->reducer = transducer_apply(transducer, &step->super, allocator);
+        range->state = reducer_new_state(range->reducer, allocator);
+        range->result = reducer_identity(range->reducer, allocator);
+        range->buffer = allocator_alloc(allocator, buffer_size);
+        range->buffer_size = buffer_size;
+
+        range->super.next(&range->super);
+}
+
+/* completes the reduction if needed, so that its stages release what they
+ * hold, dropping the elements it produces */
+void releaseEductionVSR(struct EductionValueStreamRange *range)
+{
+        if (range->state && !range->completed) {
+                range->result = reducer_complete(
+                    range->reducer, range->state,
+                    unreducedValue(range->result), range->allocator);
+                range->completed = true;
+        }
+        if (range->state) {
+                allocator_free(range->allocator, range->state);
+                range->state = NULL;
+        }
+        if (range->buffer) {
+                allocator_free(range->allocator, range->buffer);
+                range->buffer = NULL;
+                range->buffer_size = 0;
+                range->used = 0;
+                range->next_run = 0;
+        }
+}
+
+struct Value reduceStream(struct ValueStreamRange *range,
+                          struct Reducer *reducer, struct Allocator *allocator)
+{
+        void *state = reducer_new_state(reducer, allocator);
+        struct Value result =
+            reduceStreamInState(range, reducer, state, allocator);
+        result = detachValue(result, state, reducer->state_size, allocator);
+        allocator_free(allocator, state);
+
+        return result;
+}
+
+struct Value reduceStreamInState(struct ValueStreamRange *range,
+                                 struct Reducer *reducer, void *state,
+                                 struct Allocator *allocator)
+{
+        struct Value result = reducer_identity(reducer, allocator);
+        while (range->error == S_NoError && !isReduced(result)) {
+                if (range->cursor < range->end) {
+                        struct ValueSpan span = {
+                            .type_tag = range->type_tag,
+                            .element_size = range->element_size,
+                            .first = range->cursor,
+                            .last = range->end,
+                        };
+                        range->cursor = range->end;
+                        result = reducer_apply_batch(reducer, state, span,
+                                                     result, allocator);
+                        continue;
+                }
+                range->next(range);
+        }
+        return reducer_complete(reducer, state, unreducedValue(result),
+                                allocator);
+}
+
+struct Value transduceFloatArray(float const *values, size_t valuesCount,
+                                 struct Transducer *transducer,
+                                 struct Allocator *allocator)
+{
+        struct Reducer *reducer =
+            transducer_apply(transducer, idReducer(allocator), allocator);
+        void *state = reducer_new_state(reducer, allocator);
+        struct Value result = reducer_identity(reducer, allocator);
+        struct ValueSpan span = {
+            .type_tag = TTAG_FLOAT,
+            .element_size = sizeof values[0],
+            .first = (uint8_t const *)values,
+            .last = (uint8_t const *)(values + valuesCount),
+        };
+        result = reducer_apply_batch(reducer, state, span, result, allocator);
+        result = reducer_complete(reducer, state, unreducedValue(result),
+                                  allocator);
+        result = detachValue(result, state, reducer->state_size, allocator);
+        allocator_free(allocator, state);
+
+        return result;
 }
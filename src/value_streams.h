@@ -1,8 +1,136 @@
 #pragma once
 
 struct ValueStreamRange;
+struct FileValueStreamRange;
+struct MappedFileValueStreamRange;
+struct MergeValueStreamRange;
+struct ZipValueStreamRange;
+struct EductionValueStreamRange;
+struct StreamRange;
+struct TextValueStreamRange;
+struct Allocator;
+struct Reducer;
+struct Transducer;
+
+#include "stream_types.h"
+#include "values.h"
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* streams of the elements of an array, of the type of their name */
 
 void floatArrayVSR(struct ValueStreamRange *range, float const *values,
                    size_t count);
+
+void doubleArrayVSR(struct ValueStreamRange *range, double const *values,
+                    size_t count);
+
+void int64ArrayVSR(struct ValueStreamRange *range, int64_t const *values,
+                   size_t count);
+
+void int32ArrayVSR(struct ValueStreamRange *range, int32_t const *values,
+                   size_t count);
+
+void int16ArrayVSR(struct ValueStreamRange *range, int16_t const *values,
+                   size_t count);
+
+void uint8ArrayVSR(struct ValueStreamRange *range, uint8_t const *values,
+                   size_t count);
+
+/// stream of count TTAG_RECORD elements of record_size bytes
+void recordArrayVSR(struct ValueStreamRange *range, void const *records,
+                    size_t record_size, size_t count);
+
+/// reads elements of element_size bytes from fd, buffer_size bytes at a
+/// time, buffer_size >= element_size
+void fileVSR(struct FileValueStreamRange *range, int type_tag,
+             size_t element_size, int fd, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * maps the file fd in memory and hands out its elements about window_size
+ * bytes at a time.
+ *
+ * @return 0 or -1 when the file could not be mapped, in which case the
+ * stream fails with S_IOError.
+ */
+int mappedFileVSR(struct MappedFileValueStreamRange *range, int type_tag,
+                  size_t element_size, int fd, size_t window_size);
+
+void unmapFileVSR(struct MappedFileValueStreamRange *range);
+
+/**
+ * zips sources into a stream of TTAG_TUPLE elements, refilling each source
+ * through its own next() as it runs out.
+ *
+ * buffer_size must hold at least one tuple, the sum of the element sizes
+ * of the sources once aligned, and buffer be aligned for the largest of
+ * them for the fields of the tuples to be. Elements a source handed out
+ * past the end of the shortest one are lost.
+ */
+void zipVSR(struct ZipValueStreamRange *range,
+            struct ValueStreamRange **sources, size_t sources_count,
+            uint8_t *buffer, size_t buffer_size);
+
+/**
+ * merges sources, each sorted by the keys key_fn gives to its elements,
+ * into one stream sorted by key.
+ *
+ * Sources must share their type tag and element size, and be at most
+ * MERGE_VSR_MAX_SOURCES. buffer_size >= their element size.
+ */
+void mergeVSR(struct MergeValueStreamRange *range,
+              struct ValueStreamRange **sources, size_t sources_count,
+              int64_t (*key_fn)(struct Value value, void *data),
+              void *key_data, uint8_t *buffer, size_t buffer_size);
+
+/**
+ * streams the elements transducer produces from those of source, pulling
+ * them only as the stream is read.
+ *
+ * Array values the transducer produces give their elements one after the
+ * other, and the positions of indexed elements are dropped. The buffer
+ * starts with buffer_size bytes and, along with the state of the
+ * reduction, is allocated from allocator. They are released when the
+ * stream ends, or by releaseEductionVSR when it is not read to its end.
+ * The stream ends with S_IOError when source does.
+ */
+void eductionVSR(struct EductionValueStreamRange *range,
+                 struct ValueStreamRange *source, struct Transducer *transducer,
+                 size_t buffer_size, struct Allocator *allocator);
+
+void releaseEductionVSR(struct EductionValueStreamRange *range);
+
+/**
+ * parses the numbers written as text in source, separated by delimiter or
+ * by newlines, into elements of type_tag: TTAG_FLOAT, TTAG_DOUBLE,
+ * TTAG_INT64 or TTAG_INT32.
+ *
+ * Spaces, tabs and carriage returns around numbers are skipped, as are
+ * empty tokens. The stream ends with S_IOError when source does or at the
+ * first token which is not a number of type_tag, or is longer than
+ * TEXT_VSR_MAX_TOKEN_SIZE. buffer_size must hold at least one element.
+ */
+void textVSR(struct TextValueStreamRange *range, int type_tag,
+             char delimiter, struct StreamRange *source, uint8_t *buffer,
+             size_t buffer_size);
+
+/// sets the error of range, from which the implementations of streams hand
+/// out zeros from then on, and returns it
+enum StreamErrorCode failVSR(struct ValueStreamRange *range,
+                             enum StreamErrorCode error);
+
+/// reduces all the elements of range, until it ends or reducer halts
+struct Value reduceStream(struct ValueStreamRange *range,
+                          struct Reducer *reducer, struct Allocator *allocator);
+
+/// like reduceStream, in a state of reducer initialized by reducer_init_state
+/// or reducer_new_state. Allocates nothing by itself
+struct Value reduceStreamInState(struct ValueStreamRange *range,
+                                 struct Reducer *reducer, void *state,
+                                 struct Allocator *allocator);
+
+/// reduces values through transducer, keeping the last value it produced
+struct Value transduceFloatArray(float const *values, size_t valuesCount,
+                                 struct Transducer *transducer,
+                                 struct Allocator *allocator);
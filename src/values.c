@@ -2,9 +2,86 @@
 
 #include "allocator.h"
 
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
 void freeValue(struct Value *value)
 {
+        if (value->flags & (VFLAG_INLINE | VFLAG_INDEXED)) {
+                return;
+        }
+
         allocator_free(value->allocator, (void *)value->address);
         value->address = NULL;
         value->allocator = NULL;
 }
+
+/* the elements follow the payload, aligned for any type */
+struct Value newArrayValue(uint32_t element_type_tag, size_t element_size,
+                           size_t count, struct Allocator *allocator)
+{
+        size_t const alignment = alignof(max_align_t);
+        size_t const offset = (sizeof(struct ArrayPayload) + alignment - 1) /
+                              alignment * alignment;
+        uint8_t *memory =
+            allocator_alloc(allocator, offset + count * element_size);
+        struct ArrayPayload *array = (struct ArrayPayload *)memory;
+
+        *array = (struct ArrayPayload){
+            .count = count,
+            .elements = memory + offset,
+        };
+        struct Value result = arrayValue(element_type_tag, element_size, array);
+        result.allocator = allocator;
+        return result;
+}
+
+static bool isWithin(void const *address, void const *memory, size_t size)
+{
+        uintptr_t const payload = (uintptr_t)address;
+        uintptr_t const first = (uintptr_t)memory;
+        return address && payload >= first && payload - first < size;
+}
+
+struct Value detachValue(struct Value value, void const *memory, size_t size,
+                         struct Allocator *allocator)
+{
+        if (value.flags & VFLAG_INLINE) {
+                return value;
+        }
+
+        if (isArrayValue(value)) {
+                struct ValueSpan const span = spanOfArrayValue(value);
+                if (!isWithin(value.address, memory, size) &&
+                    !isWithin(span.first, memory, size)) {
+                        return value;
+                }
+                struct Value result = newArrayValue(
+                    span.type_tag, span.element_size,
+                    arrayCount(value), allocator);
+                memcpy(arrayElements(result), span.first,
+                       (size_t)(span.last - span.first));
+                result.flags |= value.flags & ~VFLAG_INDEXED;
+                return result;
+        }
+
+        if (!isWithin(value.address, memory, size)) {
+                return value;
+        }
+        if (value.element_size <= VALUE_INLINE_SIZE) {
+                struct Value result = inlineValue(
+                    value.type_tag, value.address, value.element_size);
+                result.flags |= value.flags;
+                result.index = value.index;
+                return result;
+        }
+
+        void *copy = allocator_alloc(allocator, value.element_size);
+        memcpy(copy, value.address, value.element_size);
+        value.flags &= ~VFLAG_INDEXED;
+        value.address = copy;
+        value.allocator = allocator;
+        return value;
+}
@@ -2,20 +2,75 @@
 
 struct Allocator;
 
+#include <assert.h>
+#include <stdalign.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 enum TypeTags {
         TTAG_NULL,
         TTAG_FLOAT,
+        TTAG_DOUBLE,
+        TTAG_INT64,
+        TTAG_INT32,
+        TTAG_INT16,
+        TTAG_UINT8,
+        /// elements of several streams laid out one after the other, each
+        /// at the offset tupleFieldOffset gives it, see zipVSR
+        TTAG_TUPLE,
+        /// elements which are themselves struct Value
+        TTAG_VALUE,
+        /// struct GroupResult, see groupingReducer
+        TTAG_GROUP_RESULT,
+        /// fixed-layout record, described by a struct RecordSchema
+        TTAG_RECORD,
 };
 
+enum ValueFlags {
+        /// the payload is stored in the value itself rather than at address
+        VFLAG_INLINE = 1 << 0,
+        /// the reduction producing this value must stop
+        VFLAG_REDUCED = 1 << 1,
+        /// index holds the position of the value in its stream, in place of
+        /// an allocator: indexed values never own their payload
+        VFLAG_INDEXED = 1 << 2,
+};
+
+/// set in the type tag of values holding an array of elements of the
+/// type of the other bits, see arrayValue
+#define TTAG_ARRAY_OF 0x80000000u
+
+/// largest payload that can be stored inline
+#define VALUE_INLINE_SIZE 8
+
 struct Value
 {
         uint32_t type_tag;
+        uint32_t flags;
         size_t element_size;
-        void const *address;
-        struct Allocator *allocator;
+        union {
+                void const *address;
+                uint8_t inline_bytes[VALUE_INLINE_SIZE];
+                float inline_float;
+                double inline_double;
+                int64_t inline_int;
+        };
+        union {
+                /// owner of the payload at address, if any
+                struct Allocator *allocator;
+                /// position of the value in its stream, when VFLAG_INDEXED
+                /// is set
+                size_t index;
+        };
+};
+
+/// payload of array values, see arrayValue
+struct ArrayPayload
+{
+        size_t count;
+        /// count elements of the element_size of the value
+        void const *elements;
 };
 
 static inline struct Value nullValue()
@@ -23,4 +78,337 @@ static inline struct Value nullValue()
         return (struct Value){.type_tag = TTAG_NULL};
 }
 
+/// value holding a copy of the size bytes at payload, size <=
+/// VALUE_INLINE_SIZE
+static inline struct Value inlineValue(uint32_t type_tag, void const *payload,
+                                       size_t size)
+{
+        struct Value result = {
+            .type_tag = type_tag, .flags = VFLAG_INLINE, .element_size = size,
+        };
+        for (size_t i = 0; i < size && i < VALUE_INLINE_SIZE; i++) {
+                result.inline_bytes[i] = ((uint8_t const *)payload)[i];
+        }
+        return result;
+}
+
+static inline struct Value inlineFloatValue(float f)
+{
+        return (struct Value){
+            .type_tag = TTAG_FLOAT,
+            .flags = VFLAG_INLINE,
+            .element_size = sizeof f,
+            .inline_float = f,
+        };
+}
+
+static inline struct Value inlineDoubleValue(double d)
+{
+        return (struct Value){
+            .type_tag = TTAG_DOUBLE,
+            .flags = VFLAG_INLINE,
+            .element_size = sizeof d,
+            .inline_double = d,
+        };
+}
+
+static inline struct Value inlineInt64Value(int64_t i)
+{
+        return (struct Value){
+            .type_tag = TTAG_INT64,
+            .flags = VFLAG_INLINE,
+            .element_size = sizeof i,
+            .inline_int = i,
+        };
+}
+
+/// size of the elements of the numeric types, 0 for the others
+static inline size_t typeTagSize(uint32_t type_tag)
+{
+        switch (type_tag) {
+        case TTAG_FLOAT:
+                return sizeof(float);
+        case TTAG_DOUBLE:
+                return sizeof(double);
+        case TTAG_INT64:
+                return sizeof(int64_t);
+        case TTAG_INT32:
+                return sizeof(int32_t);
+        case TTAG_INT16:
+                return sizeof(int16_t);
+        case TTAG_UINT8:
+                return sizeof(uint8_t);
+        }
+        return 0;
+}
+
+/// alignment of a field of size bytes of a TTAG_TUPLE element: the largest
+/// power of two dividing size, up to that of max_align_t
+static inline size_t tupleFieldAlignment(size_t size)
+{
+        size_t const alignment = size & (~size + 1);
+        if (alignment == 0 || alignment > alignof(max_align_t)) {
+                return alignof(max_align_t);
+        }
+        return alignment;
+}
+
+/// offset of a field of size bytes following offset bytes of fields in a
+/// TTAG_TUPLE element. The size of the element is rounded up likewise to
+/// the largest alignment of its fields, so that the fields of consecutive
+/// elements stay aligned
+static inline size_t tupleFieldOffset(size_t offset, size_t size)
+{
+        size_t const alignment = tupleFieldAlignment(size);
+        return (offset + alignment - 1) / alignment * alignment;
+}
+
+/// marks the end of a reduction
+static inline struct Value reducedValue(struct Value value)
+{
+        value.flags |= VFLAG_REDUCED;
+        return value;
+}
+
+static inline bool isReduced(struct Value value)
+{
+        return value.flags & VFLAG_REDUCED;
+}
+
+static inline struct Value unreducedValue(struct Value value)
+{
+        value.flags &= ~VFLAG_REDUCED;
+        return value;
+}
+
+/// value carrying its position in a stream, see indexingTransducer; value
+/// must not own its payload
+static inline struct Value indexedValue(struct Value value, size_t index)
+{
+        assert(value.flags & VFLAG_INDEXED || !value.allocator);
+        value.flags |= VFLAG_INDEXED;
+        value.index = index;
+        return value;
+}
+
+static inline bool isIndexed(struct Value value)
+{
+        return value.flags & VFLAG_INDEXED;
+}
+
+/// value referring to the elements of element_size bytes of array, which
+/// it does not own: the array and its elements must outlive it
+static inline struct Value arrayValue(uint32_t element_type_tag,
+                                      size_t element_size,
+                                      struct ArrayPayload const *array)
+{
+        return (struct Value){
+            .type_tag = element_type_tag | TTAG_ARRAY_OF,
+            .element_size = element_size,
+            .address = array,
+        };
+}
+
+static inline bool isArrayValue(struct Value value)
+{
+        return value.type_tag & TTAG_ARRAY_OF;
+}
+
+/// address of the payload, which for inline values lies within value
+static inline void const *valueAddress(struct Value const *value)
+{
+        if (value->flags & VFLAG_INLINE) {
+                return value->inline_bytes;
+        }
+        return value->address;
+}
+
+static inline float floatOfValue(struct Value value)
+{
+        if (value.flags & VFLAG_INLINE) {
+                return value.inline_float;
+        }
+        return *(float const *)value.address;
+}
+
+static inline double doubleOfValue(struct Value value)
+{
+        if (value.flags & VFLAG_INLINE) {
+                return value.inline_double;
+        }
+        return *(double const *)value.address;
+}
+
+static inline int64_t int64OfValue(struct Value value)
+{
+        if (value.flags & VFLAG_INLINE) {
+                return value.inline_int;
+        }
+        return *(int64_t const *)value.address;
+}
+
+/**
+ * contiguous span of homogeneous elements, typically the [cursor, end)
+ * part of a ValueStreamRange.
+ *
+ * elements are only guaranteed to stay valid for the duration of the call
+ * they are passed to.
+ */
+struct ValueSpan
+{
+        uint32_t type_tag;
+        size_t element_size;
+        uint8_t const *first;
+        uint8_t const *last;
+        /// positions of the elements in their stream, or NULL
+        size_t const *indices;
+};
+
+static inline struct Value valueOfSpanElement(struct ValueSpan span,
+                                              uint8_t const *element)
+{
+        struct Value result = {
+            .type_tag = span.type_tag,
+            .element_size = span.element_size,
+            .address = element,
+        };
+        if (span.indices) {
+                result = indexedValue(
+                    result, span.indices[(size_t)(element - span.first) /
+                                         span.element_size]);
+        }
+        return result;
+}
+
+/// elements of which a SpanCursor builds the values at once
+#define SPAN_CURSOR_BLOCK 32
+
+/**
+ * walks the elements of a span as values, see spanCursorNext.
+ *
+ * Values are built a block at a time, well before they are copied into
+ * the calls they are passed to: a value copied right after its fields
+ * were stored one by one waits on those stores.
+ */
+struct SpanCursor
+{
+        struct ValueSpan span;
+        /// value of every element, but for its address and index
+        struct Value model;
+        /// position in span of the element of values[0]
+        size_t position;
+        /// values built, and values already walked
+        size_t count;
+        size_t next;
+        struct Value values[SPAN_CURSOR_BLOCK];
+};
+
+static inline void spanCursorInit(struct SpanCursor *cursor,
+                                  struct ValueSpan span)
+{
+        cursor->span = span;
+        cursor->model = (struct Value){
+            .type_tag = span.type_tag,
+            .flags = span.indices ? VFLAG_INDEXED : 0,
+            .element_size = span.element_size,
+        };
+        cursor->position = 0;
+        cursor->count = 0;
+        cursor->next = 0;
+}
+
+static inline size_t spanCursorFill(struct SpanCursor *cursor)
+{
+        struct ValueSpan const span = cursor->span;
+        size_t const position = cursor->position + cursor->count;
+        size_t const remaining =
+            (size_t)(span.last - span.first) / span.element_size - position;
+        size_t const count =
+            remaining < SPAN_CURSOR_BLOCK ? remaining : SPAN_CURSOR_BLOCK;
+        uint8_t const *element = span.first + position * span.element_size;
+
+        for (size_t i = 0; i < count; i++) {
+                cursor->values[i] = cursor->model;
+                cursor->values[i].address = element + i * span.element_size;
+                if (span.indices) {
+                        cursor->values[i].index = span.indices[position + i];
+                }
+        }
+        cursor->position = position;
+        cursor->count = count;
+        cursor->next = 0;
+
+        return count;
+}
+
+/// value of the next element of the span, or NULL past its last one. It
+/// stays valid until the next call
+static inline struct Value const *spanCursorNext(struct SpanCursor *cursor)
+{
+        if (cursor->next == cursor->count && spanCursorFill(cursor) == 0) {
+                return NULL;
+        }
+        return &cursor->values[cursor->next++];
+}
+
+/// the elements of span within [first, last)
+static inline struct ValueSpan subSpan(struct ValueSpan span,
+                                       uint8_t const *first,
+                                       uint8_t const *last)
+{
+        struct ValueSpan result = span;
+        result.first = first;
+        result.last = last;
+        if (span.indices) {
+                result.indices +=
+                    (size_t)(first - span.first) / span.element_size;
+        }
+        return result;
+}
+
+/// the elements of an array value
+static inline struct ValueSpan spanOfArrayValue(struct Value value)
+{
+        struct ArrayPayload const *array = value.address;
+        uint8_t const *first = array->elements;
+        return (struct ValueSpan){
+            .type_tag = value.type_tag & ~TTAG_ARRAY_OF,
+            .element_size = value.element_size,
+            .first = first,
+            .last = first + array->count * value.element_size,
+        };
+}
+
+/// elements of an array value, which may be written when the value owns
+/// them, see newArrayValue
+static inline void *arrayElements(struct Value value)
+{
+        return (void *)((struct ArrayPayload const *)value.address)->elements;
+}
+
+static inline size_t arrayCount(struct Value value)
+{
+        return ((struct ArrayPayload const *)value.address)->count;
+}
+
+/**
+ * array value of count uninitialized elements, owning a single allocation
+ * from allocator which holds both its payload and the elements.
+ */
+struct Value newArrayValue(uint32_t element_type_tag, size_t element_size,
+                           size_t count, struct Allocator *allocator);
+
 void freeValue(struct Value *value);
+
+/**
+ * value with the payload of value, moved out of the size bytes at memory
+ * when it lies within them, so that it outlives their release: small
+ * payloads are stored inline, others are copied to memory from allocator,
+ * which the result owns. Copies are not indexed, as their owner takes the
+ * place of the index.
+ *
+ * Used on the results of reductions before their state is released, since
+ * results may refer to the elements a stage staged in its state.
+ */
+struct Value detachValue(struct Value value, void const *memory, size_t size,
+                         struct Allocator *allocator);
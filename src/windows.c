@@ -0,0 +1,284 @@
+#include "windows.h"
+
+#include "allocator.h"
+#include "transducer_types.h"
+#include "transducers.h"
+#include "values.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* number of aggregates a window stage produces before forwarding them
+ * downstream */
+#define WINDOW_OUTPUT_SIZE 256
+
+struct FloatWindowTransducer
+{
+        struct Transducer super;
+        enum FloatWindowAggregate aggregate;
+        size_t size;
+        size_t stride;
+};
+
+struct FloatWindowReducer
+{
+        struct ChainedReducer super;
+        enum FloatWindowAggregate aggregate;
+        size_t size;
+        size_t stride;
+        /* offsets of the ring and of the deque within the state */
+        size_t ringOffset;
+        size_t dequeOffset;
+};
+
+/* element of the monotonic deque of the min and max windows */
+struct WindowEntry
+{
+        float value;
+        size_t position;
+};
+
+/*
+ * The state is followed by the ring of the last size floats and, for the
+ * min and max windows, by a deque of size entries.
+ *
+ * The deque holds the elements of the window which may still become its
+ * minimum (resp. maximum): their values increase (resp. decrease) from its
+ * front, which is the aggregate of the window, to its back.
+ */
+struct WindowState
+{
+        /// number of floats received so far
+        size_t seen;
+        /// of the floats in the ring, recomputed every time it wraps around
+        /// so that rounding errors do not pile up
+        double sum;
+        size_t dequeFirst;
+        size_t dequeCount;
+        size_t outputCount;
+        float output[WINDOW_OUTPUT_SIZE];
+};
+
+static float *windowRing(struct FloatWindowReducer const *self, void *state)
+{
+        return (float *)((uint8_t *)state + self->ringOffset);
+}
+
+static struct WindowEntry *windowDeque(struct FloatWindowReducer const *self,
+                                       void *state)
+{
+        return (struct WindowEntry *)((uint8_t *)state + self->dequeOffset);
+}
+
+static bool windowPrecedes(enum FloatWindowAggregate aggregate, float a,
+                           float b)
+{
+        return aggregate == FW_Min ? a < b : a > b;
+}
+
+static void windowDequePush(struct FloatWindowReducer const *self,
+                            struct WindowState *window, float x)
+{
+        struct WindowEntry *deque = windowDeque(self, window);
+        size_t const size = self->size;
+        size_t const position = window->seen;
+
+        /* drop the element leaving the window, then those x supersedes */
+        if (window->dequeCount > 0 &&
+            deque[window->dequeFirst].position + size <= position) {
+                window->dequeFirst = (window->dequeFirst + 1) % size;
+                window->dequeCount--;
+        }
+        while (window->dequeCount > 0) {
+                size_t const back =
+                    (window->dequeFirst + window->dequeCount - 1) % size;
+                if (windowPrecedes(self->aggregate, deque[back].value, x)) {
+                        break;
+                }
+                window->dequeCount--;
+        }
+
+        size_t const end = (window->dequeFirst + window->dequeCount) % size;
+        deque[end] = (struct WindowEntry){.value = x, .position = position};
+        window->dequeCount++;
+}
+
+/* adds x to the window, returns true and sets *aggregate when a window
+ * ends with it */
+static bool windowPush(struct FloatWindowReducer const *self,
+                       struct WindowState *window, float x, float *aggregate)
+{
+        float *ring = windowRing(self, window);
+        size_t const size = self->size;
+        size_t const slot = window->seen % size;
+
+        if (self->aggregate == FW_Min || self->aggregate == FW_Max) {
+                windowDequePush(self, window, x);
+        } else {
+                if (window->seen >= size) {
+                        window->sum -= ring[slot];
+                }
+                window->sum += x;
+        }
+        ring[slot] = x;
+        window->seen++;
+
+        if (slot == size - 1 &&
+            (self->aggregate == FW_Sum || self->aggregate == FW_Mean)) {
+                double sum = 0.0;
+                for (size_t i = 0; i < size; i++) {
+                        sum += ring[i];
+                }
+                window->sum = sum;
+        }
+
+        if (window->seen < size || (window->seen - size) % self->stride != 0) {
+                return false;
+        }
+        switch (self->aggregate) {
+        case FW_Sum:
+                *aggregate = (float)window->sum;
+                break;
+        case FW_Mean:
+                *aggregate = (float)(window->sum / (double)size);
+                break;
+        case FW_Min:
+        case FW_Max: {
+                struct WindowEntry const *deque = windowDeque(self, window);
+                *aggregate = deque[window->dequeFirst].value;
+                break;
+        }
+        }
+        return true;
+}
+
+static struct Value floatWindowReducerApply(struct Reducer const *reducer,
+                                            void *state, struct Value input,
+                                            struct Value current,
+                                            struct Allocator *allocator)
+{
+        struct FloatWindowReducer const *self =
+            (struct FloatWindowReducer const *)reducer;
+        float aggregate;
+
+        if (input.type_tag != TTAG_FLOAT ||
+            !windowPush(self, state, floatOfValue(input), &aggregate)) {
+                return current;
+        }
+
+        return reducer_apply(self->super.step,
+                             chainedStepState(&self->super, state),
+                             inlineFloatValue(aggregate), current, allocator);
+}
+
+static struct Value windowFlush(struct FloatWindowReducer const *self,
+                                struct WindowState *window,
+                                struct Value current,
+                                struct Allocator *allocator)
+{
+        struct ValueSpan const span = {
+            .type_tag = TTAG_FLOAT,
+            .element_size = sizeof(float),
+            .first = (uint8_t const *)window->output,
+            .last = (uint8_t const *)(window->output + window->outputCount),
+        };
+        window->outputCount = 0;
+
+        return reducer_apply_batch(self->super.step,
+                                   chainedStepState(&self->super, window),
+                                   span, current, allocator);
+}
+
+/* gathers the aggregates of the span to forward them as spans, unless
+ * downstream may halt */
+static struct Value floatWindowReducerApplyBatch(struct Reducer const *reducer,
+                                                 void *state,
+                                                 struct ValueSpan span,
+                                                 struct Value current,
+                                                 struct Allocator *allocator)
+{
+        struct FloatWindowReducer const *self =
+            (struct FloatWindowReducer const *)reducer;
+        struct WindowState *window = state;
+
+        if (span.type_tag != TTAG_FLOAT ||
+            span.element_size != sizeof(float) || reducer->may_halt) {
+                for (uint8_t const *element = span.first;
+                     element < span.last && !isReduced(current);
+                     element += span.element_size) {
+                        current = floatWindowReducerApply(
+                            reducer, state, valueOfSpanElement(span, element),
+                            current, allocator);
+                }
+                return current;
+        }
+
+        float const *last = (float const *)span.last;
+        for (float const *x = (float const *)span.first;
+             x < last && !isReduced(current); x++) {
+                float aggregate;
+                if (!windowPush(self, window, *x, &aggregate)) {
+                        continue;
+                }
+                window->output[window->outputCount++] = aggregate;
+                if (window->outputCount == WINDOW_OUTPUT_SIZE) {
+                        current = windowFlush(self, window, current, allocator);
+                }
+        }
+        if (window->outputCount > 0 && !isReduced(current)) {
+                current = windowFlush(self, window, current, allocator);
+        }
+
+        return current;
+}
+
+static struct Reducer *
+floatWindowTransducerApply(struct Transducer *transducer,
+                           struct Reducer const *step,
+                           struct Allocator *allocator)
+{
+        struct FloatWindowTransducer *self =
+            (struct FloatWindowTransducer *)transducer;
+        struct FloatWindowReducer *result =
+            allocator_alloc(allocator, sizeof *result);
+
+        size_t const ringOffset = sizeof(struct WindowState);
+        size_t dequeOffset = ringOffset + self->size * sizeof(float);
+        dequeOffset = (dequeOffset + alignof(struct WindowEntry) - 1) /
+                      alignof(struct WindowEntry) *
+                      alignof(struct WindowEntry);
+        size_t stateSize = dequeOffset;
+        if (self->aggregate == FW_Min || self->aggregate == FW_Max) {
+                stateSize += self->size * sizeof(struct WindowEntry);
+        }
+
+        result->super = chainedReducerMake(step, floatWindowReducerApply,
+                                           stateSize);
+        result->super.super.apply_batch = floatWindowReducerApplyBatch;
+        result->aggregate = self->aggregate;
+        result->size = self->size;
+        result->stride = self->stride;
+        result->ringOffset = ringOffset;
+        result->dequeOffset = dequeOffset;
+
+        return &result->super.super;
+}
+
+struct Transducer *floatWindowTransducer(enum FloatWindowAggregate aggregate,
+                                         size_t size, size_t stride,
+                                         struct Allocator *allocator)
+{
+        struct FloatWindowTransducer *transducer =
+            allocator_alloc(allocator, sizeof *transducer);
+
+        *transducer = (struct FloatWindowTransducer){
+            .aggregate = aggregate,
+            .size = size,
+            .stride = stride,
+            .super = (struct Transducer){
+                .apply = floatWindowTransducerApply,
+            }};
+
+        return &transducer->super;
+}
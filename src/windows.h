@@ -0,0 +1,33 @@
+#pragma once
+
+/**
+ * @file
+ * Sliding-window aggregates of TTAG_FLOAT streams.
+ *
+ * A window stage keeps the last size floats it received in a ring buffer
+ * within the state of the reduction and, once it holds size of them,
+ * forwards the aggregate of the window every stride elements: stride 1
+ * gives a moving aggregate, stride size consecutive blocks. Each element
+ * costs O(1) amortized, whatever the size of the window.
+ *
+ * Elements other than floats are ignored. Windows are only complete once
+ * they hold size elements, so completing forwards nothing more.
+ */
+
+struct Allocator;
+struct Transducer;
+
+#include <stddef.h>
+
+enum FloatWindowAggregate {
+        FW_Sum,
+        FW_Mean,
+        FW_Min,
+        FW_Max,
+};
+
+/// forwards the aggregate of the last size floats every stride floats,
+/// size > 0 and stride > 0
+struct Transducer *floatWindowTransducer(enum FloatWindowAggregate aggregate,
+                                         size_t size, size_t stride,
+                                         struct Allocator *allocator);
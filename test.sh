@@ -2,4 +2,9 @@
 HERE="$(dirname ${0})"
 BUILD="${HERE}/builds"
 [ -d "${BUILD}" ] || mkdir -p "${BUILD}"
-"${HERE}"/build.sh && "${HERE}"/builds/"$(hostname)"/main
+"${HERE}"/build.sh && "${HERE}"/builds/"$(hostname)"/main || exit 1
+
+# the tests again under AddressSanitizer, reporting only its errors; the
+# tests do not release their reducers, so leaks are not checked
+"${HERE}"/build.sh --output-dir "${BUILD}"/asan asan > /dev/null &&
+    ASAN_OPTIONS=detect_leaks=0 "${BUILD}"/asan/"$(hostname)"/main > /dev/null